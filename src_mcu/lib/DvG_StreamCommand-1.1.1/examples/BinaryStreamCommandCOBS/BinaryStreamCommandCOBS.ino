@@ -0,0 +1,38 @@
+/** @example BinaryStreamCommandCOBS.ino
+
+Listen to the serial port for COBS-framed binary commands and act upon them.
+
+Each binary command is encoded by Consistent Overhead Byte Stuffing (COBS),
+such that it contains no 0x00 bytes, and is terminated by a single 0x00 byte.
+Hence, the command itself may contain any byte value.
+
+This demo will simply send every received command back as a COBS frame.
+*/
+
+#include "DvG_StreamCommand.h"
+#include <Arduino.h>
+
+// Instantiate serial port listener for receiving COBS-framed binary commands
+const uint8_t BIN_BUF_LEN = 64; // Length of the binary command buffer
+uint8_t bin_buf[BIN_BUF_LEN];   // The binary command buffer
+DvG_BinaryStreamCommand bsc(Serial, bin_buf, BIN_BUF_LEN);
+
+void setup() { Serial.begin(9600); }
+
+void loop() {
+  // Poll the Serial stream for incoming bytes
+  int8_t bsc_available = bsc.available();
+
+  if (bsc_available == -1) {
+    // The remainder of the too long command will be skipped
+    bsc.reset();
+
+  } else if (bsc_available) {
+    // A new command is available --> Get the number of decoded bytes and act
+    // upon it
+    uint16_t data_len = bsc.getCommandLength();
+
+    // Simply send the decoded command back, encoded again
+    DvG_BinaryStreamCommand::writeCOBS(Serial, bin_buf, data_len);
+  }
+}
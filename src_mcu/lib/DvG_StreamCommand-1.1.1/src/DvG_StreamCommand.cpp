@@ -2,7 +2,7 @@
  * @file    DvG_StreamCommand.cpp
  * @author  Dennis van Gils (vangils.dennis@gmail.com)
  * @version https://github.com/Dennis-van-Gils/DvG_StreamCommand
- * @version 1.1.0
+ * @version 1.3.0
  * @date    30-08-2022
  *
  * @mainpage A lightweight Arduino library to listen for commands over a stream.
@@ -16,16 +16,24 @@
  * Method `available()` should be called repeatedly to poll for characters or
  * bytes incoming to the stream. It will return true when a new completely
  * received command is ready to be processed by the user. See the examples @ref
- * StreamCommand.ino and @ref BinaryStreamCommand.ino.
+ * StreamCommand.ino, @ref BinaryStreamCommand.ino and @ref
+ * BinaryStreamCommandCOBS.ino.
  *
  * @section author Author
  * Dennis van Gils (vangils.dennis@gmail.com)
  *
  * @section version Version
  * - https://github.com/Dennis-van-Gils/DvG_StreamCommand
- * - v1.1.0
+ * - v1.3.0
  *
  * @section Changelog
+ * - v1.3.0 - Added a COBS framing mode to `DvG_BinaryStreamCommand`, with the
+ * encoders `writeCOBS()` and `encodeCOBS()` for replies. The EOL sentinel is
+ * matched incrementally and `reset()` no longer clears the buffer.
+ * - v1.2.0 - Added classes `DvG_Arg` and `DvG_ArgList` to split a command into
+ * typed arguments in place. Added the parse functions `scanInt()` and
+ * `scanFloat()`, which replace the C library parsers.
+ * `DvG_StreamCommand::available()` reads the stream in bulk.
  * - v1.1.0 - Added method `reset()`
  * - v1.0.0 - Initial commit. This is the improved successor to
  * `DvG_SerialCommand`.
@@ -36,6 +44,10 @@
 
 #include "DvG_StreamCommand.h"
 
+#include <ctype.h>
+#include <float.h>
+#include <limits.h>
+
 /*******************************************************************************
   DvG_StreamCommand
 *******************************************************************************/
@@ -49,40 +61,116 @@ DvG_StreamCommand::DvG_StreamCommand(Stream &stream, char *buffer,
   reset();
 }
 
-bool DvG_StreamCommand::available() {
-  char c;
+/**
+ * @brief Return the index of the first carriage return or line feed character
+ * in @p str of length @p len, or @p len when there is none. Scans a word of 4
+ * characters at a time.
+ */
+static uint16_t find_CR_or_LF(const char *str, uint16_t len) {
+  const uint32_t ONES = 0x01010101UL;
+  const uint32_t HIGHS = 0x80808080UL;
+  uint16_t i = 0;
 
+  for (; i + 4 <= len; i += 4) {
+    uint32_t word;
+    memcpy(&word, str + i, 4); // Unaligned load
+    uint32_t x_CR = word ^ (ONES * 13);
+    uint32_t x_LF = word ^ (ONES * 10);
+    // Non-zero when any of the bytes of `x_CR` or `x_LF` is zero
+    if (((x_CR - ONES) & ~x_CR & HIGHS) | ((x_LF - ONES) & ~x_LF & HIGHS)) {
+      break;
+    }
+  }
+  for (; i < len; ++i) {
+    if (str[i] == 13 || str[i] == 10) {
+      break;
+    }
+  }
+  return i;
+}
+
+bool DvG_StreamCommand::available() {
   // Poll the input buffer of the stream for data
-  if (_stream.available()) {
-    _fTerminated = false;
-    while (_stream.available()) {
-      c = _stream.peek();
+  if (!_pend_len && !_stream.available()) {
+    return _fTerminated;
+  }
+  _fTerminated = false;
 
-      if (c == 13) {
-        // Ignore ASCII 13 (carriage return)
-        _stream.read(); // Remove char from the stream input buffer
+  while (true) {
+    char *chunk = &_buffer[_cur_len];
+    uint16_t room = _max_len - 1 - _cur_len;
+    uint16_t n;
 
-      } else if (c == 10) {
-        // Found ASCII 10 (line feed) --> Terminate string
-        _stream.read(); // Remove char from the stream input buffer
-        _buffer[_cur_len] = '\0';
-        _fTerminated = true;
+    if (_pend_len) {
+      // Bytes read past the previous line feed. These always fit.
+      memmove(chunk, &_buffer[_pend_start], _pend_len);
+      n = _pend_len;
+      _pend_len = 0;
+
+    } else if (room) {
+      // Bulk read as many chars as can be appended to the string
+      int n_avail = _stream.available();
+      if (n_avail <= 0) {
+        break;
+      }
+      if (n_avail < room) {
+        room = (uint16_t)n_avail;
+      }
+      n = (uint16_t)_stream.readBytes(chunk, room);
+      if (n == 0) {
         break;
+      }
 
-      } else if (_cur_len < _max_len - 1) {
-        // Append char to string
+    } else {
+      // Maximum buffer length is reached. Only a carriage return or line feed
+      // can still be taken in, so peek at the next char.
+      if (!_stream.available()) {
+        break;
+      }
+      char c = _stream.peek();
+      if (c == 13) {
+        // Ignore ASCII 13 (carriage return)
         _stream.read(); // Remove char from the stream input buffer
-        _buffer[_cur_len] = c;
-        _cur_len++;
+        continue;
+      }
+      if (c == 10) {
+        // Found ASCII 10 (line feed)
+        _stream.read(); // Remove char from the stream input buffer
+      }
+      // Forcefully terminate the string in the command buffer now. Leave any
+      // other char in the stream input buffer.
+      _buffer[_cur_len] = '\0';
+      _fTerminated = true;
+      break;
+    }
 
-      } else {
-        // Maximum buffer length is reached. Forcefully terminate the string
-        // in the command buffer now. Leave the char in the stream input buffer.
-        _buffer[_cur_len] = '\0';
+    // Strip ASCII 13 (carriage return) and stop at ASCII 10 (line feed)
+    uint16_t i_read = 0;  // Index into the chunk to read from
+    uint16_t i_write = 0; // Index into the chunk to append to
+    while (i_read < n) {
+      uint16_t i_found = i_read + find_CR_or_LF(&chunk[i_read], n - i_read);
+      if (i_write != i_read) {
+        memmove(&chunk[i_write], &chunk[i_read], i_found - i_read);
+      }
+      i_write += i_found - i_read;
+      i_read = i_found + 1;
+      if (i_found < n && chunk[i_found] == 10) {
         _fTerminated = true;
         break;
       }
     }
+    _cur_len += i_write;
+
+    if (_fTerminated) {
+      // Found ASCII 10 (line feed) --> Terminate string. Keep the chars after
+      // it for the next command, they lie past the '\0'.
+      _buffer[_cur_len] = '\0';
+      if (i_read < n) {
+        _pend_start = (uint16_t)(chunk - _buffer) + i_read;
+        _pend_len = n - i_read;
+      }
+      break;
+    }
   }
 
   return _fTerminated;
@@ -113,10 +201,57 @@ DvG_BinaryStreamCommand::DvG_BinaryStreamCommand(Stream &stream,
   _buffer = buffer;
   _max_len = max_len;
   _EOL = EOL;
-  _EOL_len = EOL_len;
+  _EOL_len = (EOL != nullptr) ? EOL_len : 0;
+  _EOL_fail = nullptr;
+  _cobs = (_EOL_len == 0);
+
+  if (!_cobs) {
+    // Failure table of the EOL matcher, allocated once. Without it, a mismatch
+    // falls back to the start of the sentinel, which is only exact for
+    // sentinels of which no proper prefix is also a suffix.
+    _EOL_fail = (uint8_t *)malloc(_EOL_len);
+    if (_EOL_fail != nullptr) {
+      uint8_t k = 0;
+      _EOL_fail[0] = 0;
+      for (uint8_t i = 1; i < _EOL_len; ++i) {
+        while (k > 0 && _EOL[i] != _EOL[k]) {
+          k = _EOL_fail[k - 1];
+        }
+        if (_EOL[i] == _EOL[k]) {
+          k++;
+        }
+        _EOL_fail[i] = k;
+      }
+
+      // Skip the fallbacks that expect the same byte as the one that just
+      // mismatched, so that runs of a repeated sentinel byte fall back at once
+      for (uint8_t n = 1; n < _EOL_len; ++n) {
+        k = _EOL_fail[n - 1];
+        if (k > 0 && _EOL[k] == _EOL[n]) {
+          _EOL_fail[n - 1] = _EOL_fail[k - 1];
+        }
+      }
+    }
+  }
+  reset();
+}
+
+DvG_BinaryStreamCommand::DvG_BinaryStreamCommand(Stream &stream,
+                                                 uint8_t *buffer,
+                                                 uint16_t max_len)
+    : _stream(stream) // Initialize reference before body
+{
+  _buffer = buffer;
+  _max_len = max_len;
+  _EOL = nullptr;
+  _EOL_len = 0;
+  _EOL_fail = nullptr;
+  _cobs = true;
   reset();
 }
 
+DvG_BinaryStreamCommand::~DvG_BinaryStreamCommand() { free(_EOL_fail); }
+
 int8_t DvG_BinaryStreamCommand::available(bool debug_info) {
   uint8_t c;
 
@@ -128,6 +263,19 @@ int8_t DvG_BinaryStreamCommand::available(bool debug_info) {
       _stream.write('\t');
     }
 
+    if (_cobs) {
+      int8_t state = pushCOBS(c);
+      if (state == -1) {
+        return -1;
+      } else if (state == 1) {
+        if (debug_info) {
+          _stream.print("EOL\t");
+        }
+        break;
+      }
+      continue;
+    }
+
     if (_cur_len < _max_len) {
       _buffer[_cur_len] = c;
       _cur_len++;
@@ -137,29 +285,58 @@ int8_t DvG_BinaryStreamCommand::available(bool debug_info) {
       return -1;
     }
 
-    // Check for EOL at the end
-    if (_cur_len >= _EOL_len) {
-      _found_EOL = true;
-      for (uint8_t i = 0; i < _EOL_len; ++i) {
-        if (_buffer[_cur_len - i - 1] != _EOL[_EOL_len - i - 1]) {
-          _found_EOL = false;
-          break; // Any mismatch will exit early
-        }
+    // Advance the EOL matcher. On a mismatch, continue from the longest part
+    // of the sentinel that still matches.
+    uint8_t n = _n_matched;
+    if (c != _EOL[n]) {
+      while (n > 0 && c != _EOL[n]) {
+        n = (_EOL_fail != nullptr) ? _EOL_fail[n - 1] : 0;
       }
-      if (_found_EOL) {
-        // Wait with reading in more bytes from the stream input buffer to let
-        // the user act upon the currently received command
-        if (debug_info) {
-          _stream.print("EOL\t");
-        }
-        break;
+      if (c != _EOL[n]) {
+        _n_matched = 0;
+        continue;
       }
     }
+    _n_matched = ++n;
+    if (n == _EOL_len) {
+      _found_EOL = true;
+      _n_matched = 0;
+
+      // Wait with reading in more bytes from the stream input buffer to let
+      // the user act upon the currently received command
+      if (debug_info) {
+        _stream.print("EOL\t");
+      }
+      break;
+    }
   }
 
   return _found_EOL;
 }
 
+int8_t DvG_BinaryStreamCommand::pushCOBS(uint8_t c) {
+  if (c != 0x00) {
+    if (_skip) {
+      return 0;
+    }
+    if (_cur_len == _max_len) {
+      // Drop the remainder of the frame
+      _skip = true;
+      return -1;
+    }
+    _buffer[_cur_len] = c;
+    _cur_len++;
+    return 0;
+  }
+
+  // End of the frame. Skip empty frames and the tail of an overrun.
+  uint16_t len = _cur_len;
+  _found_EOL = !_skip && len > 0 && decodeCOBS(_buffer, len);
+  _cur_len = _found_EOL ? len : 0;
+  _skip = false;
+  return _found_EOL;
+}
+
 uint16_t DvG_BinaryStreamCommand::getCommandLength() {
   uint16_t len;
 
@@ -175,16 +352,290 @@ uint16_t DvG_BinaryStreamCommand::getCommandLength() {
   return len;
 }
 
+uint16_t DvG_BinaryStreamCommand::encodeCOBS(const uint8_t *src, uint16_t len,
+                                             uint8_t *dst) {
+  // Each block starts with a code byte: 1 + the number of non-zero data bytes
+  // following it. A code below 0xFF implies a 0x00 after the block, except at
+  // the end.
+  uint16_t out = 1;
+  uint16_t code_idx = 0;
+  uint8_t code = 1;
+  for (uint16_t i = 0; i < len; ++i) {
+    if (code == 0xFF) {
+      // Full block of 254 bytes, start a new one
+      dst[code_idx] = code;
+      code_idx = out++;
+      code = 1;
+    }
+    if (src[i] == 0x00) {
+      dst[code_idx] = code;
+      code_idx = out++;
+      code = 1;
+    } else {
+      dst[out++] = src[i];
+      code++;
+    }
+  }
+  dst[code_idx] = code;
+  return out;
+}
+
+bool DvG_BinaryStreamCommand::decodeCOBS(uint8_t *buf, uint16_t &len) {
+  // The decoded bytes never overtake the encoded ones, so decode in place
+  uint16_t in = 0;
+  uint16_t out = 0;
+  while (in < len) {
+    uint8_t code = buf[in++];
+    if (code == 0x00 || code - 1 > len - in) {
+      return false;
+    }
+    memmove(&buf[out], &buf[in], code - 1);
+    in += code - 1;
+    out += code - 1;
+    if (code < 0xFF && in < len) {
+      buf[out++] = 0x00;
+    }
+  }
+  len = out;
+  return true;
+}
+
+size_t DvG_BinaryStreamCommand::writeCOBS(Print &out, const uint8_t *data,
+                                          uint16_t len) {
+  size_t n = 0;
+  uint16_t start = 0;
+  while (true) {
+    // Block of up to 254 non-zero bytes, ended by a 0x00 or the end of data
+    uint16_t end = start;
+    while (end < len && data[end] != 0x00 && end - start < 254) {
+      end++;
+    }
+    n += out.write((uint8_t)(end - start + 1));
+    n += out.write(&data[start], end - start);
+    if (end == len) {
+      break;
+    }
+    // A block below 254 bytes was ended by a 0x00, which gets consumed
+    start = (end - start < 254) ? end + 1 : end;
+  }
+  n += out.write((uint8_t)0x00);
+  return n;
+}
+
+/*******************************************************************************
+  DvG_Arg and DvG_ArgList
+*******************************************************************************/
+
+bool DvG_Arg::toInt(int64_t &value) const {
+  int64_t parsed;
+  const char *end = scanInt(_str, parsed);
+  if (end == nullptr || *end != '\0') {
+    return false;
+  }
+  value = parsed;
+  return true;
+}
+
+bool DvG_Arg::toInt(int32_t &value) const {
+  int64_t parsed;
+  if (!toInt(parsed) || parsed < INT32_MIN || parsed > INT32_MAX) {
+    return false;
+  }
+  value = (int32_t)parsed;
+  return true;
+}
+
+bool DvG_Arg::toFloat(float &value) const {
+  float parsed;
+  const char *end = scanFloat(_str, parsed);
+  if (end == nullptr || *end != '\0') {
+    return false;
+  }
+  value = parsed;
+  return true;
+}
+
+bool DvG_Arg::toBool(bool &value) const {
+  if (equals("true") || equals("True") || equals("TRUE")) {
+    value = true;
+    return true;
+  }
+  if (equals("false") || equals("False") || equals("FALSE")) {
+    value = false;
+    return true;
+  }
+  int64_t parsed;
+  if (!toInt(parsed)) {
+    return false;
+  }
+  value = (parsed != 0);
+  return true;
+}
+
+bool DvG_Arg::toEnum(const char *const names[], uint8_t n_names,
+                     uint8_t &index) const {
+  for (uint8_t i = 0; i < n_names; ++i) {
+    if (equals(names[i])) {
+      index = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+uint8_t DvG_ArgList::split(char *str, char delimiter) {
+  _n_args = 0;
+  while (true) {
+    while (*str == delimiter) {
+      *str++ = '\0';
+    }
+    if (*str == '\0') {
+      break;
+    }
+    _args[_n_args++] = DvG_Arg(str);
+    if (_n_args == MAX_ARGS) {
+      break; // Keep the remainder in the last argument
+    }
+    while (*str != '\0' && *str != delimiter) {
+      str++;
+    }
+  }
+  return _n_args;
+}
+
 /*******************************************************************************
   Parse functions
 *******************************************************************************/
 
+static inline bool is_digit(char c) { return (c >= '0' && c <= '9'); }
+
+const char *scanInt(const char *str, int64_t &value) {
+  // Accumulate the magnitude, checking against the range of int64_t before
+  // each digit. Avoids 64-bit divisions, which are library calls on a 32-bit
+  // MCU.
+  const uint64_t LIMIT_DIV_10 = 922337203685477580ULL; // INT64_MAX / 10
+  bool negative = (*str == '-');
+  if (*str == '-' || *str == '+') {
+    str++;
+  }
+  if (!is_digit(*str)) {
+    return nullptr;
+  }
+
+  uint8_t limit_last = (negative ? 8 : 7); // Last digit of INT64_MIN or MAX
+  uint64_t magnitude = 0;
+  while (is_digit(*str)) {
+    uint8_t digit = *str - '0';
+    if (magnitude > LIMIT_DIV_10 ||
+        (magnitude == LIMIT_DIV_10 && digit > limit_last)) {
+      return nullptr; // Out of range
+    }
+    magnitude = magnitude * 10 + digit;
+    str++;
+  }
+
+  value = (negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude);
+  return str;
+}
+
+const char *scanFloat(const char *str, float &value) {
+  // Powers of ten that are exact in double precision
+  static const double POW10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                 1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                 1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                 1e18, 1e19, 1e20, 1e21, 1e22};
+  const uint64_t MANTISSA_LIMIT = 1000000000000000000ULL; // 18 digits
+  bool negative = (*str == '-');
+  if (*str == '-' || *str == '+') {
+    str++;
+  }
+
+  // Collect the significant digits into an integer mantissa, with a decimal
+  // exponent for the digits beyond its capacity and the fraction digits
+  uint64_t mantissa = 0;
+  int32_t exp10 = 0;
+  bool has_digits = false;
+  while (is_digit(*str)) {
+    if (mantissa < MANTISSA_LIMIT) {
+      mantissa = mantissa * 10 + (*str - '0');
+    } else {
+      exp10++;
+    }
+    has_digits = true;
+    str++;
+  }
+  if (*str == '.') {
+    str++;
+    while (is_digit(*str)) {
+      if (mantissa < MANTISSA_LIMIT) {
+        mantissa = mantissa * 10 + (*str - '0');
+        exp10--;
+      }
+      has_digits = true;
+      str++;
+    }
+  }
+  if (!has_digits) {
+    return nullptr;
+  }
+
+  // Optional exponent, only consumed when followed by digits
+  if (*str == 'e' || *str == 'E') {
+    const char *exp_str = str + 1;
+    bool exp_negative = (*exp_str == '-');
+    if (*exp_str == '-' || *exp_str == '+') {
+      exp_str++;
+    }
+    if (is_digit(*exp_str)) {
+      int32_t exp = 0;
+      while (is_digit(*exp_str)) {
+        if (exp < 10000) {
+          exp = exp * 10 + (*exp_str - '0');
+        }
+        exp_str++;
+      }
+      exp10 += (exp_negative ? -exp : exp);
+      str = exp_str;
+    }
+  }
+
+  // Scale in double precision. A mantissa up to 2^53 times a power of ten up
+  // to 1e22 is rounded correctly, leaving at most 1 ULP after rounding to
+  // float.
+  double result = (double)mantissa;
+  if (mantissa != 0) {
+    while (exp10 < -22 && result != 0) {
+      result /= 1e22;
+      exp10 += 22;
+    }
+    while (exp10 > 22 && result <= FLT_MAX) {
+      result *= 1e22;
+      exp10 -= 22;
+    }
+    if (exp10 < 0) {
+      result /= POW10[-exp10 < 22 ? -exp10 : 22];
+    } else {
+      result *= POW10[exp10 < 22 ? exp10 : 22];
+    }
+    if (result > FLT_MAX) {
+      return nullptr; // Out of range
+    }
+  }
+
+  value = (negative ? -(float)result : (float)result);
+  return str;
+}
+
 float parseFloatInString(const char *str_in, uint16_t pos) {
+  float value = 0.0f;
   if (strlen(str_in) > pos) {
-    return (float)atof(&str_in[pos]);
-  } else {
-    return 0.0f;
+    const char *str = &str_in[pos];
+    while (isspace(*str)) {
+      str++;
+    }
+    scanFloat(str, value);
   }
+  return value;
 }
 
 bool parseBoolInString(const char *str_in, uint16_t pos) {
@@ -194,16 +645,22 @@ bool parseBoolInString(const char *str_in, uint16_t pos) {
         strncmp(&str_in[pos], "TRUE", 4) == 0) {
       return true;
     }
-    return (atoi(&str_in[pos]) != 0);
+    return (parseIntInString(str_in, pos) != 0);
   } else {
     return false;
   }
 }
 
 int parseIntInString(const char *str_in, uint16_t pos) {
+  int64_t value = 0;
   if (strlen(str_in) > pos) {
-    return atoi(&str_in[pos]);
-  } else {
-    return 0;
+    const char *str = &str_in[pos];
+    while (isspace(*str)) {
+      str++;
+    }
+    if (scanInt(str, value) == nullptr || value < INT_MIN || value > INT_MAX) {
+      value = 0;
+    }
   }
+  return (int)value;
 }
\ No newline at end of file
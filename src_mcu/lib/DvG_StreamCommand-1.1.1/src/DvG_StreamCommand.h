@@ -28,6 +28,11 @@
  * array (C-string, i.e. '\0' terminated) to store incoming characters into.
  * This keeps the memory usage low and unfragmented, instead of relying on
  * memory hungry C++ strings.
+ *
+ * Incoming characters are read from the stream in bulk. Characters received
+ * after a line feed get read in as well. These are held in the command buffer,
+ * past the '\0' of the received command, and taken in as the start of the next
+ * command. Hence, do not read from the stream directly in between commands.
  */
 class DvG_StreamCommand {
 public:
@@ -45,8 +50,8 @@ public:
   DvG_StreamCommand(Stream &stream, char *buffer, uint16_t max_len);
 
   /**
-   * @brief Poll the stream for incoming characters and append them one-by-one
-   * to the command buffer @p buffer. This method should be called repeatedly.
+   * @brief Poll the stream for incoming characters and append them in bulk to
+   * the command buffer @p buffer. This method should be called repeatedly.
    *
    * @return True when a complete command has been received and is ready to be
    * returned by @ref getCommand(), false otherwise.
@@ -62,21 +67,25 @@ public:
   char *getCommand();
 
   /**
-   * @brief Empty the command buffer.
+   * @brief Empty the command buffer, discarding the chars read past the last
+   * line feed as well.
    */
   inline void reset() {
     _fTerminated = false;
     _buffer[0] = '\0';
     _cur_len = 0;
+    _pend_len = 0;
   }
 
 private:
-  Stream &_stream;         // Reference to the stream to listen to
-  char *_buffer;           // Reference to the command buffer
-  uint16_t _max_len;       // Array size of the command buffer
-  uint16_t _cur_len;       // Number of currently received command characters
-  bool _fTerminated;       // Has a complete command been received?
-  const char *_empty = ""; // Empty reply, which is just the '\0' character
+  Stream &_stream;          // Reference to the stream to listen to
+  char *_buffer;            // Reference to the command buffer
+  uint16_t _max_len;        // Array size of the command buffer
+  uint16_t _cur_len;        // Number of currently received command characters
+  bool _fTerminated;        // Has a complete command been received?
+  const char *_empty = "";  // Empty reply, which is just the '\0' character
+  uint16_t _pend_start = 0; // Index of the chars read past the line feed
+  uint16_t _pend_len = 0;   // Number of chars read past the line feed
 };
 
 /*******************************************************************************
@@ -92,10 +101,21 @@ private:
  * received that matches the 'end-of-line' (EOL) sentinel. The EOL sentinel is
  * supplied by the user and should be a single sequence of bytes of fixed length
  * that is unique, i.e. will not appear anywhere inside of the command / data
- * packet that it is suffixing.
+ * packet that it is suffixing. The EOL sentinel is matched incrementally,
+ * Knuth-Morris-Pratt style, at an amortized cost of one comparison per
+ * received byte regardless of its length.
  *
  * The command buffer is supplied by the user and must be a fixed-size uint8_t
  * array to store incoming bytes into.
+ *
+ * Alternatively, when no EOL sentinel is supplied, the commands are expected
+ * to be framed by Consistent Overhead Byte Stuffing (COBS). Each command is
+ * then encoded such that it contains no 0x00 bytes and is terminated by a
+ * single 0x00 byte. This allows commands of any content, at the cost of at
+ * most 1 byte of overhead per 254 bytes. The received command gets decoded in
+ * place in the command buffer. Replies can be encoded by @ref writeCOBS() or
+ * @ref encodeCOBS(). A frame that fails to decode is dropped. After a buffer
+ * overrun, the remainder of the frame is skipped up to its 0x00 byte.
  */
 class DvG_BinaryStreamCommand {
 public:
@@ -110,11 +130,31 @@ public:
    * @param EOL Reference to the end-of-line sentinel: A fixed-size uint8_t
    * array containing a unique sequence of bytes.
    * @param EOL_len Array size of @p EOL. Do not exceed the maximum size of
-   * 2^^8 = 256 bytes.
+   * 2^^8 - 1 = 255 bytes. When 0, the commands are expected to be COBS-framed
+   * instead.
    */
   DvG_BinaryStreamCommand(Stream &stream, uint8_t *buffer, uint16_t max_len,
                           const uint8_t *EOL, uint8_t EOL_len);
 
+  /**
+   * @brief Construct a new DvG_BinaryStreamCommand object, listening for
+   * COBS-framed commands.
+   *
+   * @param stream Reference to a stream to listen to, e.g. Serial, Wire, etc.
+   * @param buffer Reference to the command buffer: A fixed-size uint8_t array
+   * which will be managed by this class to hold a single incoming command. It
+   * has to fit the encoded command, i.e. 1 byte more per started 254 bytes.
+   * @param max_len Array size of @p buffer. Do not exceed the maximum size of
+   * 2^^16 = 65536 bytes.
+   */
+  DvG_BinaryStreamCommand(Stream &stream, uint8_t *buffer, uint16_t max_len);
+
+  ~DvG_BinaryStreamCommand();
+
+  // Not copyable, as it owns the table of the EOL matcher
+  DvG_BinaryStreamCommand(const DvG_BinaryStreamCommand &) = delete;
+  DvG_BinaryStreamCommand &operator=(const DvG_BinaryStreamCommand &) = delete;
+
   /**
    * @brief Poll the stream for incoming bytes and append them one-by-one to the
    * command buffer @p buffer. This method should be called repeatedly.
@@ -134,7 +174,8 @@ public:
 
   /**
    * @brief Return the length of the command without the EOL sentinel in bytes,
-   * only when a complete command has been received. The received command can be
+   * or the decoded length in COBS mode, only when a complete command has been
+   * received. The received command can be
    * read from the user-supplied command buffer up to this length. Otherwise, 0
    * is returned.
    *
@@ -143,30 +184,203 @@ public:
   uint16_t getCommandLength();
 
   /**
-   * @brief Empty the command buffer.
+   * @brief Empty the command buffer. The buffer contents are left as is, only
+   * the received length is cleared.
    */
   inline void reset() {
-    for (uint16_t i = 0; i < _max_len; ++i) {
-      _buffer[i] = 0;
-    }
     _found_EOL = false;
     _cur_len = 0;
+    _n_matched = 0;
   }
 
+  /**
+   * @brief Encode @p len bytes at @p src by COBS into @p dst, without the
+   * terminating 0x00 byte.
+   *
+   * @param dst Output buffer of at least `len + len / 254 + 1` bytes. Must
+   * not overlap @p src.
+   *
+   * @return The encoded length in bytes
+   */
+  static uint16_t encodeCOBS(const uint8_t *src, uint16_t len, uint8_t *dst);
+
+  /**
+   * @brief Decode a COBS-encoded frame of @p len bytes in place, without its
+   * terminating 0x00 byte.
+   *
+   * @param len Encoded length on input, decoded length on output
+   *
+   * @return False when the frame is malformed, in which case @p buf has been
+   * partially overwritten and @p len is left unchanged
+   */
+  static bool decodeCOBS(uint8_t *buf, uint16_t &len);
+
+  /**
+   * @brief Write @p len bytes at @p data to @p out as a COBS frame, including
+   * the terminating 0x00 byte. Needs no intermediate buffer.
+   *
+   * @return The number of bytes written
+   */
+  static size_t writeCOBS(Print &out, const uint8_t *data, uint16_t len);
+
 private:
+  int8_t pushCOBS(uint8_t c);
+
   Stream &_stream;     // Reference to the stream to listen to
   uint8_t *_buffer;    // Reference to the command buffer
   uint16_t _max_len;   // Array size of the command buffer
   uint16_t _cur_len;   // Number of currently received command bytes
   const uint8_t *_EOL; // Reference to the end-of-line sentinel
   uint16_t _EOL_len;   // Array size of the end-of-line sentinel
+  uint8_t *_EOL_fail;  // Matched length to fall back to on a mismatch, per
+                       // matched length minus 1
+  uint8_t _n_matched;  // Number of EOL bytes matched so far
   bool _found_EOL;     // Has a complete command been received?
+  bool _cobs = false;  // Listen for COBS frames instead of an EOL sentinel?
+  bool _skip = false;  // Skip up to the next COBS frame after an overrun?
+};
+
+/*******************************************************************************
+  DvG_Arg and DvG_ArgList
+*******************************************************************************/
+
+/**
+ * @brief View of a single argument inside of a command buffer, with accessors
+ * that parse it into a typed value.
+ *
+ * The accessors parse the full argument in a single pass. When the argument
+ * is not a valid value of the requested type they return false and leave the
+ * value untouched, so that a default can be preset.
+ */
+class DvG_Arg {
+public:
+  /**
+   * @brief Construct a new DvG_Arg object.
+   *
+   * @param str '\0'-terminated argument, which must outlive this object
+   */
+  DvG_Arg(const char *str = "") : _str(str) {}
+
+  /**
+   * @brief Return the argument as C-string.
+   */
+  inline const char *c_str() const { return _str; }
+
+  inline bool isEmpty() const { return _str[0] == '\0'; }
+
+  /**
+   * @brief Return true when the argument matches @p str exactly.
+   */
+  inline bool equals(const char *str) const { return strcmp(_str, str) == 0; }
+
+  /**
+   * @brief Parse a decimal integer, optionally signed.
+   *
+   * @return True when successful and within range, false otherwise
+   */
+  bool toInt(int32_t &value) const;
+  bool toInt(int64_t &value) const;
+
+  /**
+   * @brief Parse a decimal floating point number, optionally with exponent.
+   *
+   * @return True when successful, false otherwise
+   */
+  bool toFloat(float &value) const;
+
+  /**
+   * @brief Parse a boolean: 'true', 'True' or 'TRUE', 'false', 'False' or
+   * 'FALSE', or else an integer where 0 is false and all others are true.
+   *
+   * @return True when successful, false otherwise
+   */
+  bool toBool(bool &value) const;
+
+  /**
+   * @brief Look up the argument in a list of names.
+   *
+   * @param names Array of C-strings to match against
+   * @param n_names Array size of @p names
+   * @param index Set to the index of the matching name
+   * @return True when found, false otherwise
+   */
+  bool toEnum(const char *const names[], uint8_t n_names,
+              uint8_t &index) const;
+
+private:
+  const char *_str;
+};
+
+/**
+ * @brief Class to split a command in place into arguments, without copying.
+ *
+ * The delimiters in the command buffer are overwritten by '\0' characters, so
+ * that each argument becomes a C-string of its own, viewed by a
+ * @ref DvG_Arg. Runs of delimiters count as one. E.g. `cfg slits 36` splits
+ * into the arguments `cfg`, `slits` and `36`.
+ */
+class DvG_ArgList {
+public:
+  static const uint8_t MAX_ARGS = 8; // Maximum number of arguments
+
+  /**
+   * @brief Split the C-string @p str in place. Any text beyond
+   * @ref MAX_ARGS arguments is kept in the last argument.
+   *
+   * @param str C-string to split, e.g. the command buffer as returned by
+   * @ref DvG_StreamCommand::getCommand()
+   * @param delimiter Character separating the arguments
+   * @return The number of arguments
+   */
+  uint8_t split(char *str, char delimiter = ' ');
+
+  /**
+   * @brief Return the number of arguments.
+   */
+  inline uint8_t count() const { return _n_args; }
+
+  /**
+   * @brief Return the argument at index @p i, or an empty argument when out
+   * of range.
+   */
+  inline DvG_Arg operator[](uint8_t i) const {
+    return (i < _n_args ? _args[i] : DvG_Arg());
+  }
+
+private:
+  DvG_Arg _args[MAX_ARGS];
+  uint8_t _n_args = 0;
 };
 
 /*******************************************************************************
   Parse functions
 *******************************************************************************/
 
+/**
+ * @brief Parse a decimal integer at the start of C-string @p str: An optional
+ * sign followed by digits. Single pass, without relying on `strtol()`.
+ *
+ * @param str C-string to parse
+ * @param value Set to the parsed value, only when successful
+ * @return The position right after the integer when successful, nullptr when
+ * @p str does not start with an integer or when it is out of range.
+ */
+const char *scanInt(const char *str, int64_t &value);
+
+/**
+ * @brief Parse a decimal floating point number at the start of C-string
+ * @p str: An optional sign, digits with an optional decimal point and an
+ * optional exponent. Single pass, without relying on `strtod()`, so that the
+ * C library floating point parser does not get linked in. The result is within
+ * 1 ULP of the correctly rounded value.
+ *
+ * @param str C-string to parse
+ * @param value Set to the parsed value, only when successful
+ * @return The position right after the number when successful, nullptr when
+ * @p str does not start with a number or when it is out of range.
+ */
+const char *scanFloat(const char *str, float &value);
+
 /**
  * @brief Safely parse a float value in C-string @p str_in from of position
  * @p pos.
@@ -0,0 +1,125 @@
+/**
+ * @file test_main.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Host benchmark of the parse functions `scanInt()` and `scanFloat()`
+ * against the C library parsers `strtoll()` and `strtof()`.
+ * @copyright MIT License. See the LICENSE file for details.
+ *
+ * Run with `pio test -e native -f test_bench_scan -v` to see the results. On
+ * x86 the time stamp counter is read as well, to give a rough number of cycles
+ * per call.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <x86intrin.h>
+#endif
+
+#include "DvG_StreamCommand.h"
+
+static const uint32_t N_STRINGS = 100000;
+static const uint32_t N_REPEAT = 10; // Timing runs, the fastest one counts
+
+static uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static double seconds() {
+  using namespace std::chrono;
+  return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Time @p parse over all @p strings and print the time per call.
+ */
+template <typename F>
+static void bench(const char *name, const std::vector<std::string> &strings,
+                  F parse) {
+  double t_best = 1e9;
+  uint64_t c_best = UINT64_MAX;
+  volatile double sink = 0;
+  for (uint32_t run = 0; run < N_REPEAT; ++run) {
+    double t = seconds();
+    uint64_t c = cycles();
+    double sum = 0;
+    for (const std::string &str : strings) {
+      sum += parse(str.c_str());
+    }
+    c_best = min(c_best, cycles() - c);
+    t_best = min(t_best, seconds() - t);
+    sink = sum;
+  }
+  (void)sink;
+
+  double n = strings.size();
+  printf("%-28s %6.1f ns/call %7.1f cycles/call\n", name, t_best / n * 1e9,
+         c_best / n);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_bench_int() {
+  std::mt19937_64 rng(1);
+  std::vector<std::string> small, large;
+  char str[32];
+  for (uint32_t i = 0; i < N_STRINGS; ++i) {
+    snprintf(str, sizeof(str), "%d", (int)(rng() % 20001) - 10000);
+    small.push_back(str);
+    snprintf(str, sizeof(str), "%lld", (long long)rng());
+    large.push_back(str);
+  }
+
+  auto scan = [](const char *s) {
+    int64_t v = 0;
+    scanInt(s, v);
+    return (double)v;
+  };
+  auto lib = [](const char *s) { return (double)strtoll(s, nullptr, 10); };
+  bench("scanInt, up to 5 digits", small, scan);
+  bench("strtoll, up to 5 digits", small, lib);
+  bench("scanInt, 19 digits", large, scan);
+  bench("strtoll, 19 digits", large, lib);
+}
+
+void test_bench_float() {
+  std::mt19937_64 rng(1);
+  std::uniform_real_distribution<float> uniform(-1000, 1000);
+  std::uniform_int_distribution<int> exp(-30, 30);
+  std::vector<std::string> fixed, scientific;
+  char str[32];
+  for (uint32_t i = 0; i < N_STRINGS; ++i) {
+    snprintf(str, sizeof(str), "%.3f", uniform(rng));
+    fixed.push_back(str);
+    snprintf(str, sizeof(str), "%.7ge%d", uniform(rng) / 1000, exp(rng));
+    scientific.push_back(str);
+  }
+
+  auto scan = [](const char *s) {
+    float v = 0;
+    scanFloat(s, v);
+    return (double)v;
+  };
+  auto lib = [](const char *s) { return (double)strtof(s, nullptr); };
+  bench("scanFloat, fixed point", fixed, scan);
+  bench("strtof, fixed point", fixed, lib);
+  bench("scanFloat, with exponent", scientific, scan);
+  bench("strtof, with exponent", scientific, lib);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_bench_int);
+  RUN_TEST(test_bench_float);
+  return UNITY_END();
+}
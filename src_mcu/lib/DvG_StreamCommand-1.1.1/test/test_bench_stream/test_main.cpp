@@ -0,0 +1,355 @@
+/**
+ * @file test_main.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Host benchmark of the stream readers, through a mock stream that
+ * hands out its input in USB packets of 64 bytes.
+ * @copyright MIT License. See the LICENSE file for details.
+ *
+ * Run with `pio test -e native -f test_bench_stream -v` to see the results.
+ * The line reader `DvG_StreamCommand` is compared against the char-by-char
+ * reader of v1.1.1, and the EOL matcher of `DvG_BinaryStreamCommand` against
+ * comparing the full sentinel after every byte, as v1.1.1 did. COBS framing is
+ * timed as well. Besides the throughput, the share of CPU time needed to keep
+ * up with an input of 1 MB/s is given.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+
+#include "DvG_StreamCommand.h"
+
+static const size_t N_BYTES = 1 << 20; // [bytes] Input per run
+static const size_t PACKET = 64;       // [bytes] Handed out per poll
+static const uint32_t N_REPEAT = 20;   // Timing runs, the fastest one counts
+
+/**
+ * @brief Stream serving @ref data, of which only the first @ref arrived bytes
+ * can be read so far.
+ */
+class MockStream : public Stream {
+public:
+  std::string data;
+  size_t pos = 0;
+  size_t arrived = 0;
+
+  size_t write(uint8_t) override { return 1; }
+  int available() override {
+    return (int)(min(arrived, data.size()) - pos);
+  }
+  int read() override { return (available() > 0 ? (uint8_t)data[pos++] : -1); }
+  int peek() override { return (available() > 0 ? (uint8_t)data[pos] : -1); }
+};
+
+/**
+ * @brief The line reader of v1.1.1, calling `available()`, `peek()` and
+ * `read()` per char.
+ */
+class PerCharReader {
+public:
+  PerCharReader(Stream &stream, char *buffer, uint16_t max_len)
+      : _stream(stream), _buffer(buffer), _max_len(max_len) {}
+
+  bool available() {
+    if (_stream.available()) {
+      _fTerminated = false;
+      while (_stream.available()) {
+        char c = _stream.peek();
+        if (c == 13) {
+          _stream.read();
+        } else if (c == 10) {
+          _stream.read();
+          _buffer[_cur_len] = '\0';
+          _fTerminated = true;
+          break;
+        } else if (_cur_len < _max_len - 1) {
+          _stream.read();
+          _buffer[_cur_len] = c;
+          _cur_len++;
+        } else {
+          _buffer[_cur_len] = '\0';
+          _fTerminated = true;
+          break;
+        }
+      }
+    }
+    return _fTerminated;
+  }
+
+  char *getCommand() {
+    _fTerminated = false;
+    _cur_len = 0;
+    return _buffer;
+  }
+
+private:
+  Stream &_stream;
+  char *_buffer;
+  uint16_t _max_len;
+  uint16_t _cur_len = 0;
+  bool _fTerminated = false;
+};
+
+/**
+ * @brief The binary reader of v1.1.1, comparing the full EOL sentinel against
+ * the end of the buffer after every byte.
+ */
+class TailCompareReader {
+public:
+  TailCompareReader(Stream &stream, uint8_t *buffer, uint16_t max_len,
+                    const uint8_t *EOL, uint8_t EOL_len)
+      : _stream(stream), _buffer(buffer), _max_len(max_len), _EOL(EOL),
+        _EOL_len(EOL_len) {}
+
+  int8_t available() {
+    while (_stream.available()) {
+      uint8_t c = _stream.read();
+      if (_cur_len < _max_len) {
+        _buffer[_cur_len] = c;
+        _cur_len++;
+      } else {
+        return -1;
+      }
+      if (_cur_len >= _EOL_len) {
+        _found_EOL = true;
+        for (uint8_t i = 0; i < _EOL_len; ++i) {
+          if (_buffer[_cur_len - i - 1] != _EOL[_EOL_len - i - 1]) {
+            _found_EOL = false;
+            break;
+          }
+        }
+        if (_found_EOL) {
+          break;
+        }
+      }
+    }
+    return _found_EOL;
+  }
+
+  uint16_t getCommandLength() {
+    uint16_t len = (_found_EOL ? _cur_len - _EOL_len : 0);
+    _found_EOL = false;
+    _cur_len = 0;
+    return len;
+  }
+
+  void reset() {
+    _found_EOL = false;
+    _cur_len = 0;
+  }
+
+private:
+  Stream &_stream;
+  uint8_t *_buffer;
+  uint16_t _max_len;
+  const uint8_t *_EOL;
+  uint8_t _EOL_len;
+  uint16_t _cur_len = 0;
+  bool _found_EOL = false;
+};
+
+static double seconds() {
+  using namespace std::chrono;
+  return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Return @ref N_BYTES of command lines of about @p line_len chars,
+ * ending in CR LF.
+ */
+static std::string make_lines(size_t line_len) {
+  std::mt19937 rng(1);
+  std::string data;
+  while (data.size() < N_BYTES) {
+    size_t len = line_len / 2 + rng() % line_len;
+    for (size_t i = 0; i < len; ++i) {
+      data += (char)('a' + rng() % 26);
+    }
+    data += "\r\n";
+  }
+  return data;
+}
+
+static void report(const char *name, size_t n, size_t n_bytes, double t) {
+  double ns_per_byte = t / n_bytes * 1e9;
+  printf("%-36s %6zu cmds: %6.1f MB/s, %5.2f ns/byte, %5.2f %% CPU at 1 MB/s"
+         "\n",
+         name, n, n_bytes / t / 1e6, ns_per_byte, ns_per_byte / 10);
+}
+
+/**
+ * @brief Return packets of 100 bytes, each followed by @p EOL, up to
+ * @ref N_BYTES of packets. The packets hold random bytes and runs of up to 15
+ * times @p fill, but never the sentinel.
+ */
+static std::string make_packets(const std::string &EOL, char fill) {
+  std::mt19937 rng(1);
+  std::string data;
+  for (size_t n = 0; n < N_BYTES / 100; ++n) {
+    std::string packet;
+    while (packet.size() < 100) {
+      if (fill && rng() % 2) {
+        packet.append(rng() % 16, fill);
+      } else {
+        packet += (char)(rng() % 256);
+      }
+      packet.resize(min(packet.size(), (size_t)100));
+      while (packet.find(EOL) != std::string::npos) {
+        packet.pop_back();
+      }
+    }
+    data += packet + EOL;
+  }
+  return data;
+}
+
+/**
+ * @brief Return COBS frames of 100 random bytes, up to @ref N_BYTES of
+ * payload.
+ */
+static std::string make_COBS_frames() {
+  std::mt19937 rng(1);
+  std::string data;
+  uint8_t payload[100];
+  uint8_t frame[102];
+  for (size_t n = 0; n < N_BYTES / 100; ++n) {
+    for (uint8_t &byte : payload) {
+      byte = rng() % 256;
+    }
+    uint16_t len =
+        DvG_BinaryStreamCommand::encodeCOBS(payload, sizeof(payload), frame);
+    data.append((const char *)frame, len);
+    data += '\0';
+  }
+  return data;
+}
+
+/**
+ * @brief Time reading all lines of @p data by @p Reader and print the
+ * throughput.
+ */
+template <typename Reader>
+static void bench(const char *name, const std::string &data) {
+  static MockStream stream;
+  static char buf[128];
+  stream.data = data;
+  double t_best = 1e9;
+  size_t n_lines = 0;
+
+  for (uint32_t run = 0; run < N_REPEAT; ++run) {
+    Reader reader(stream, buf, sizeof(buf));
+    stream.pos = 0;
+    n_lines = 0;
+    double t = seconds();
+    for (stream.arrived = PACKET; stream.arrived < data.size() + PACKET;
+         stream.arrived += PACKET) {
+      while (reader.available()) {
+        reader.getCommand();
+        n_lines++;
+      }
+    }
+    t_best = min(t_best, seconds() - t);
+  }
+
+  TEST_ASSERT_EQUAL(data.size(), stream.pos);
+  report(name, n_lines, data.size(), t_best);
+}
+
+/**
+ * @brief Time reading all packets of @p data by @p make_reader() and print the
+ * throughput.
+ */
+template <typename F>
+static void bench_binary(const char *name, const std::string &data,
+                         F make_reader) {
+  static MockStream stream;
+  stream.data = data;
+  double t_best = 1e9;
+  size_t n_packets = 0;
+
+  for (uint32_t run = 0; run < N_REPEAT; ++run) {
+    auto reader = make_reader(stream);
+    stream.pos = 0;
+    n_packets = 0;
+    double t = seconds();
+    for (stream.arrived = PACKET; stream.arrived < data.size() + PACKET;
+         stream.arrived += PACKET) {
+      int8_t state;
+      while ((state = reader->available())) {
+        if (state == -1) {
+          reader->reset();
+        } else {
+          n_packets += (reader->getCommandLength() > 0);
+        }
+      }
+    }
+    t_best = min(t_best, seconds() - t);
+  }
+
+  TEST_ASSERT_EQUAL(data.size(), stream.pos);
+  TEST_ASSERT_EQUAL(N_BYTES / 100, n_packets); // None missed
+  report(name, n_packets, data.size(), t_best);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_bench_short_lines() {
+  std::string data = make_lines(12);
+  bench<PerCharReader>("char by char, ~12 chars/line", data);
+  bench<DvG_StreamCommand>("DvG_StreamCommand, ~12 chars/line", data);
+}
+
+void test_bench_long_lines() {
+  std::string data = make_lines(100);
+  bench<PerCharReader>("char by char, ~100 chars/line", data);
+  bench<DvG_StreamCommand>("DvG_StreamCommand, ~100 chars/line", data);
+}
+
+void test_bench_EOL_sentinel() {
+  // The tail compare is quick as long as the last byte of the sentinel is rare
+  // in the data. Its worst case is a sentinel ending in a byte that often
+  // comes in runs.
+  static uint8_t buf[256];
+  const char *names[][2] = {
+      {"tail compare, 3-byte EOL", "KMP matcher, 3-byte EOL"},
+      {"tail compare, 16-byte EOL", "KMP matcher, 16-byte EOL"}};
+  const std::string EOLs[] = {std::string("\xAA\xAA\x55", 3),
+                              '\x55' + std::string(15, '\xAA')};
+
+  for (size_t i = 0; i < 2; ++i) {
+    const uint8_t *EOL = (const uint8_t *)EOLs[i].data();
+    uint8_t EOL_len = EOLs[i].size();
+    std::string data = make_packets(EOLs[i], (i == 0 ? 0 : '\xAA'));
+    bench_binary(names[i][0], data, [&](Stream &stream) {
+      return std::make_unique<TailCompareReader>(stream, buf, sizeof(buf), EOL,
+                                                 EOL_len);
+    });
+    bench_binary(names[i][1], data, [&](Stream &stream) {
+      return std::make_unique<DvG_BinaryStreamCommand>(stream, buf,
+                                                       sizeof(buf), EOL,
+                                                       EOL_len);
+    });
+  }
+}
+
+void test_bench_COBS() {
+  static uint8_t buf[256];
+  std::string data = make_COBS_frames();
+  bench_binary("COBS frames", data, [&](Stream &stream) {
+    return std::make_unique<DvG_BinaryStreamCommand>(stream, buf, sizeof(buf));
+  });
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_bench_short_lines);
+  RUN_TEST(test_bench_long_lines);
+  RUN_TEST(test_bench_EOL_sentinel);
+  RUN_TEST(test_bench_COBS);
+  return UNITY_END();
+}
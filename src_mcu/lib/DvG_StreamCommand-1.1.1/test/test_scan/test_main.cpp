@@ -0,0 +1,221 @@
+/**
+ * @file test_main.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Host test of the parse functions `scanInt()` and `scanFloat()`, by
+ * edge cases and by comparing against the C library parsers.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <random>
+
+#include "DvG_StreamCommand.h"
+
+static std::mt19937_64 rng(1);
+
+/**
+ * @brief Return the distance in units in the last place between two floats
+ * of the same sign.
+ */
+static uint32_t ulps(float a, float b) {
+  int32_t ia, ib;
+  memcpy(&ia, &a, 4);
+  memcpy(&ib, &b, 4);
+  return (uint32_t)(ia > ib ? ia - ib : ib - ia);
+}
+
+/**
+ * @brief Check that scanInt() agrees with `strtoll()` on @p str.
+ */
+static void check_int(const char *str) {
+  errno = 0;
+  char *end;
+  long long expected = strtoll(str, &end, 10);
+  bool valid = (end != str && errno == 0 && !isspace(*str));
+  int64_t value = 12345;
+  const char *result = scanInt(str, value);
+  if (valid) {
+    TEST_ASSERT_TRUE_MESSAGE(result == end, str);
+    TEST_ASSERT_TRUE_MESSAGE(value == expected, str);
+  } else {
+    TEST_ASSERT_TRUE_MESSAGE(result == nullptr, str);
+    TEST_ASSERT_TRUE_MESSAGE(value == 12345, str); // Untouched
+  }
+}
+
+/**
+ * @brief Check that scanFloat() is within 1 ULP of `strtof()` on @p str.
+ * Unlike `strtof()`, leading whitespace, `inf` and `nan` are not accepted.
+ */
+static void check_float(const char *str) {
+  errno = 0;
+  char *end;
+  float expected = strtof(str, &end);
+  const char *s = str + (*str == '-' || *str == '+');
+  bool valid = (end != str && (isdigit(*s) || *s == '.'));
+  float value;
+  const char *result = scanFloat(str, value);
+  if (!valid || (errno == ERANGE && isinf(expected))) {
+    TEST_ASSERT_TRUE_MESSAGE(result == nullptr, str);
+    return;
+  }
+  TEST_ASSERT_TRUE_MESSAGE(result == end, str);
+  TEST_ASSERT_TRUE_MESSAGE(signbit(value) == signbit(expected), str);
+  TEST_ASSERT_TRUE_MESSAGE(ulps(value, expected) <= 1, str);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_int_limits() {
+  int64_t value;
+  TEST_ASSERT_NOT_NULL(scanInt("9223372036854775807", value));
+  TEST_ASSERT_TRUE(value == INT64_MAX);
+  TEST_ASSERT_NOT_NULL(scanInt("9223372036854775806", value));
+  TEST_ASSERT_TRUE(value == INT64_MAX - 1);
+  TEST_ASSERT_NULL(scanInt("9223372036854775808", value));
+  TEST_ASSERT_NOT_NULL(scanInt("-9223372036854775808", value));
+  TEST_ASSERT_TRUE(value == INT64_MIN);
+  TEST_ASSERT_NOT_NULL(scanInt("-9223372036854775807", value));
+  TEST_ASSERT_TRUE(value == INT64_MIN + 1);
+  TEST_ASSERT_NULL(scanInt("-9223372036854775809", value));
+  TEST_ASSERT_NULL(scanInt("+9223372036854775808", value));
+  TEST_ASSERT_NULL(scanInt("99999999999999999999999", value));
+
+  TEST_ASSERT_NOT_NULL(scanInt("0000000000000000000009223372036854775807",
+                               value));
+  TEST_ASSERT_TRUE(value == INT64_MAX);
+  TEST_ASSERT_NOT_NULL(scanInt("-0", value));
+  TEST_ASSERT_TRUE(value == 0);
+}
+
+void test_int_syntax() {
+  const char *cases[] = {"",   "-",   "+",    "--1", "+-1", " 1",  "\t-1",
+                         "1 ", "12a", "1.5",  "-x",  "a1",  "0x1F", "+7",
+                         "-",  "- 1", "1e3",  "0",   "00",  "\n"};
+  for (const char *str : cases) {
+    check_int(str);
+  }
+
+  // A bare sign is not a number, nor is leading whitespace. Trailing
+  // characters are left for the caller.
+  int64_t value = 0;
+  TEST_ASSERT_NULL(scanInt("-", value));
+  TEST_ASSERT_NULL(scanInt("+", value));
+  TEST_ASSERT_NULL(scanInt(" 5", value));
+  const char *str = "42 \t";
+  TEST_ASSERT_TRUE(scanInt(str, value) == str + 2);
+  TEST_ASSERT_EQUAL(42, value);
+}
+
+void test_int_fuzz() {
+  const char alphabet[] = "0123456789+- ";
+  char str[32];
+  for (uint32_t i = 0; i < 200000; ++i) {
+    size_t len = rng() % 24;
+    for (size_t j = 0; j < len; ++j) {
+      str[j] = alphabet[rng() % (sizeof(alphabet) - 1)];
+    }
+    str[len] = '\0';
+    check_int(str);
+  }
+
+  // Random values over the full range, and their neighbours
+  for (uint32_t i = 0; i < 200000; ++i) {
+    int64_t v = (int64_t)rng() >> (rng() % 64);
+    snprintf(str, sizeof(str), "%lld", (long long)v);
+    check_int(str);
+  }
+}
+
+void test_float_syntax() {
+  const char *cases[] = {
+      "",      "-",       "+",      ".",       "-.",     "+.e1",   "e5",
+      " 1.5",  "1.5 ",    "1.",     ".5",      "-.5",    "1e",     "1e+",
+      "1e-",   "1e5",     "1E5",    "1e+5",    "1e-5",   "2.5E-3", "1e38",
+      "3.4028234e38",     "3.4028236e38",      "1e39",   "-1e39",  "1e-38",
+      "1e-45", "1e-46",   "1e-50",  "0e999999", "1e-99999", "0.0",  "-0",
+      "00012.5000",       "123456789012345678901234567890",
+      "0.000000000000000000000000000001234567", "1.5x", "inf",  "nan"};
+  for (const char *str : cases) {
+    check_float(str);
+  }
+
+  float value = 7;
+  TEST_ASSERT_NULL(scanFloat("-", value));
+  TEST_ASSERT_NULL(scanFloat(".", value));
+  TEST_ASSERT_NULL(scanFloat(" 1", value));
+  TEST_ASSERT_EQUAL_FLOAT(7, value);
+
+  // The exponent is only consumed when followed by digits
+  const char *str = "1e+x";
+  TEST_ASSERT_TRUE(scanFloat(str, value) == str + 1);
+  TEST_ASSERT_EQUAL_FLOAT(1, value);
+  str = "-2.5e-3 ";
+  TEST_ASSERT_TRUE(scanFloat(str, value) == str + 7);
+  TEST_ASSERT_EQUAL_FLOAT(-2.5e-3f, value);
+}
+
+void test_float_round_trip_sweep() {
+  // Every 4099th bit pattern of the positive floats, printed with enough
+  // digits to identify it
+  char str[32];
+  uint32_t n_exact = 0, n = 0;
+  for (uint32_t bits = 0; bits < 0x7F800000; bits += 4099) {
+    float f;
+    memcpy(&f, &bits, 4);
+    snprintf(str, sizeof(str), "%.9g", f);
+    float value;
+    TEST_ASSERT_NOT_NULL_MESSAGE(scanFloat(str, value), str);
+    TEST_ASSERT_TRUE_MESSAGE(ulps(value, f) <= 1, str);
+    n_exact += (value == f);
+    n++;
+  }
+  TEST_ASSERT_TRUE(n_exact > n * 0.99);
+}
+
+void test_float_fuzz() {
+  char str[64];
+  std::uniform_int_distribution<int> exp(-50, 40);
+  for (uint32_t i = 0; i < 200000; ++i) {
+    int len = 0;
+    if (rng() % 2) {
+      str[len++] = (rng() % 2 ? '-' : '+');
+    }
+    for (int j = rng() % 12; j > 0; --j) {
+      str[len++] = '0' + rng() % 10;
+    }
+    if (rng() % 2) {
+      str[len++] = '.';
+      for (int j = rng() % 12; j > 0; --j) {
+        str[len++] = '0' + rng() % 10;
+      }
+    }
+    if (rng() % 2) {
+      len += snprintf(&str[len], sizeof(str) - len, "e%d", exp(rng));
+    }
+    str[len] = '\0';
+    check_float(str);
+  }
+}
+
+void test_parse_in_string_skips_whitespace() {
+  TEST_ASSERT_EQUAL(-12, parseIntInString("x  -12 ", 1));
+  TEST_ASSERT_EQUAL(0, parseIntInString("x  3000000000", 1)); // > INT_MAX
+  TEST_ASSERT_EQUAL_FLOAT(2.5f, parseFloatInString("x \t2.5e0 ", 1));
+  TEST_ASSERT_EQUAL_FLOAT(0, parseFloatInString("x  -", 1));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_int_limits);
+  RUN_TEST(test_int_syntax);
+  RUN_TEST(test_int_fuzz);
+  RUN_TEST(test_float_syntax);
+  RUN_TEST(test_float_round_trip_sweep);
+  RUN_TEST(test_float_fuzz);
+  RUN_TEST(test_parse_in_string_skips_whitespace);
+  return UNITY_END();
+}
@@ -0,0 +1,111 @@
+/**
+ * @file test_main.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Host test of the line reader `DvG_StreamCommand`, fed by a stream
+ * that hands out its input in packets.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <string>
+#include <vector>
+
+#include "DvG_StreamCommand.h"
+
+/**
+ * @brief Stream serving @ref data, of which only the first @ref arrived bytes
+ * can be read so far.
+ */
+class MockStream : public Stream {
+public:
+  std::string data;
+  size_t pos = 0;
+  size_t arrived = 0;
+
+  size_t write(uint8_t) override { return 1; }
+  int available() override {
+    return (int)(min(arrived, data.size()) - pos);
+  }
+  int read() override { return (available() > 0 ? (uint8_t)data[pos++] : -1); }
+  int peek() override { return (available() > 0 ? (uint8_t)data[pos] : -1); }
+};
+
+static MockStream stream;
+static char buf[16];
+
+/**
+ * @brief Feed in all data, @p packet bytes at a time, and return the commands
+ * received.
+ */
+static std::vector<std::string> receive(DvG_StreamCommand &sc,
+                                        size_t packet = 64) {
+  std::vector<std::string> commands;
+  for (stream.arrived = 0; stream.arrived < stream.data.size() + packet;
+       stream.arrived += packet) {
+    while (sc.available()) {
+      commands.push_back(sc.getCommand());
+    }
+  }
+  return commands;
+}
+
+void setUp() {
+  stream.data.clear();
+  stream.pos = 0;
+  stream.arrived = 0;
+}
+
+void tearDown() {}
+
+void test_lines_split_over_packets() {
+  stream.data = "u1\r\n?;x?\nsp\r\n\nlong argument\n";
+  std::vector<std::string> expected = {"u1", "?;x?", "sp", "",
+                                       "long argument"};
+  for (size_t packet = 1; packet <= 8; ++packet) {
+    DvG_StreamCommand sc(stream, buf, sizeof(buf));
+    stream.pos = 0;
+    TEST_ASSERT_TRUE(expected == receive(sc, packet));
+  }
+}
+
+void test_overflow_terminates_the_line() {
+  // The first 15 chars make a command, the remainder the next one
+  stream.data = "0123456789abcdefghij\n";
+  DvG_StreamCommand sc(stream, buf, sizeof(buf));
+  std::vector<std::string> expected = {"0123456789abcde", "fghij"};
+  TEST_ASSERT_TRUE(expected == receive(sc));
+
+  // A line feed right after a full buffer belongs to that line
+  stream.pos = 0;
+  stream.data = "0123456789abcde\r\nx\n";
+  expected = {"0123456789abcde", "x"};
+  TEST_ASSERT_TRUE(expected == receive(sc));
+}
+
+void test_reset_discards_the_chars_past_the_line_feed() {
+  // Both lines arrive in one packet, so the second one is read in already
+  stream.data = "first\nsecond\n";
+  stream.arrived = stream.data.size();
+  DvG_StreamCommand sc(stream, buf, sizeof(buf));
+  TEST_ASSERT_TRUE(sc.available());
+  TEST_ASSERT_EQUAL_STRING("first", sc.getCommand());
+
+  sc.reset();
+  TEST_ASSERT_FALSE(sc.available());
+  TEST_ASSERT_EQUAL_STRING("", sc.getCommand());
+
+  stream.data += "third\n";
+  stream.arrived = stream.data.size();
+  TEST_ASSERT_TRUE(sc.available());
+  TEST_ASSERT_EQUAL_STRING("third", sc.getCommand());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_lines_split_over_packets);
+  RUN_TEST(test_overflow_terminates_the_line);
+  RUN_TEST(test_reset_discards_the_chars_past_the_line_feed);
+  return UNITY_END();
+}
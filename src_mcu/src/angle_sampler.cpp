@@ -0,0 +1,109 @@
+/**
+ * @file angle_sampler.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Angle-synchronous sampling of an analog input, triggered by the
+ * up-flanks of the tacho signal.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "angle_sampler.h"
+
+#if defined(__SAMD51__)
+#  include "wiring_private.h"
+#endif
+
+bool AngleSampler::begin(uint8_t pin) {
+  enable(false);
+
+#if defined(__SAMD51__)
+  // Let the Arduino core configure the pin multiplexer, the ADC clock and the
+  // input channel by a single blocking read, like `analogRead()` would do.
+  Adc *adc;
+  if (g_APinDescription[pin].ulPinAttribute & PIN_ATTR_ANALOG) {
+    adc = ADC0;
+  } else if (g_APinDescription[pin].ulPinAttribute & PIN_ATTR_ANALOG_ALT) {
+    adc = ADC1;
+  } else {
+    return false;
+  }
+  analogReadResolution(12);
+  analogRead(pin);
+
+  if (_dma_allocated) {
+    _dma.abort();
+  } else {
+    _dma.allocate();
+    _dma_allocated = true;
+  }
+  _adc = adc;
+
+  // Single conversions on software trigger, result moved by DMA
+  _adc->CTRLA.bit.ENABLE = 0;
+  while (_adc->SYNCBUSY.bit.ENABLE) {}
+  _adc->CTRLB.bit.FREERUN = 0;
+  while (_adc->SYNCBUSY.bit.CTRLB) {}
+  _adc->INTFLAG.reg = ADC_INTFLAG_RESRDY;
+  _adc->CTRLA.bit.ENABLE = 1;
+  while (_adc->SYNCBUSY.bit.ENABLE) {}
+
+  _dma.setTrigger(_adc == ADC0 ? ADC0_DMAC_ID_RESRDY : ADC1_DMAC_ID_RESRDY);
+  _dma.setAction(DMA_TRIGGER_ACTON_BEAT);
+  _dma.addDescriptor((void *)&_adc->RESULT.reg, (void *)_samples, N_BUF,
+                     DMA_BEAT_SIZE_HWORD, false, true);
+  _dma.loop(true);
+  _dma.startJob();
+#else
+  (void)pin;
+#endif
+
+  // The DMA restarts at the beginning of the ring buffer
+  _head = 0;
+  _tail = 0;
+  return true;
+}
+
+void AngleSampler::enable(bool state) {
+  _enabled = false;
+  _tail = _head;
+  _edge_count = 0;
+  _enabled = state;
+}
+
+uint16_t AngleSampler::available() const {
+  uint16_t n = _head - _tail;
+#if defined(__SAMD51__)
+  // The last triggered conversion might still be in progress or waiting for
+  // the DMA. Conversions take ~1 us, so the previous ones have completed.
+  if (n > 0 && (_adc->STATUS.bit.ADCBUSY || _adc->INTFLAG.bit.RESRDY)) {
+    n--;
+  }
+#endif
+  return n;
+}
+
+uint16_t AngleSampler::stream(Print &out) {
+  const uint8_t header[2] = {0xA5, 0x5A};
+  uint16_t n = available();
+  uint16_t idx = _tail & (N_BUF - 1);
+
+  if (n == 0) {
+    return 0;
+  }
+  if (n > N_BUF - idx) {
+    n = N_BUF - idx; // Remainder follows in the next frame
+  }
+  int room = out.availableForWrite() - 4; // Minus the header and count
+  if (room < (int)(sizeof(uint32_t) + sizeof(uint16_t))) {
+    return 0;
+  }
+  n = min(n, (uint16_t)(room / (sizeof(uint32_t) + sizeof(uint16_t))));
+
+  std::atomic_signal_fence(std::memory_order_acquire);
+  out.write(header, 2);
+  out.write((const uint8_t *)&n, 2);
+  out.write((const uint8_t *)&_stamps[idx], n * sizeof(uint32_t));
+  out.write((const uint8_t *)&_samples[idx], n * sizeof(uint16_t));
+  _tail = _tail + n;
+
+  return n;
+}
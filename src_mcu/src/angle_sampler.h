@@ -0,0 +1,153 @@
+/**
+ * @file angle_sampler.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Angle-synchronous sampling of an analog input, triggered by the
+ * up-flanks of the tacho signal.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef ANGLE_SAMPLER_H_
+#define ANGLE_SAMPLER_H_
+
+#include <Arduino.h>
+#include <atomic>
+
+#if defined(__SAMD51__)
+#  include <Adafruit_ZeroDMA.h>
+#endif
+
+/**
+ * @brief Class to sample an analog input at fixed shaft angles, i.e. on every
+ * k-th up-flank of the tacho signal.
+ *
+ * The up-flank ISR calls @ref onEdge(), which stores the edge timestamp and
+ * software-triggers a single ADC conversion. A DMA channel triggered by the
+ * ADC result-ready flag moves the result into a ring buffer of samples, in
+ * lockstep with the ring buffer of timestamps. No CPU time is spent on moving
+ * the samples around: @ref stream() writes the contiguous part of both ring
+ * buffers directly to the output stream.
+ *
+ * When not compiled for the SAMD51, the ADC and DMA are simulated by a user
+ * supplied function that returns the sample value for a given timestamp. The
+ * conversion then completes immediately inside @ref onEdge().
+ *
+ * Each call to @ref stream() sends a single binary frame, little endian:
+ *   - uint8_t[2]  Header 0xA5 0x5A
+ *   - uint16_t    Number of samples n
+ *   - uint32_t[n] [us] Edge timestamps
+ *   - uint16_t[n] 12-bit ADC values
+ */
+class AngleSampler {
+public:
+  static constexpr uint16_t N_BUF = 256; // Ring buffer capacity, power of 2
+
+  /**
+   * @brief Configure the ADC and DMA to sample analog pin @p pin. Sampling is
+   * disabled afterwards, call @ref enable() to start. May be called again to
+   * switch pins.
+   *
+   * @return True when successful, false when @p pin is not an analog input.
+   */
+  bool begin(uint8_t pin);
+
+  /**
+   * @brief Start or stop triggering conversions. Clears the ring buffers.
+   */
+  void enable(bool state);
+
+  inline bool isEnabled() const { return _enabled; }
+
+  /**
+   * @brief Sample on every @p k-th up-flank only. A value of 0 is taken as 1.
+   */
+  inline void setDivider(uint16_t k) {
+    _divider = (k > 0 ? k : 1);
+    _edge_count = 0;
+  }
+
+  inline uint16_t getDivider() const { return _divider; }
+
+  /**
+   * @brief To be called from the up-flank ISR.
+   *
+   * @param stamp_us [us] Timestamp of the up-flank
+   */
+  inline void onEdge(uint32_t stamp_us) {
+    if (!_enabled || ++_edge_count < _divider) {
+      return;
+    }
+    _edge_count = 0;
+
+    uint16_t head = _head;
+    if ((uint16_t)(head - _tail) >= N_BUF) {
+      // Not triggering keeps the DMA write position in lockstep with `_head`
+      _dropped++;
+      return;
+    }
+    _stamps[head & (N_BUF - 1)] = stamp_us;
+    trigger(head & (N_BUF - 1), stamp_us);
+    std::atomic_signal_fence(std::memory_order_release);
+    _head = head + 1;
+  }
+
+  /**
+   * @brief Return the number of completed conversions ready to be streamed.
+   */
+  uint16_t available() const;
+
+  /**
+   * @brief Write the completed conversions as a single binary frame to
+   * @p out, straight from the ring buffers. At most one contiguous part of the
+   * ring buffers is sent per call, and no more than fits in
+   * `out.availableForWrite()`, so that the call never blocks.
+   *
+   * @return The number of samples sent
+   */
+  uint16_t stream(Print &out);
+
+  /**
+   * @brief Return the number of edges skipped because the ring buffers were
+   * full.
+   */
+  inline uint32_t dropped() const { return _dropped; }
+
+#if !defined(__SAMD51__)
+  /**
+   * @brief Install the simulated ADC, returning a 12-bit sample for the given
+   * edge timestamp.
+   */
+  inline void setSimulatedADC(uint16_t (*adc)(uint32_t stamp_us)) {
+    _sim_adc = adc;
+  }
+#endif
+
+private:
+  inline void trigger(uint16_t idx, uint32_t stamp_us) {
+#if defined(__SAMD51__)
+    (void)idx;
+    (void)stamp_us;
+    _adc->SWTRIG.bit.START = 1;
+#else
+    _samples[idx] = (_sim_adc ? _sim_adc(stamp_us) : 0);
+#endif
+  }
+
+  uint16_t _samples[N_BUF] __attribute__((aligned(4))); // Written by DMA
+  uint32_t _stamps[N_BUF];                               // [us]
+  volatile uint16_t _head = 0;    // Number of triggered conversions
+  volatile uint16_t _tail = 0;    // Number of streamed conversions
+  volatile uint16_t _divider = 1; // Sample every k-th up-flank
+  volatile uint16_t _edge_count = 0;
+  volatile uint32_t _dropped = 0;
+  volatile bool _enabled = false;
+
+#if defined(__SAMD51__)
+  Adc *_adc = nullptr;
+  Adafruit_ZeroDMA _dma;
+  bool _dma_allocated = false;
+#else
+  uint16_t (*_sim_adc)(uint32_t stamp_us) = nullptr;
+#endif
+};
+
+#endif
@@ -0,0 +1,82 @@
+/**
+ * @file clock_sync.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Synchronization of the `micros()` clock to the clock of the host PC
+ * by ping and timestamp exchanges.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "clock_sync.h"
+
+uint64_t ClockSync::ping(uint64_t received_us) {
+  _ping = received_us;
+  _ping_pending = true;
+  return _ping;
+}
+
+bool ClockSync::addHostTime(int64_t host_us) {
+  if (!_ping_pending) {
+    return false;
+  }
+  _ping_pending = false;
+  _dev[_idx] = _ping;
+  _host[_idx] = host_us;
+  _idx = (_idx + 1) % N_PAIRS;
+  if (_n < N_PAIRS) {
+    _n++;
+  }
+  fit();
+  return true;
+}
+
+void ClockSync::reset() {
+  _idx = 0;
+  _n = 0;
+  _ping_pending = false;
+  _offset = 0;
+  _drift = 0;
+  _accuracy = NAN;
+}
+
+void ClockSync::fit() {
+  // Least-squares line through (device time, host - device time), relative to
+  // the newest pair to keep the precision of the doubles
+  uint8_t newest = (_idx + N_PAIRS - 1) % N_PAIRS;
+  uint64_t ref = _dev[newest];
+  double y_ref = (double)(_host[newest] - (int64_t)ref);
+  double sx = 0, sy = 0;
+  for (uint8_t i = 0; i < _n; ++i) {
+    sx += (double)(int64_t)(_dev[i] - ref);
+    sy += (double)(_host[i] - (int64_t)_dev[i]) - y_ref;
+  }
+  double mx = sx / _n;
+  double my = sy / _n;
+
+  double sxx = 0, sxy = 0;
+  for (uint8_t i = 0; i < _n; ++i) {
+    double dx = (double)(int64_t)(_dev[i] - ref) - mx;
+    double dy = (double)(_host[i] - (int64_t)_dev[i]) - y_ref - my;
+    sxx += dx * dx;
+    sxy += dx * dy;
+  }
+  double drift = (sxx > 0 ? sxy / sxx : 0);
+  double offset = my - drift * mx; // At `ref`
+
+  double ss = 0;
+  for (uint8_t i = 0; i < _n; ++i) {
+    double x = (double)(int64_t)(_dev[i] - ref);
+    double y = (double)(_host[i] - (int64_t)_dev[i]) - y_ref;
+    double res = y - (offset + drift * x);
+    ss += res * res;
+  }
+
+  _ref = ref;
+  _offset = y_ref + offset;
+  _drift = drift;
+  _accuracy = (_n > 2 ? sqrt(ss / (_n - 2)) : NAN);
+}
+
+int64_t ClockSync::toHost(uint64_t device_us) const {
+  double dx = (double)(int64_t)(device_us - _ref);
+  return (int64_t)device_us + (int64_t)llround(_offset + _drift * dx);
+}
@@ -0,0 +1,119 @@
+/**
+ * @file clock_sync.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Synchronization of the `micros()` clock to the clock of the host PC
+ * by ping and timestamp exchanges.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef CLOCK_SYNC_H_
+#define CLOCK_SYNC_H_
+
+#include <Arduino.h>
+
+#include "micros64.h"
+
+/**
+ * @brief Class to estimate the offset and drift of the device clock relative
+ * to the host clock, in order to timestamp readings in host time.
+ *
+ * The exchange goes as follows:
+ *   1. The host notes its time T1 and sends a ping.
+ *   2. The device replies its own time t at the moment the ping was received.
+ *   3. The host notes its time T4 when the reply arrives and sends back its
+ *      estimate of its time at the moment t, i.e. (T1 + T4) / 2.
+ *
+ * The device pairs its time t with the host time. A straight line is fitted
+ * through the last @ref N_PAIRS pairs by least squares, giving the offset and
+ * drift. The RMS residual of the fit serves as estimate of the accuracy.
+ *
+ * Time t is taken when the line holding the ping has been read from the
+ * serial port, before executing it. The midpoint (T1 + T4) / 2 is off by half
+ * the difference between the delays on the way in and out. On the way in, the
+ * ping waits in the receive buffer until `loop()` reads it, up to one loop
+ * iteration. On the way out, the reply waits behind any output queued earlier.
+ * Both only add to the round trip T4 - T1, so the host should preferably only
+ * send back the pings with the shortest round trip.
+ *
+ * Device times are 64 bits, as returned by @ref micros64().
+ */
+class ClockSync {
+public:
+  static constexpr uint8_t N_PAIRS = 16;
+
+  /**
+   * @brief Handle a ping of the host.
+   *
+   * @param received_us [us] Device time at which the ping was received, as
+   * returned by @ref micros64()
+   * @return The device time [us] to reply to the host
+   */
+  uint64_t ping(uint64_t received_us);
+
+  /**
+   * @brief Pair the host time with the device time of the last ping.
+   *
+   * @param host_us [us] Host time at the moment of the last ping
+   * @return True when paired, false when no ping was pending
+   */
+  bool addHostTime(int64_t host_us);
+
+  /**
+   * @brief Discard all pairs.
+   */
+  void reset();
+
+  /**
+   * @brief Return the number of pairs in the fit.
+   */
+  inline uint8_t count() const { return _n; }
+
+  inline bool isSynced() const { return _n > 0; }
+
+  /**
+   * @brief Convert a 64-bit device time [us] to host time [us].
+   */
+  int64_t toHost(uint64_t device_us) const;
+
+  /**
+   * @brief Return the device time [us] around which the fit is centered.
+   */
+  inline uint64_t getReference() const { return _ref; }
+
+  /**
+   * @brief Return the host time minus the device time [us] at
+   * @ref getReference().
+   */
+  inline double getOffset() const { return _offset; }
+
+  /**
+   * @brief Return the rate of the host clock relative to the device clock,
+   * minus 1 [ppm].
+   */
+  inline double getDrift() const { return _drift * 1e6; }
+
+  /**
+   * @brief Return the RMS residual of the fit [us], NAN when less than three
+   * pairs.
+   */
+  inline double getAccuracy() const { return _accuracy; }
+
+private:
+  void fit();
+
+  // Pairs of device and host time, circular
+  uint64_t _dev[N_PAIRS];
+  int64_t _host[N_PAIRS];
+  uint8_t _idx = 0; // Index to write the next pair to
+  uint8_t _n = 0;   // Number of pairs
+  uint64_t _ping = 0;
+  bool _ping_pending = false;
+
+  // Fit result: host = device + offset + drift * (device - reference)
+  uint64_t _ref = 0;
+  double _offset = 0;
+  double _drift = 0;
+  double _accuracy = NAN;
+};
+
+#endif
@@ -0,0 +1,140 @@
+/**
+ * @file command_table.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Table-driven dispatcher of the ASCII commands received by
+ * `DvG_StreamCommand`, with typed arguments.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "command_table.h"
+
+CommandTable::CommandTable(const Command *commands, uint8_t n_commands) {
+  _commands = commands;
+  _n_commands = n_commands;
+  memset(_slots, 0, sizeof(_slots));
+
+  for (uint8_t idx = 0; idx < n_commands; ++idx) {
+    const char *name = commands[idx].name;
+    size_t len = strlen(name);
+    if (len == 0 || len > MAX_NAME || _n_indexed == MAX_COMMANDS) {
+      continue;
+    }
+    uint32_t k = key(name, len);
+    if (find(k) >= 0) {
+      continue; // Duplicate
+    }
+    uint8_t slot = hash(k);
+    while (_slots[slot]) {
+      slot = (slot + 1) % HASH_SIZE; // Linear probing
+    }
+    _slots[slot] = idx + 1;
+    _n_indexed++;
+  }
+}
+
+uint32_t CommandTable::key(const char *name, uint8_t len) {
+  // Pack the name into 32 bits, which is unique for up to 4 characters
+  uint32_t k = 0;
+  for (uint8_t i = 0; i < len; ++i) {
+    k |= (uint32_t)(uint8_t)name[i] << (8 * i);
+  }
+  return k;
+}
+
+uint8_t CommandTable::hash(uint32_t key) {
+  // Multiplicative (Fibonacci) hashing
+  return (uint8_t)((uint32_t)(key * 2654435761UL) >> (32 - HASH_BITS));
+}
+
+int16_t CommandTable::find(uint32_t k) const {
+  // The table is at most half full, so the probing ends quickly
+  uint8_t slot = hash(k);
+  while (_slots[slot]) {
+    uint8_t idx = _slots[slot] - 1;
+    const char *name = _commands[idx].name;
+    if (key(name, strlen(name)) == k) {
+      return idx;
+    }
+    slot = (slot + 1) % HASH_SIZE;
+  }
+  return -1;
+}
+
+CommandTable::RESULT CommandTable::dispatch(char *str) {
+  // Find the longest registered name prefixing the command
+  uint8_t len = 0;
+  while (len < MAX_NAME && str[len] != '\0') {
+    len++;
+  }
+  int16_t idx = -1;
+  while (len > 0 && (idx = find(key(str, len))) < 0) {
+    len--;
+  }
+  if (idx < 0) {
+    return RESULT::UNKNOWN;
+  }
+  const Command &cmd = _commands[idx];
+
+  Arg arg;
+  arg.b = false;
+  arg.i = 0;
+  arg.f = 0;
+  uint8_t n_args = arg.args.split(str + len);
+
+  bool ok = (n_args <= 1);
+  switch (cmd.type) {
+    case ARG::NONE:
+      ok = (n_args == 0);
+      break;
+    case ARG::BOOL:
+      ok = ok && (n_args == 0 || arg.args[0].toBool(arg.b));
+      break;
+    case ARG::INT:
+      ok = ok && (n_args == 0 || arg.args[0].toInt(arg.i));
+      break;
+    case ARG::FLOAT:
+      ok = ok && (n_args == 0 || arg.args[0].toFloat(arg.f));
+      break;
+    case ARG::LIST:
+      ok = true;
+      break;
+  }
+  if (!ok) {
+    return RESULT::BAD_ARG;
+  }
+
+  cmd.handler(arg);
+  return RESULT::OK;
+}
+
+uint8_t CommandTable::check(Print &out) const {
+  uint8_t n_errors = 0;
+  for (uint8_t idx = 0; idx < _n_commands; ++idx) {
+    const char *name = _commands[idx].name;
+    size_t len = strlen(name);
+    int16_t found = -1;
+    if (len > 0 && len <= MAX_NAME) {
+      found = find(key(name, len));
+      if (found == idx) {
+        continue;
+      }
+    }
+    out.print("ERROR: Command not indexed, ");
+    out.print(len == 0 || len > MAX_NAME ? "invalid name "
+              : found >= 0               ? "duplicate name "
+                                         : "table full ");
+    out.println(name);
+    n_errors++;
+  }
+  return n_errors;
+}
+
+void CommandTable::help(Print &out) const {
+  const char *arg_names[] = {"", "<0|1>", "<int>", "<float>", "<args>"};
+  for (uint8_t idx = 0; idx < _n_commands; ++idx) {
+    out.print(_commands[idx].name);
+    out.print(arg_names[int(_commands[idx].type)]);
+    out.print('\t');
+    out.println(_commands[idx].help);
+  }
+}
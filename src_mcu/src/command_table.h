@@ -0,0 +1,131 @@
+/**
+ * @file command_table.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Table-driven dispatcher of the ASCII commands received by
+ * `DvG_StreamCommand`, with typed arguments.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef COMMAND_TABLE_H_
+#define COMMAND_TABLE_H_
+
+#include <Arduino.h>
+
+#include "DvG_StreamCommand.h"
+
+/**
+ * @brief Class to dispatch a received command to its handler, by looking up
+ * its name in a table of registered commands.
+ *
+ * A command consists of a name of 1 to @ref MAX_NAME characters, directly
+ * followed by its argument, e.g. `ps1200` is command `ps` with argument
+ * `1200`. The longest registered name that prefixes the command wins, so `ps`
+ * takes precedence over `p`. The names are indexed by an open-addressing hash
+ * table on construction, so that a dispatch costs at most @ref MAX_NAME
+ * lookups, independent of the number of commands.
+ *
+ * The argument gets split in place into space-separated arguments by
+ * @ref DvG_ArgList. For the single-value types it gets parsed before the
+ * handler is called. An empty argument parses as 0 or false. A malformed
+ * argument, more than one argument, or any argument to a command without one,
+ * is rejected. Commands of type LIST get all arguments passed unparsed.
+ */
+class CommandTable {
+public:
+  static constexpr uint8_t MAX_NAME = 4;       // [chars] Longest command name
+  static constexpr uint8_t MAX_COMMANDS = 128; // Capacity of the hash table
+
+  /**
+   * @brief Type of the argument of a command.
+   */
+  enum class ARG : uint8_t {
+    NONE,  // No argument
+    BOOL,  // 'true', 'false' or an integer, non-zero being true
+    INT,   // Decimal integer, 64 bits
+    FLOAT, // Decimal floating point number
+    LIST,  // Any number of arguments, parsed by the handler
+  };
+
+  /**
+   * @brief Parsed argument, passed to the handler.
+   */
+  struct Arg {
+    DvG_ArgList args; // Space-separated arguments following the command name
+    bool b;           // Value when of type BOOL
+    int64_t i;        // Value when of type INT
+    float f;          // Value when of type FLOAT
+  };
+
+  typedef void (*Handler)(const Arg &arg);
+
+  /**
+   * @brief Entry of the command table.
+   */
+  struct Command {
+    const char *name; // Command name, 1 to @ref MAX_NAME characters
+    ARG type;         // Type of the argument
+    Handler handler;  // Function to call
+    const char *help; // Description for the help listing
+  };
+
+  /**
+   * @brief Outcome of @ref dispatch().
+   */
+  enum class RESULT : uint8_t {
+    OK,      // The handler got called
+    UNKNOWN, // No command matches
+    BAD_ARG  // The argument is malformed or not expected
+  };
+
+  /**
+   * @brief Construct a new CommandTable object and index the commands.
+   * Entries with an invalid or duplicate name, or beyond
+   * @ref MAX_COMMANDS, can not be indexed, see @ref check().
+   *
+   * @param commands Table of commands, which must outlive this object
+   * @param n_commands Number of entries in @p commands
+   */
+  CommandTable(const Command *commands, uint8_t n_commands);
+
+  /**
+   * @brief Look up the command in @p str, parse its argument and call its
+   * handler. The argument gets split in place, so @p str is modified.
+   */
+  RESULT dispatch(char *str);
+
+  /**
+   * @brief Print all commands in table order, one per line as the name with
+   * its argument type, a tab and the description.
+   */
+  void help(Print &out) const;
+
+  /**
+   * @brief Print an error line for every command that could not be indexed,
+   * because its name is invalid or a duplicate, or the table is full. To be
+   * called once at start-up.
+   *
+   * @return The number of commands that can not be dispatched
+   */
+  uint8_t check(Print &out) const;
+
+  /**
+   * @brief Return the number of indexed commands.
+   */
+  inline uint8_t count() const { return _n_indexed; }
+
+private:
+  static constexpr uint8_t HASH_BITS = 8;
+  static constexpr uint16_t HASH_SIZE = 1 << HASH_BITS;
+  static_assert(HASH_SIZE >= 2 * MAX_COMMANDS, "Keep at most half full");
+
+  static uint32_t key(const char *name, uint8_t len);
+  static uint8_t hash(uint32_t key);
+  int16_t find(uint32_t key) const;
+
+  const Command *_commands;
+  uint8_t _n_commands;
+  uint8_t _n_indexed = 0;
+  uint8_t _slots[HASH_SIZE]; // Index into `_commands` plus 1, 0 when empty
+};
+
+#endif
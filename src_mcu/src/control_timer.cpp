@@ -0,0 +1,94 @@
+/**
+ * @file control_timer.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Fixed-rate timer interrupt to execute a control loop in.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "control_timer.h"
+
+static void (*control_callback)() = nullptr;
+static volatile uint32_t control_interval_us = 0; // Nominal interval
+static volatile uint32_t control_jitter_us = 0;   // Max. deviation
+static volatile uint32_t control_micros_prev = 0; // Last tick, 0 if none
+
+static void control_tick() {
+  uint32_t micros_now = micros();
+
+  if (control_micros_prev != 0) {
+    uint32_t dt = micros_now - control_micros_prev;
+    uint32_t dev = (dt > control_interval_us ? dt - control_interval_us
+                                             : control_interval_us - dt);
+    if (dev > control_jitter_us) {
+      control_jitter_us = dev;
+    }
+  }
+  control_micros_prev = micros_now;
+
+  if (control_callback) {
+    control_callback();
+  }
+}
+
+#if defined(__SAMD51__)
+// GCLK1 runs at 48 MHz, divided by 64 gives 750 kHz timer ticks
+static const uint32_t F_TC = 48000000 / 64;
+
+void control_timer_begin(uint32_t rate_hz, void (*callback)()) {
+  MCLK->APBBMASK.reg |= MCLK_APBBMASK_TC3;
+  GCLK->PCHCTRL[TC3_GCLK_ID].reg = GCLK_PCHCTRL_GEN_GCLK1 | GCLK_PCHCTRL_CHEN;
+  while (!(GCLK->PCHCTRL[TC3_GCLK_ID].reg & GCLK_PCHCTRL_CHEN)) {}
+
+  control_timer_end();
+  control_callback = callback;
+  control_interval_us = 1000000UL / rate_hz;
+  control_jitter_us = 0;
+  control_micros_prev = 0;
+
+  TC3->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_PRESCALER_DIV64 |
+                           TC_CTRLA_PRESCSYNC_PRESC;
+  TC3->COUNT16.WAVE.reg = TC_WAVE_WAVEGEN_MFRQ;
+  TC3->COUNT16.CC[0].reg = F_TC / rate_hz - 1;
+  while (TC3->COUNT16.SYNCBUSY.bit.CC0) {}
+  TC3->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
+  TC3->COUNT16.INTENSET.reg = TC_INTENSET_MC0;
+
+  NVIC_ClearPendingIRQ(TC3_IRQn);
+  NVIC_SetPriority(TC3_IRQn, 2); // Below the tacho pin interrupts
+  NVIC_EnableIRQ(TC3_IRQn);
+
+  TC3->COUNT16.CTRLA.bit.ENABLE = 1;
+  while (TC3->COUNT16.SYNCBUSY.bit.ENABLE) {}
+}
+
+void control_timer_end() {
+  if (!(MCLK->APBBMASK.reg & MCLK_APBBMASK_TC3)) {
+    return; // Never started, the registers are not clocked
+  }
+  NVIC_DisableIRQ(TC3_IRQn);
+  TC3->COUNT16.CTRLA.bit.ENABLE = 0;
+  while (TC3->COUNT16.SYNCBUSY.bit.ENABLE) {}
+  control_callback = nullptr;
+}
+
+extern "C" void TC3_Handler() {
+  TC3->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
+  control_tick();
+}
+
+#else
+void control_timer_begin(uint32_t rate_hz, void (*callback)()) {
+  control_callback = callback;
+  control_interval_us = 1000000UL / rate_hz;
+  control_jitter_us = 0;
+  control_micros_prev = 0;
+}
+
+void control_timer_end() { control_callback = nullptr; }
+
+void control_timer_tick() { control_tick(); }
+#endif
+
+uint32_t control_timer_jitter() { return control_jitter_us; }
+
+void control_timer_reset_jitter() { control_jitter_us = 0; }
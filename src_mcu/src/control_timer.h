@@ -0,0 +1,50 @@
+/**
+ * @file control_timer.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Fixed-rate timer interrupt to execute a control loop in.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef CONTROL_TIMER_H_
+#define CONTROL_TIMER_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief Start calling @p callback at a fixed rate from the TC3 interrupt.
+ *
+ * The interrupt runs at a lower priority than the tacho pin interrupts, so
+ * that the up-flanks keep being timestamped accurately. The timing jitter of
+ * the calls is tracked, see @ref control_timer_jitter().
+ *
+ * @param rate_hz [Hz] Rate, between 12 Hz and 750 kHz
+ * @param callback Function to call
+ */
+void control_timer_begin(uint32_t rate_hz, void (*callback)());
+
+/**
+ * @brief Stop calling the callback.
+ */
+void control_timer_end();
+
+/**
+ * @brief Return the maximum deviation [us] of the interval between two calls
+ * from the nominal interval, since the start or the last call to
+ * @ref control_timer_reset_jitter().
+ */
+uint32_t control_timer_jitter();
+
+/**
+ * @brief Restart tracking the maximum deviation of the interval.
+ */
+void control_timer_reset_jitter();
+
+#if !defined(__SAMD51__)
+/**
+ * @brief Simulate a single timer tick. Off-target there is no timer, so this
+ * function is to be called at the requested rate instead.
+ */
+void control_timer_tick();
+#endif
+
+#endif
@@ -0,0 +1,69 @@
+/**
+ * @file curve_recorder.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief On-device recorder of run-up and coast-down curves with automatic
+ * triggering on speed thresholds.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "curve_recorder.h"
+
+CurveRecorder::CurveRecorder(uint16_t n_slits, uint32_t timeout_us) {
+  _n_slits = n_slits;
+  _timeout_us = timeout_us;
+}
+
+void CurveRecorder::arm(bool run_up, float trigger_revps, float stop_revps,
+                        uint16_t decimation, double ticks_per_s) {
+  float ticks = (float)ticks_per_s;
+  noInterrupts();
+  _state = STATE::IDLE;
+  _run_up = run_up;
+  if (trigger_revps > 0) {
+    _T_trigger = (uint32_t)(ticks / (trigger_revps * _n_slits));
+  } else {
+    _T_trigger = 0; // Trigger on the first rotation
+  }
+  if (stop_revps > 0) {
+    _T_stop = (uint32_t)(ticks / (stop_revps * _n_slits));
+  } else {
+    _T_stop = (run_up ? 0 : UINT32_MAX); // Never crossed
+  }
+  _decimation = (decimation > 0 ? decimation : 1);
+  _prev_period = 0;
+  _n = 0;
+  _state = STATE::ARMED;
+  interrupts();
+}
+
+void CurveRecorder::disarm() {
+  noInterrupts();
+  if (_state == STATE::RECORDING) {
+    _state = STATE::DONE;
+  } else if (_state == STATE::ARMED) {
+    _state = STATE::IDLE;
+  }
+  interrupts();
+}
+
+void CurveRecorder::poll() {
+  noInterrupts();
+  if (_state == STATE::RECORDING && micros() - _last_edge_us > _timeout_us) {
+    _state = STATE::DONE;
+  }
+  interrupts();
+}
+
+void CurveRecorder::send(Print &out) const {
+  const uint8_t header[2] = {'C', 'R'};
+  uint32_t n = _n;
+  uint16_t decimation = _decimation;
+  uint32_t stamp = _stamp_trigger;
+
+  out.write(header, 2);
+  out.write((const uint8_t *)&n, 4);
+  out.write((const uint8_t *)&decimation, 2);
+  out.write((const uint8_t *)&_n_slits, 2);
+  out.write((const uint8_t *)&stamp, 4);
+  out.write((const uint8_t *)_buf, n * sizeof(uint32_t));
+}
@@ -0,0 +1,165 @@
+/**
+ * @file curve_recorder.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief On-device recorder of run-up and coast-down curves with automatic
+ * triggering on speed thresholds.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef CURVE_RECORDER_H_
+#define CURVE_RECORDER_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief Class to record the rotation rate versus time into RAM, slit by slit
+ * or decimated, once armed and triggered.
+ *
+ * When armed for a run-up, recording starts at the up-flank where the rotation
+ * rate rises above the trigger level. When armed for a coast-down, it starts
+ * where the rotation rate drops below the trigger level. Recording stops when
+ * the rotation rate crosses the optional stop level, when the buffer is full
+ * or at standstill.
+ *
+ * The trigger and stop levels are converted into slit periods when arming, so
+ * that the up-flank ISR can record with just integer comparisons. Each record
+ * holds the sum of @p decimation consecutive slit periods. The timestamp of
+ * each record hence follows from the cumulative sum of the records, starting
+ * at the timestamp of the trigger.
+ *
+ * The recording is sent to the host as a single binary block, little endian:
+ *   - uint8_t[2]  Header 'C' 'R'
+ *   - uint32_t    Number of records n
+ *   - uint16_t    Decimation, i.e. slit periods per record
+ *   - uint16_t    Number of slits on the encoder disk
+ *   - uint32_t    [us] Timestamp of the trigger
+ *   - uint32_t[n] [us] Summed slit periods
+ */
+class CurveRecorder {
+public:
+  static constexpr uint16_t N_RECORDS = 8192; // Buffer capacity, 32 kB
+
+  enum class STATE {
+    IDLE,      // Not armed
+    ARMED,     // Waiting for the trigger
+    RECORDING, // Triggered
+    DONE       // Recording has stopped, ready to be sent
+  };
+
+  /**
+   * @brief Construct a new CurveRecorder object.
+   *
+   * @param n_slits Number of slits on the encoder disk
+   * @param timeout_us [us] Slit periods longer than this are considered to be a
+   * standstill
+   */
+  CurveRecorder(uint16_t n_slits, uint32_t timeout_us);
+
+  /**
+   * @brief Arm the recorder, discarding any previous recording.
+   *
+   * @param run_up True to trigger on a rising, false on a falling rotation rate
+   * @param trigger_revps [rev/s] Trigger level, 0 to start a run-up at the
+   * first slit period after a standstill, or a coast-down right away
+   * @param stop_revps [rev/s] Stop level, 0 to record until the buffer is full
+   * or standstill
+   * @param decimation Number of slit periods per record, at least 1
+   * @param ticks_per_s Calibrated number of `micros()` ticks per second
+   */
+  void arm(bool run_up, float trigger_revps, float stop_revps,
+           uint16_t decimation, double ticks_per_s);
+
+  /**
+   * @brief Disarm, or stop an ongoing recording.
+   */
+  void disarm();
+
+  inline STATE getState() const { return _state; }
+
+  /**
+   * @brief Return the number of records so far.
+   */
+  inline uint32_t count() const { return _n; }
+
+  /**
+   * @brief To be called from the up-flank ISR.
+   *
+   * @param period_us [us] Last slit period
+   * @param stamp_us [us] Timestamp of the up-flank
+   */
+  inline void onPeriod(uint32_t period_us, uint32_t stamp_us) {
+    if (_state == STATE::ARMED) {
+      uint32_t prev = _prev_period;
+      _prev_period = period_us;
+      if (prev == 0) {
+        return; // Need two periods to detect a crossing
+      }
+      if (triggered(prev, period_us)) {
+        _stamp_trigger = stamp_us;
+        _last_edge_us = stamp_us;
+        _sum_T = 0;
+        _n_T = 0;
+        _state = STATE::RECORDING;
+      }
+
+    } else if (_state == STATE::RECORDING) {
+      _last_edge_us = stamp_us;
+      if (period_us > _timeout_us ||
+          (_run_up ? period_us < _T_stop : period_us > _T_stop)) {
+        _state = STATE::DONE;
+        return;
+      }
+      _sum_T += period_us;
+      if (++_n_T >= _decimation) {
+        _buf[_n++] = _sum_T;
+        _sum_T = 0;
+        _n_T = 0;
+        if (_n >= N_RECORDS) {
+          _state = STATE::DONE;
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief Stop the recording at standstill, i.e. once no up-flanks have been
+   * detected for longer than the timeout. This method should be called
+   * repeatedly from `loop()`.
+   */
+  void poll();
+
+  /**
+   * @brief Send the recording as a single binary block to @p out, straight
+   * from the buffer.
+   */
+  void send(Print &out) const;
+
+private:
+  inline bool triggered(uint32_t prev, uint32_t period_us) const {
+    if (_T_trigger == 0) {
+      // No trigger level: A run-up starts at the first slit period after a
+      // standstill, a coast-down at the first slit period after arming
+      return period_us <= _timeout_us && (!_run_up || prev > _timeout_us);
+    }
+    return _run_up ? (prev >= _T_trigger && period_us < _T_trigger)
+                   : (prev <= _T_trigger && period_us > _T_trigger);
+  }
+
+  uint16_t _n_slits;
+  uint32_t _timeout_us;
+
+  volatile STATE _state = STATE::IDLE;
+  volatile bool _run_up = true;
+  volatile uint32_t _T_trigger = 0; // [us] Trigger level as slit period, or 0
+  volatile uint32_t _T_stop = 0;    // [us] Stop level as slit period
+  volatile uint16_t _decimation = 1;
+  volatile uint32_t _prev_period = 0; // [us]
+  volatile uint32_t _stamp_trigger = 0;
+  volatile uint32_t _last_edge_us = 0;
+  volatile uint32_t _sum_T = 0; // [us] Sum of the slit periods in record
+  volatile uint16_t _n_T = 0;   // Number of slit periods in record
+  volatile uint32_t _n = 0;     // Number of records
+  uint32_t _buf[N_RECORDS];     // [us]
+};
+
+#endif
@@ -0,0 +1,238 @@
+/**
+ * @file data_logger.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Append-only logger of timestamped speed records and optionally raw
+ * slit periods to the QSPI flash.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "data_logger.h"
+#include "flash_store.h"
+#include "varint.h"
+
+static const uint16_t MAGIC = 0x4C54;     // "TL"
+static const uint16_t MAGIC_END = 0x454C; // "LE"
+static const uint32_t PAGES_PER_SECTOR =
+    QSPIFlash::SECTOR_SIZE / QSPIFlash::PAGE_SIZE;
+
+DataLogger::DataLogger(QSPIFlash &flash) : _flash(flash) {
+  static_assert(sizeof(Page) == QSPIFlash::PAGE_SIZE, "Page size mismatch");
+}
+
+uint32_t DataLogger::pageCRC(const Page &page) {
+  // CRC32 over the header fields before the CRC and the used payload, by
+  // chaining as if both were one contiguous block
+  uint8_t buf[HEADER_SIZE - 4 + PAYLOAD_SIZE];
+  memcpy(buf, &page, HEADER_SIZE - 4);
+  memcpy(buf + HEADER_SIZE - 4, page.payload, page.len);
+  return FlashStore::crc32(buf, HEADER_SIZE - 4 + page.len);
+}
+
+bool DataLogger::isValid(const Page &page) const {
+  return page.magic == MAGIC && page.len <= PAYLOAD_SIZE &&
+         page.crc == pageCRC(page);
+}
+
+bool DataLogger::begin() {
+  _n_pages = _flash.size() / QSPIFlash::PAGE_SIZE;
+  if (_n_pages == 0) {
+    return false;
+  }
+
+  // Continue after the page with the highest sequence number
+  uint32_t seq_max = 0;
+  _head = 0;
+  for (uint32_t i = 0; i < _n_pages; ++i) {
+    _flash.read(i * QSPIFlash::PAGE_SIZE, &_writing, sizeof(Page));
+    if (isValid(_writing) && _writing.seq >= seq_max) {
+      seq_max = _writing.seq;
+      _head = (i + 1) % _n_pages;
+    }
+  }
+  _seq = seq_max + 1;
+
+  // A page torn by a power loss fails its CRC, but can not be programmed again
+  // before its sector gets erased. Skip ahead to a blank page or to the next
+  // sector, which gets erased first.
+  while (_head % PAGES_PER_SECTOR != 0 && !isErased(_head)) {
+    _head = (_head + 1) % _n_pages;
+  }
+  _state = STATE::IDLE;
+  return true;
+}
+
+bool DataLogger::isErased(uint32_t idx) {
+  _flash.read(idx * QSPIFlash::PAGE_SIZE, &_writing, sizeof(Page));
+  const uint8_t *p = (const uint8_t *)&_writing;
+  for (uint32_t i = 0; i < sizeof(Page); ++i) {
+    if (p[i] != 0xFF) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void DataLogger::enable(bool state) {
+  if (!state && _page_open) {
+    closePage();
+  }
+  _enabled = state && (_n_pages > 0);
+}
+
+void DataLogger::openPage(uint64_t t_us) {
+  _page.magic = MAGIC;
+  _page.len = 0;
+  _page.t0_us = t_us;
+  _t_page = t_us;
+  _prev_speed = 0;
+  _page_ms = millis();
+  _page_open = true;
+}
+
+void DataLogger::closePage() {
+  _page_open = false;
+  if (_page.len == 0) {
+    return;
+  }
+  _page.seq = _seq++;
+  _page.crc = pageCRC(_page);
+  memset(_page.payload + _page.len, 0xFF, PAYLOAD_SIZE - _page.len);
+  _pages.push(_page);
+}
+
+bool DataLogger::append(const uint8_t *rec, uint8_t len) {
+  if (_page.len + len > PAYLOAD_SIZE) {
+    return false;
+  }
+  memcpy(_page.payload + _page.len, rec, len);
+  _page.len += len;
+  return true;
+}
+
+void DataLogger::logSpeed(uint64_t stamp_us, float revps) {
+  if (!_enabled) {
+    return;
+  }
+  uint64_t t = stamp_us;
+  int32_t speed = (isnan(revps) ? 0 : (int32_t)lroundf(revps * 1000));
+  if (!_page_open) {
+    openPage(t);
+  }
+
+  for (uint8_t attempt = 0; attempt < 2; ++attempt) {
+    uint8_t rec[2 * VARINT_MAX_LEN];
+    uint8_t len = put_varint(rec, (uint32_t)(t - _t_page) << 1);
+    len += put_varint(rec + len, zigzag(speed - _prev_speed));
+    if (append(rec, len)) {
+      break;
+    }
+    closePage();
+    openPage(t);
+  }
+  _t_page = t;
+  _prev_speed = speed;
+}
+
+void DataLogger::logEdge(uint32_t period_us) {
+  if (!_enabled || !_edges) {
+    return;
+  }
+  uint8_t rec[VARINT_MAX_LEN];
+  period_us = min(period_us, (uint32_t)INT32_MAX); // Standstill
+  uint8_t len = put_varint(rec, (period_us << 1) | 1);
+  if (!_page_open) {
+    openPage(micros64());
+  }
+  if (!append(rec, len)) {
+    closePage();
+    openPage(micros64());
+    append(rec, len);
+  }
+}
+
+void DataLogger::poll() {
+  if (_page_open && _page.len > 0 && millis() - _page_ms >= FLUSH_MS) {
+    closePage();
+  }
+
+  switch (_state) {
+    case STATE::IDLE:
+      if (!_pages.pop(_writing)) {
+        return;
+      }
+      if (_head % PAGES_PER_SECTOR == 0) {
+        _flash.beginEraseSector(_head * QSPIFlash::PAGE_SIZE);
+        _state = STATE::ERASING_SECTOR;
+      } else {
+        _flash.beginProgram(_head * QSPIFlash::PAGE_SIZE, &_writing,
+                            sizeof(Page));
+        _state = STATE::PROGRAMMING;
+      }
+      break;
+
+    case STATE::ERASING_SECTOR:
+      if (_flash.isBusy()) {
+        return;
+      }
+      _flash.beginProgram(_head * QSPIFlash::PAGE_SIZE, &_writing,
+                          sizeof(Page));
+      _state = STATE::PROGRAMMING;
+      break;
+
+    case STATE::PROGRAMMING:
+      if (_flash.isBusy()) {
+        return;
+      }
+      _head = (_head + 1) % _n_pages;
+      _n_written++;
+      _state = STATE::IDLE;
+      break;
+
+    case STATE::ERASING_CHIP:
+      if (_flash.isBusy()) {
+        return;
+      }
+      _head = 0;
+      _state = STATE::IDLE;
+      break;
+  }
+}
+
+void DataLogger::erase() {
+  if (_n_pages == 0 || _state == STATE::ERASING_CHIP) {
+    return;
+  }
+  // Discard everything not yet written
+  while (_state != STATE::IDLE) {
+    poll();
+  }
+  _page_open = false;
+  _pages.clear();
+  _flash.beginEraseChip();
+  _state = STATE::ERASING_CHIP;
+}
+
+void DataLogger::send(Print &out) {
+  // Write out all pending pages first
+  if (_page_open) {
+    closePage();
+  }
+  bool erasing = (_state == STATE::ERASING_CHIP);
+  while (!erasing && (_state != STATE::IDLE || _pages.size() > 0)) {
+    poll();
+  }
+
+  Page page;
+  for (uint32_t i = 0; i < _n_pages && !erasing; ++i) {
+    _flash.read(((_head + i) % _n_pages) * QSPIFlash::PAGE_SIZE, &page,
+                sizeof(page));
+    if (isValid(page)) {
+      out.write((const uint8_t *)&page, sizeof(page));
+    }
+  }
+
+  memset(&page, 0xFF, sizeof(page));
+  page.magic = MAGIC_END;
+  page.len = 0;
+  out.write((const uint8_t *)&page, sizeof(page));
+}
@@ -0,0 +1,170 @@
+/**
+ * @file data_logger.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Append-only logger of timestamped speed records and optionally raw
+ * slit periods to the QSPI flash.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef DATA_LOGGER_H_
+#define DATA_LOGGER_H_
+
+#include <Arduino.h>
+
+#include "micros64.h"
+#include "qspi_flash.h"
+#include "ring_buffer.h"
+
+/**
+ * @brief Class to log to the QSPI flash as a circular, append-only sequence of
+ * self-contained 256-byte pages.
+ *
+ * Page layout, little endian:
+ *   - uint16_t  Magic 'T' 'L'
+ *   - uint16_t  Number of payload bytes used
+ *   - uint32_t  Sequence number, incrementing by 1 per page
+ *   - uint64_t  [us] Time since start-up at the start of the page
+ *   - uint32_t  CRC32 of the above and the used payload bytes
+ *   - uint8_t[] Payload of records, at most 236 bytes
+ *
+ * Each record starts with an unsigned LEB128 varint holding `(value << 1) |
+ * type`:
+ *   - Type 0, speed record: value is the time [us] since the previous speed
+ *     record or since the start of the page, followed by a zigzag varint of
+ *     the change in rotation rate [mrev/s] since the previous speed record.
+ *     The first speed record of a page changes from 0.
+ *   - Type 1, edge record: value is a slit period [us].
+ *
+ * A page is closed and queued for writing once full or after @ref FLUSH_MS,
+ * bounding the data lost on a power loss. Queued pages are written by a state
+ * machine in @ref poll() that never waits for the flash chip. The sector
+ * ahead gets erased when the log reaches it, so that the oldest data is
+ * overwritten once the flash is full. A page torn by a power loss fails its
+ * CRC and is skipped. On start-up, the log continues after the page with the
+ * highest sequence number, skipping a torn page behind it.
+ */
+class DataLogger {
+public:
+  static constexpr uint32_t FLUSH_MS = 5000; // [ms] Max. age of a page in RAM
+  static constexpr uint16_t HEADER_SIZE = 20;
+  static constexpr uint16_t PAYLOAD_SIZE = QSPIFlash::PAGE_SIZE - HEADER_SIZE;
+
+  /**
+   * @brief Construct a new DataLogger object.
+   *
+   * @param flash Flash chip to log to, see @ref QSPIFlash
+   */
+  DataLogger(QSPIFlash &flash);
+
+  /**
+   * @brief Find the end of the existing log on the flash. Scans all pages, so
+   * takes about a second for 2 MB.
+   *
+   * @return True when successful, false when no flash chip was found
+   */
+  bool begin();
+
+  /**
+   * @brief Start or stop logging. Stopping closes the current page.
+   */
+  void enable(bool state);
+  inline bool isEnabled() const { return _enabled; }
+
+  /**
+   * @brief Log the raw slit periods as well or not.
+   */
+  inline void setEdges(bool state) { _edges = state; }
+  inline bool getEdges() const { return _edges; }
+
+  /**
+   * @brief Append a speed record, when enabled.
+   *
+   * @param stamp_us [us] Timestamp from @ref micros64()
+   * @param revps [rev/s] Rotation rate, NAN is logged as 0
+   */
+  void logSpeed(uint64_t stamp_us, float revps);
+
+  /**
+   * @brief Append an edge record, when enabled and logging edges.
+   *
+   * @param period_us [us] Slit period
+   */
+  void logEdge(uint32_t period_us);
+
+  /**
+   * @brief Close the page when due and advance the flash writes. This method
+   * should be called repeatedly from `loop()`.
+   */
+  void poll();
+
+  /**
+   * @brief Start erasing the full log, which can take tens of seconds.
+   */
+  void erase();
+
+  /**
+   * @brief Send all valid pages, oldest first, to @p out as 256-byte blocks,
+   * followed by a terminating block with magic 'L' 'E'. Blocks until done.
+   */
+  void send(Print &out);
+
+  /**
+   * @brief Return the number of pages written and the number of pages
+   * dropped, because the write queue was full, since start-up.
+   */
+  inline uint32_t pageCount() const { return _n_written; }
+  inline uint32_t droppedCount() const { return _pages.dropped(); }
+
+  /**
+   * @brief Return the sequence number of the next page.
+   */
+  inline uint32_t getSequence() const { return _seq; }
+
+  inline bool isErasing() const { return _state == STATE::ERASING_CHIP; }
+
+private:
+  enum class STATE {
+    IDLE,           // Waiting for a queued page
+    ERASING_SECTOR, // Erasing the sector ahead
+    PROGRAMMING,    // Programming a page
+    ERASING_CHIP    // Erasing the full log
+  };
+
+  struct Page {
+    uint16_t magic;
+    uint16_t len;
+    uint32_t seq;
+    uint64_t t0_us;
+    uint32_t crc;
+    uint8_t payload[PAYLOAD_SIZE];
+  };
+
+  static uint32_t pageCRC(const Page &page);
+  bool isValid(const Page &page) const;
+  bool isErased(uint32_t idx);
+  void openPage(uint64_t t_us);
+  void closePage();
+  bool append(const uint8_t *rec, uint8_t len);
+
+  QSPIFlash &_flash;
+  uint32_t _n_pages = 0; // Number of pages on the flash
+  bool _enabled = false;
+  bool _edges = false;
+
+  // Page being filled
+  Page _page;
+  bool _page_open = false;
+  uint32_t _page_ms = 0;   // [ms] `millis()` at opening of the page
+  uint64_t _t_page = 0;    // [us] Time of the last speed record in the page
+  int32_t _prev_speed = 0; // [mrev/s] Last speed record in the page
+
+  // Pages waiting to be written
+  RingBuffer<Page, 4> _pages;
+  Page _writing;
+  STATE _state = STATE::IDLE;
+  uint32_t _head = 0; // Index of the next page to write on the flash
+  uint32_t _seq = 1;  // Sequence number of the next page
+  uint32_t _n_written = 0;
+};
+
+#endif
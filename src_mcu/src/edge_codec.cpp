@@ -0,0 +1,150 @@
+/**
+ * @file edge_codec.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Compression of edge timestamp streams by zigzag varint residuals
+ * against a predicted period, with periodic keyframes.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "edge_codec.h"
+#include "varint.h"
+
+static const uint32_t TOKEN_KEYFRAME = 1;
+static const int32_t MAX_RESIDUAL = (1L << 30) - 1; // Fits `zigzag << 1`
+
+/*------------------------------------------------------------------------------
+  EdgePredictor
+------------------------------------------------------------------------------*/
+
+EdgePredictor::EdgePredictor(uint16_t n_slits) {
+  _n_slits = (n_slits > MAX_SLITS ? MAX_SLITS : (n_slits < 1 ? 1 : n_slits));
+  reset(0);
+}
+
+void EdgePredictor::reset(uint32_t period_us) {
+  _idx = 0;
+  _n = 1;
+  _hist[0] = period_us;
+}
+
+uint32_t EdgePredictor::predict() const {
+  if (_n_slits == 1 || _n <= _n_slits) {
+    return _hist[_idx];
+  }
+  // The history holds the last N + 1 periods, the oldest right after `_idx`
+  uint16_t len = _n_slits + 1;
+  uint32_t p_rev_prev = _hist[(_idx + 1) % len]; // N + 1 periods ago
+  uint32_t p_rev = _hist[(_idx + 2) % len];      // N periods ago
+  int64_t pred = (int64_t)_hist[_idx] + p_rev - p_rev_prev;
+  return (pred > 0 ? (uint32_t)pred : 0);
+}
+
+void EdgePredictor::update(uint32_t period_us) {
+  _idx = (_idx + 1) % (_n_slits + 1);
+  _hist[_idx] = period_us;
+  if (_n <= _n_slits) {
+    _n++;
+  }
+}
+
+/*------------------------------------------------------------------------------
+  EdgeEncoder
+------------------------------------------------------------------------------*/
+
+EdgeEncoder::EdgeEncoder(uint16_t n_slits, uint16_t keyframe_interval)
+    : _predictor(n_slits) {
+  _keyframe_interval = keyframe_interval;
+}
+
+void EdgeEncoder::reset() {
+  _started = false;
+  _force_key = true;
+}
+
+uint8_t EdgeEncoder::encode(uint32_t stamp_us, uint8_t *out) {
+  uint32_t period = (_started ? stamp_us - _prev_stamp : 0);
+  int64_t residual = (int64_t)period - _predictor.predict();
+  _prev_stamp = stamp_us;
+  _started = true;
+
+  if (!_force_key && _n_since_key < _keyframe_interval &&
+      residual >= -MAX_RESIDUAL && residual <= MAX_RESIDUAL) {
+    _predictor.update(period);
+    _n_since_key++;
+    return put_varint(out, zigzag((int32_t)residual) << 1);
+  }
+
+  out[0] = TOKEN_KEYFRAME;
+  out[1] = (uint8_t)stamp_us;
+  out[2] = (uint8_t)(stamp_us >> 8);
+  out[3] = (uint8_t)(stamp_us >> 16);
+  out[4] = (uint8_t)(stamp_us >> 24);
+  _predictor.reset(period);
+  _n_since_key = 0;
+  _force_key = false;
+  return 5 + put_varint(out + 5, period);
+}
+
+/*------------------------------------------------------------------------------
+  EdgeDecoder
+------------------------------------------------------------------------------*/
+
+EdgeDecoder::EdgeDecoder(uint16_t n_slits) : _predictor(n_slits) {}
+
+void EdgeDecoder::reset() {
+  _state = STATE::VARINT;
+  _synced = false;
+  _value = 0;
+  _shift = 0;
+}
+
+bool EdgeDecoder::push(uint8_t byte, uint32_t &stamp_us) {
+  if (_state == STATE::KEY_STAMP) {
+    _value |= (uint32_t)byte << (8 * _n_bytes);
+    if (++_n_bytes == 4) {
+      _stamp = _value;
+      _value = 0;
+      _shift = 0;
+      _state = STATE::KEY_PERIOD;
+    }
+    return false;
+  }
+
+  // Assemble a varint
+  if (_shift < 32) {
+    _value |= (uint32_t)(byte & 0x7F) << _shift;
+  }
+  _shift += 7;
+  if (byte & 0x80) {
+    if (_shift >= 35) {
+      reset(); // Corrupt, too long
+    }
+    return false;
+  }
+  uint32_t value = _value;
+  _value = 0;
+  _shift = 0;
+
+  if (_state == STATE::KEY_PERIOD) {
+    _predictor.reset(value);
+    _state = STATE::VARINT;
+    _synced = true;
+    stamp_us = _stamp;
+    return true;
+  }
+  if (value == TOKEN_KEYFRAME) {
+    _n_bytes = 0;
+    _state = STATE::KEY_STAMP;
+    return false;
+  }
+  if ((value & 1) || !_synced) {
+    _synced = false; // Unknown token or waiting for a keyframe
+    return false;
+  }
+
+  uint32_t period = _predictor.predict() + unzigzag(value >> 1);
+  _predictor.update(period);
+  _stamp += period;
+  stamp_us = _stamp;
+  return true;
+}
@@ -0,0 +1,160 @@
+/**
+ * @file edge_codec.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Compression of edge timestamp streams by zigzag varint residuals
+ * against a predicted period, with periodic keyframes.
+ * @copyright MIT License. See the LICENSE file for details.
+ *
+ * Free of Arduino dependencies, so that the decoder can be compiled into host
+ * software as is.
+ */
+
+#ifndef EDGE_CODEC_H_
+#define EDGE_CODEC_H_
+
+#include <stdint.h>
+
+/**
+ * @brief Period predictor shared by the encoder and the decoder.
+ *
+ * The next period is predicted as the last period, plus the change in period
+ * that the same slit showed one revolution earlier. This cancels the
+ * repeating pattern of unequal slit spacings on the encoder disk. Until a
+ * full revolution has passed since the last keyframe, the last period is used
+ * as is.
+ */
+class EdgePredictor {
+public:
+  static constexpr uint16_t MAX_SLITS = 128;
+
+  /**
+   * @brief Construct a new EdgePredictor object.
+   *
+   * @param n_slits Number of slits on the encoder disk, at most
+   * @ref MAX_SLITS. Use 1 to predict from the last period only.
+   */
+  EdgePredictor(uint16_t n_slits);
+
+  /**
+   * @brief Clear the history and set the last period.
+   */
+  void reset(uint32_t period_us);
+
+  /**
+   * @brief Return the predicted next period [us].
+   */
+  uint32_t predict() const;
+
+  /**
+   * @brief Add the actual period [us].
+   */
+  void update(uint32_t period_us);
+
+  inline uint32_t last() const { return _hist[_idx]; }
+
+private:
+  uint16_t _n_slits;
+  uint16_t _idx;                 // Index of the last period in the history
+  uint16_t _n;                   // Number of periods in the history
+  uint32_t _hist[MAX_SLITS + 1]; // [us] Last periods, circular
+};
+
+/**
+ * @brief Class to encode a stream of edge timestamps into a compact byte
+ * stream.
+ *
+ * Each edge is encoded as a token starting with an unsigned LEB128 varint v:
+ *   - v even: regular edge. `v >> 1` is the zigzag-encoded residual of the
+ *     period since the previous edge against the predicted period, see
+ *     @ref EdgePredictor. Steady rotation costs a single byte per edge.
+ *   - v == 1: keyframe. Followed by the absolute timestamp [us] as uint32_t
+ *     little endian and a varint of the period [us] since the previous edge,
+ *     0 when unknown. The prediction history starts over.
+ *
+ * A keyframe is emitted for the first edge, every @p keyframe_interval edges
+ * and for residuals too large to encode, so that a decoder can (re)sync to
+ * the stream there.
+ */
+class EdgeEncoder {
+public:
+  static constexpr uint8_t MAX_TOKEN = 10; // [bytes] Longest token
+
+  /**
+   * @brief Construct a new EdgeEncoder object.
+   *
+   * @param n_slits Number of slits on the encoder disk, see
+   * @ref EdgePredictor
+   * @param keyframe_interval Number of edges between keyframes
+   */
+  EdgeEncoder(uint16_t n_slits, uint16_t keyframe_interval = 256);
+
+  /**
+   * @brief Emit a keyframe for the next edge, e.g. after edges got lost.
+   */
+  void reset();
+
+  /**
+   * @brief Encode the next edge.
+   *
+   * @param stamp_us [us] Timestamp of the edge
+   * @param out Buffer of at least @ref MAX_TOKEN bytes
+   * @return The number of bytes written to @p out
+   */
+  uint8_t encode(uint32_t stamp_us, uint8_t *out);
+
+private:
+  EdgePredictor _predictor;
+  uint16_t _keyframe_interval;
+  uint16_t _n_since_key = 0; // Edges since the last keyframe
+  bool _started = false;     // Has any edge been encoded?
+  bool _force_key = true;
+  uint32_t _prev_stamp = 0;
+};
+
+/**
+ * @brief Class to decode the byte stream of @ref EdgeEncoder, byte by byte.
+ */
+class EdgeDecoder {
+public:
+  /**
+   * @brief Construct a new EdgeDecoder object.
+   *
+   * @param n_slits Number of slits on the encoder disk, the same as used by
+   * the encoder
+   */
+  EdgeDecoder(uint16_t n_slits);
+
+  /**
+   * @brief Drop sync and wait for the next keyframe, e.g. after bytes got
+   * lost.
+   */
+  void reset();
+
+  /**
+   * @brief Feed in the next byte.
+   *
+   * @param byte Next byte of the stream
+   * @param stamp_us Set to the timestamp [us] of the decoded edge
+   * @return True when an edge was decoded
+   */
+  bool push(uint8_t byte, uint32_t &stamp_us);
+
+  inline bool isSynced() const { return _synced; }
+
+private:
+  enum class STATE {
+    VARINT,    // Reading the leading varint
+    KEY_STAMP, // Reading the absolute timestamp of a keyframe
+    KEY_PERIOD // Reading the period varint of a keyframe
+  };
+
+  EdgePredictor _predictor;
+  STATE _state = STATE::VARINT;
+  bool _synced = false;
+  uint32_t _value = 0;  // Varint or timestamp being assembled
+  uint8_t _shift = 0;   // Bit position within `_value`
+  uint8_t _n_bytes = 0; // Bytes of the timestamp read so far
+  uint32_t _stamp = 0;  // [us] Timestamp of the last edge
+};
+
+#endif
@@ -0,0 +1,197 @@
+/**
+ * @file flash_store.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Persistent storage of a settings record in a block of the internal
+ * flash memory.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "flash_store.h"
+
+static const uint32_t MAGIC = 0x54414348; // "TACH"
+
+// Layout of the record header, padded to a quad word and followed by the
+// record itself
+struct Header {
+  uint32_t magic;
+  uint16_t len;
+  uint16_t reserved;
+  uint32_t crc;
+  uint32_t reserved2;
+};
+
+#if defined(__SAMD51__)
+static const uint32_t FLASH_END = FLASH_ADDR + FLASH_SIZE;
+
+FlashStore::FlashStore(uint8_t block) {
+  _addr = FLASH_END - (block + 1) * BLOCK_SIZE;
+}
+
+static void nvm_command(uint32_t cmd) {
+  NVMCTRL->INTFLAG.reg = NVMCTRL_INTFLAG_DONE;
+  NVMCTRL->CTRLB.reg = NVMCTRL_CTRLB_CMDEX_KEY | cmd;
+}
+
+static void nvm_wait() {
+  while (!NVMCTRL->INTFLAG.bit.DONE) {}
+}
+
+// The cache is disabled while writing or erasing, see the SAMD51 errata, and
+// restored once the NVM controller is ready again
+static bool cache_saved = false;
+static bool cachedis0 = false;
+static bool cachedis1 = false;
+
+static void cache_disable() {
+  if (!cache_saved) {
+    cachedis0 = NVMCTRL->CTRLA.bit.CACHEDIS0;
+    cachedis1 = NVMCTRL->CTRLA.bit.CACHEDIS1;
+    cache_saved = true;
+  }
+  NVMCTRL->CTRLA.bit.CACHEDIS0 = true;
+  NVMCTRL->CTRLA.bit.CACHEDIS1 = true;
+}
+
+bool FlashStore::isBusy() {
+  if (!NVMCTRL->STATUS.bit.READY) {
+    return true;
+  }
+  if (cache_saved) {
+    NVMCTRL->CTRLA.bit.CACHEDIS0 = cachedis0;
+    NVMCTRL->CTRLA.bit.CACHEDIS1 = cachedis1;
+    cache_saved = false;
+  }
+  return false;
+}
+
+void FlashStore::beginErase() {
+  while (!NVMCTRL->STATUS.bit.READY) {}
+  cache_disable();
+  NVMCTRL->ADDR.reg = _addr;
+  nvm_command(NVMCTRL_CTRLB_CMD_EB);
+}
+
+void FlashStore::beginWriteQuad(uint32_t offset, const void *data) {
+  volatile uint32_t *dst = (volatile uint32_t *)(_addr + offset);
+  uint32_t words[QUAD_SIZE / 4];
+  memcpy(words, data, QUAD_SIZE);
+
+  NVMCTRL->CTRLA.bit.WMODE = NVMCTRL_CTRLA_WMODE_MAN_Val;
+  while (!NVMCTRL->STATUS.bit.READY) {}
+  cache_disable();
+  nvm_command(NVMCTRL_CTRLB_CMD_PBC);
+  nvm_wait();
+  for (uint8_t i = 0; i < QUAD_SIZE / 4; ++i) {
+    dst[i] = words[i];
+  }
+  nvm_command(NVMCTRL_CTRLB_CMD_WQW);
+}
+
+void FlashStore::eraseBlock() {
+  beginErase();
+  while (isBusy()) {}
+}
+
+void FlashStore::program(uint32_t offset, const void *data, uint32_t len) {
+  const uint8_t *src = (const uint8_t *)data;
+  uint32_t n_src = len;
+  volatile uint32_t *dst = (volatile uint32_t *)(_addr + offset);
+
+  // Manual page writes
+  NVMCTRL->CTRLA.bit.WMODE = NVMCTRL_CTRLA_WMODE_MAN_Val;
+  while (!NVMCTRL->STATUS.bit.READY) {}
+  cache_disable();
+
+  // Whole quad words only, padding the tail with 0xFF
+  len = (len + QUAD_SIZE - 1) & ~(QUAD_SIZE - 1);
+  while (len > 0) {
+    nvm_command(NVMCTRL_CTRLB_CMD_PBC);
+    nvm_wait();
+    do {
+      uint32_t word = 0xFFFFFFFF;
+      uint32_t n = (n_src < 4 ? n_src : 4);
+      memcpy(&word, src, n);
+      n_src -= n;
+      *dst++ = word;
+      src += 4;
+      len -= 4;
+    } while (len > 0 && ((uintptr_t)dst % PAGE_SIZE) != 0);
+    nvm_command(NVMCTRL_CTRLB_CMD_WP);
+    nvm_wait();
+  }
+  while (isBusy()) {}
+}
+
+#else
+// Simulated flash
+static const uint8_t N_SIM_BLOCKS = 8;
+static uint8_t sim_flash[N_SIM_BLOCKS * FlashStore::BLOCK_SIZE];
+static bool sim_flash_init = false;
+
+FlashStore::FlashStore(uint8_t block) {
+  if (!sim_flash_init) {
+    memset(sim_flash, 0xFF, sizeof(sim_flash));
+    sim_flash_init = true;
+  }
+  _addr = (uintptr_t)(sim_flash + (N_SIM_BLOCKS - 1 - block) * BLOCK_SIZE);
+}
+
+bool FlashStore::isBusy() { return false; }
+
+void FlashStore::beginErase() { memset((void *)_addr, 0xFF, BLOCK_SIZE); }
+
+void FlashStore::beginWriteQuad(uint32_t offset, const void *data) {
+  program(offset, data, QUAD_SIZE);
+}
+
+void FlashStore::eraseBlock() { beginErase(); }
+
+void FlashStore::program(uint32_t offset, const void *data, uint32_t len) {
+  // Flash can only clear bits
+  uint8_t *dst = (uint8_t *)(_addr + offset);
+  const uint8_t *src = (const uint8_t *)data;
+  for (uint32_t i = 0; i < len; ++i) {
+    dst[i] &= src[i];
+  }
+}
+#endif
+
+uint32_t FlashStore::crc32(const void *data, uint32_t len) {
+  // Bitwise CRC-32 (IEEE 802.3), small and fast enough for rare writes
+  const uint8_t *p = (const uint8_t *)data;
+  uint32_t crc = 0xFFFFFFFF;
+  while (len--) {
+    crc ^= *p++;
+    for (uint8_t k = 0; k < 8; ++k) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+bool FlashStore::read(void *data, uint16_t len) const {
+  Header hdr;
+  memcpy(&hdr, at(0), sizeof(hdr));
+  if (hdr.magic != MAGIC || hdr.len != len ||
+      hdr.crc != crc32(at(sizeof(hdr)), len)) {
+    return false;
+  }
+  memcpy(data, at(sizeof(hdr)), len);
+  return true;
+}
+
+bool FlashStore::write(const void *data, uint16_t len) {
+  if (len > BLOCK_SIZE - sizeof(Header)) {
+    return false;
+  }
+
+  Header hdr = {MAGIC, len, 0xFFFF, crc32(data, len), 0xFFFFFFFF};
+  eraseBlock();
+  program(0, &hdr, sizeof(hdr));
+  program(sizeof(hdr), data, len);
+
+  Header check;
+  memcpy(&check, at(0), sizeof(check));
+  return memcmp(&check, &hdr, sizeof(hdr)) == 0 &&
+         memcmp(at(sizeof(hdr)), data, len) == 0;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file flash_store.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Persistent storage of a settings record in a block of the internal
+ * flash memory.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef FLASH_STORE_H_
+#define FLASH_STORE_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief Class to store a single record, e.g. a settings struct, persistently
+ * in one erase block of the internal flash of the SAMD51.
+ *
+ * The blocks are counted from the end of the flash, away from the firmware.
+ * Hence, the record survives a power cycle and a firmware upload that does not
+ * erase the full chip. The record is stored together with a magic number, its
+ * length and a CRC32, so that an erased or corrupted block is detected and
+ * the caller can fall back to its defaults.
+ *
+ * Writing erases the full block first, which takes tens of milliseconds and
+ * wears the flash. It is meant for settings that change rarely. For
+ * log-structured storage, the block can also be erased and written quad word
+ * by quad word without waiting for completion, see @ref isBusy(). The last
+ * blocks lie in the second flash bank, so the firmware keeps executing from
+ * the first bank meanwhile. Off-target, the flash is simulated in RAM.
+ */
+class FlashStore {
+public:
+  static constexpr uint32_t BLOCK_SIZE = 8192; // [bytes] Erase granularity
+  static constexpr uint32_t PAGE_SIZE = 512;   // [bytes] Page buffer size
+  static constexpr uint32_t QUAD_SIZE = 16;    // [bytes] Write granularity
+
+  /**
+   * @brief Construct a new FlashStore object.
+   *
+   * @param block Index of the flash block to use, counted from the end of the
+   * flash, starting at 0
+   */
+  FlashStore(uint8_t block);
+
+  /**
+   * @brief Read the record into @p data.
+   *
+   * @param data Buffer to read into, left untouched when no valid record of
+   * length @p len is stored
+   * @param len Length of the record in bytes
+   * @return True when a valid record was read
+   */
+  bool read(void *data, uint16_t len) const;
+
+  /**
+   * @brief Erase the block and write the record.
+   *
+   * @param data Record to write
+   * @param len Length of the record in bytes, at most a block minus the 16
+   * bytes of the header
+   * @return True when successful, i.e. when the record reads back intact
+   */
+  bool write(const void *data, uint16_t len);
+
+  /**
+   * @brief Return the CRC32 of @p len bytes at @p data.
+   */
+  static uint32_t crc32(const void *data, uint32_t len);
+
+  /**
+   * @brief Start erasing the block without waiting for completion.
+   */
+  void beginErase();
+
+  /**
+   * @brief Start writing a single quad word of @p data into the erased flash
+   * at byte @p offset of the block, without waiting for completion.
+   *
+   * @param offset Multiple of @ref QUAD_SIZE
+   * @param data @ref QUAD_SIZE bytes to write
+   */
+  void beginWriteQuad(uint32_t offset, const void *data);
+
+  /**
+   * @brief Return true while the flash is still being erased or written.
+   * Shared by all blocks, as there is a single flash controller.
+   */
+  static bool isBusy();
+
+  /**
+   * @brief Return a pointer to byte @p offset of the block.
+   */
+  inline const uint8_t *at(uint32_t offset) const {
+    return (const uint8_t *)_addr + offset;
+  }
+
+protected:
+  /**
+   * @brief Erase the full block, setting all bytes to 0xFF.
+   */
+  void eraseBlock();
+
+  /**
+   * @brief Program @p len bytes of @p data into the erased flash at byte
+   * @p offset of the block. The flash is written in whole quad words, as
+   * each quad word carries an ECC and may only be written once per erase.
+   * Hence, @p offset should be a multiple of @ref QUAD_SIZE and the tail of
+   * the last quad word gets padded with 0xFF.
+   */
+  void program(uint32_t offset, const void *data, uint32_t len);
+
+  uintptr_t _addr; // Start address of the block
+};
+
+#endif
@@ -27,7 +27,29 @@
 #include "Adafruit_GFX.h"
 #include "Adafruit_SSD1306.h"
 #include "DvG_StreamCommand.h"
+#include "angle_sampler.h"
 #include "avdweb_Switch.h"
+#include "clock_sync.h"
+#include "command_table.h"
+#include "control_timer.h"
+#include "curve_recorder.h"
+#include "data_logger.h"
+#include "edge_codec.h"
+#include "micros64.h"
+#include "modbus_rtu.h"
+#include "odometer.h"
+#include "order_spectrum.h"
+#include "qspi_flash.h"
+#include "ratio_engine.h"
+#include "ring_buffer.h"
+#include "signal_quality.h"
+#include "speed_alarm.h"
+#include "speed_dac.h"
+#include "speed_pid.h"
+#include "tach_out.h"
+#include "telemetry.h"
+#include "timebase_cal.h"
+#include "tx_queue.h"
 
 // Tacho settings
 enum class TACHO_UNIT {
@@ -47,6 +69,76 @@ TACHO_UNIT unit = TACHO_UNIT::RPM;
 const uint16_t N_UPFLANKS = 24;    // Number of up-flanks to average over
 const uint16_t ISR_TIMEOUT = 4000; // [ms] Timeout to stop waiting for the ISR
 
+// [us] Slit periods longer than this are considered to be a standstill
+const uint32_t SLIT_TIMEOUT = 1000UL * ISR_TIMEOUT / N_UPFLANKS;
+
+// Optional second tacho input, e.g. on the other side of a gearbox or belt,
+// used to measure the speed ratio and slip between both shafts
+const uint8_t PIN_TACHO_B = 11;
+const uint8_t N_SLITS_ON_DISK_B = 24;
+const uint16_t N_RATIO_WINDOW = 24; // Default number of up-flanks to average
+
+// Calibration of the timebase against a reference frequency or 1-PPS signal on
+// the second tacho input, see `timebase_cal.h`. The correction is stored in the
+// last block of the flash.
+TimebaseCal timebase(0);
+
+// Total revolutions and running hours, checkpointed to flash blocks 1 and 2,
+// see `odometer.h`
+Odometer odometer(N_SLITS_ON_DISK, SLIT_TIMEOUT, 1);
+
+// Over- and under-speed alarm output, see `speed_alarm.h`
+const uint8_t PIN_ALARM = 12;
+float alarm_over_revps = 0;  // [rev/s] Over-speed threshold, 0 is disabled
+float alarm_under_revps = 0; // [rev/s] Under-speed threshold, 0 is disabled
+float alarm_hysteresis = 5;  // [%], up to ALARM_HYSTERESIS_MAX
+const float ALARM_HYSTERESIS_MAX = 100.;
+SpeedAlarm speed_alarm;
+
+// Analog speed output on the DAC, see `speed_dac.h`
+const uint8_t PIN_DAC = A0;
+const float DAC_FULL_SCALE = 50.;   // [rev/s] Default, corresponds to 3.3 V
+const uint32_t DAC_INTERVAL = 1000; // [us] Default update interval
+SpeedDAC speed_dac(N_SLITS_ON_DISK, SLIT_TIMEOUT);
+
+// Re-emitted tacho signal of N pulses per revolution, see `tach_out.h`. Pin 13
+// is shared with the red LED on the Feather. The pin should be on the 24-bit
+// TCC0 or TCC1 for rotation rates below 114 output pulses per second.
+const uint8_t PIN_TACH_OUT = 13;
+TachOut tach_out(N_SLITS_ON_DISK, SLIT_TIMEOUT);
+
+// Closed-loop speed control driving a PWM output, see `speed_pid.h`. The
+// controller runs at a fixed rate from a timer interrupt.
+const uint8_t PIN_PID_PWM = A4;
+const uint16_t PID_RATE = 500;     // [Hz] Control rate
+const uint16_t PID_PWM_MAX = 4095; // 12-bit PWM duty cycle
+SpeedPID pid(1.f / PID_RATE, 0, PID_PWM_MAX);
+bool pid_enabled = false;
+
+// Run-up and coast-down curve recorder, see `curve_recorder.h`
+CurveRecorder recorder(N_SLITS_ON_DISK, SLIT_TIMEOUT);
+float recorder_trigger_revps = 1; // [rev/s] Trigger level
+float recorder_stop_revps = 0;    // [rev/s] Stop level, 0 is disabled
+uint16_t recorder_decimation = 1; // Slit periods per record
+
+// Logging of the rotation rate and optionally the raw slit periods to the QSPI
+// flash, see `data_logger.h`
+QSPIFlash qspi_flash;
+DataLogger logger(qspi_flash);
+uint32_t logger_interval = 100; // [ms] Interval of the speed records
+
+// Angle-synchronous sampling of an analog input, see `angle_sampler.h`. A0 and
+// A4 are taken by the DAC and the speed control output and can not be sampled.
+const uint8_t ANALOG_PINS[] = {A0, A1, A2, A3, A4, A5};
+const uint8_t PIN_SAMPLER = A1; // Default analog input
+AngleSampler sampler;
+
+// Optional Modbus RTU slave on the hardware serial port on pins 0 and 1, e.g.
+// via an RS-485 transceiver with automatic direction control, see
+// `modbus_rtu.h`. Can be switched on and off with ASCII command `b<address>`.
+const uint8_t MODBUS_ADDRESS = 0;   // Slave address at start-up, 0 is off
+const uint32_t MODBUS_BAUD = 19200; // [bit/s] 8 data bits, even parity
+
 // OLED display
 const uint8_t PIN_BUTTON_A = 9;
 const uint8_t PIN_BUTTON_B = 6;
@@ -60,10 +152,14 @@ const uint16_t T_DISPLAY = 500;       // [ms] Display refresh rate
 const uint16_t T_SCREENSAVER = 20000; // [ms] Turn display off when at 0 RPM
 
 // Instantiate serial port listener for receiving ASCII commands
-const uint8_t CMD_BUF_LEN = 16;  // Length of the ASCII command buffer
+const uint8_t CMD_BUF_LEN = 64;  // Length of the ASCII command buffer
 char cmd_buf[CMD_BUF_LEN]{'\0'}; // The ASCII command buffer
 DvG_StreamCommand sc(Serial, cmd_buf, CMD_BUF_LEN);
 
+// All output to the serial port is queued, so that `loop()` never blocks when
+// the host stops reading, see `tx_queue.h`
+TxQueue tx(Serial);
+
 /*------------------------------------------------------------------------------
   Frequency detector
 ------------------------------------------------------------------------------*/
@@ -75,35 +171,1243 @@ const double MIN_RADPS = MIN_REVPS * TWO_PI;
 
 volatile bool isr_done = false;
 volatile uint8_t isr_counter = 0;
-volatile uint32_t T_upflanks = 0; // [us] Measured duration for N_UPFLANKS
-double freq_upflanks = NAN;       // [Hz] Measured up-flank frequency
+volatile uint32_t T_upflanks = 0;  // [us] Measured duration for N_UPFLANKS
+volatile uint64_t micros_done = 0; // [us] Time of the last up-flank measured
+double freq_upflanks = NAN;        // [Hz] Measured up-flank frequency
+
+// Synchronization to the host clock, see `clock_sync.h`
+ClockSync clock_sync;
+uint64_t line_received_us = 0; // [us] Device time of the last received line
+uint64_t reading_us = 0; // [us] Device time of the last measured frequency
+
+// Every single slit period as measured by the ISR, to be processed in `loop()`
+RingBuffer<uint32_t, 512> slit_periods; // [us]
+volatile uint32_t T_upflank = 0;      // [us] Last slit period
+volatile uint32_t micros_upflank = 0; // [us] Time of the last up-flank
+volatile uint32_t n_upflanks_A = 0;   // Number of up-flanks so far
+
+// State of the second tacho input, only written by `isr_rising_B()`
+volatile uint32_t n_upflanks_B = 0;     // Number of up-flanks so far
+volatile uint32_t micros_upflank_B = 0; // [us] Time of the last up-flank
+volatile uint32_t T_upflank_B = 0;      // [us] Last up-flank period
+
+// High time and period of every slit, when monitoring the signal quality
+struct SlitTiming {
+  uint32_t high_us;   // [us] Time the signal was high
+  uint32_t period_us; // [us] Period up to the next up-flank
+};
+RingBuffer<SlitTiming, 256> slit_timings;
+volatile uint32_t T_high = 0;         // [us] High time of the last slit
+volatile bool T_high_valid = false;   // Was the down-flank detected?
+volatile bool quality_mode = false;   // Listen to both flanks?
+volatile bool quality_primed = false; // Was the last up-flank listened to?
+SignalQuality quality(N_SLITS_ON_DISK, SLIT_TIMEOUT);
+
+// Timestamps of the up-flanks, when streaming them compressed, see
+// `edge_codec.h`
+RingBuffer<uint32_t, 512> edge_stamps; // [us]
+volatile bool edge_stream = false;
+EdgeEncoder edge_encoder(N_SLITS_ON_DISK);
+
+// Snapshots of the second tacho input at every up-flank of the first input
+RingBuffer<RatioSample, 256> ratio_samples;
+RatioEngine ratio(N_SLITS_ON_DISK, N_SLITS_ON_DISK_B, N_RATIO_WINDOW,
+                  SLIT_TIMEOUT);
 
 void isr_rising() {
   // Interrupt service routine for when an up-flank is detected on the input pin
-  static uint32_t micros_start = 0;
+  static uint64_t micros_start = 0;
+  uint64_t micros64_now = micros64();
+  uint32_t micros_now = (uint32_t)micros64_now;
+  uint32_t period = micros_now - micros_upflank;
+
+  speed_alarm.onPeriod(period, micros_now); // First, for the lowest latency
+  speed_dac.onPeriod(period, micros_now);
+  tach_out.onPeriod(period, micros_now);
+  recorder.onPeriod(period, micros_now);
+  odometer.onPeriod(period);
+  slit_periods.push(period);
+  if (quality_mode) {
+    // A missed down-flank shows up as a high time equal to the period. The
+    // first slit after enabling is left out, as its down-flank was not
+    // listened to.
+    if (quality_primed) {
+      slit_timings.push({T_high_valid ? T_high : period, period});
+    }
+    quality_primed = true;
+    T_high_valid = false;
+  }
+  T_upflank = period;
+  micros_upflank = micros_now;
+  sampler.onEdge(micros_now);
+  if (edge_stream) {
+    edge_stamps.push(micros_now);
+  }
+  ratio_samples.push({micros_now, ++n_upflanks_A, n_upflanks_B,
+                      micros_upflank_B, T_upflank_B});
 
   if (!isr_done) {
     if (isr_counter == 0) {
-      micros_start = micros();
+      micros_start = micros64_now;
     }
     isr_counter++;
     if (isr_counter > N_UPFLANKS) {
-      T_upflanks = micros() - micros_start;
+      T_upflanks = (uint32_t)(micros64_now - micros_start);
+      micros_done = micros64_now;
       isr_done = true;
     }
   }
 }
 
+void isr_falling() {
+  // Interrupt service routine for when a down-flank is detected on the input
+  // pin, only active when monitoring the signal quality
+  T_high = micros() - micros_upflank;
+  T_high_valid = true;
+}
+
+void isr_change() {
+  // Interrupt service routine for both flanks on the input pin
+  if (digitalRead(PIN_TACHO)) {
+    isr_rising();
+  } else {
+    isr_falling();
+  }
+}
+
+void quality_enable(bool state) {
+  // Listen to both flanks when monitoring the signal quality, else to the
+  // up-flanks only to halve the interrupt load
+  detachInterrupt(digitalPinToInterrupt(PIN_TACHO));
+  quality_mode = state;
+  quality_primed = false;
+  T_high_valid = false;
+  slit_timings.clear();
+  quality.reset();
+  if (state) {
+    attachInterrupt(digitalPinToInterrupt(PIN_TACHO), isr_change, CHANGE);
+  } else {
+    attachInterrupt(digitalPinToInterrupt(PIN_TACHO), isr_rising, RISING);
+  }
+}
+
+void isr_rising_B() {
+  // Interrupt service routine for when an up-flank is detected on the second
+  // tacho input. Both tacho ISRs share the same priority, so they can not
+  // preempt each other and the snapshot in `isr_rising()` is consistent.
+  uint32_t micros_now = micros();
+
+  T_upflank_B = micros_now - micros_upflank_B;
+  micros_upflank_B = micros_now;
+  n_upflanks_B++;
+}
+
+void isr_reference() {
+  // Interrupt service routine for when an up-flank is detected on the second
+  // tacho input, while it is used as reference to calibrate the timebase
+  timebase.onEdge(micros());
+}
+
+void timebase_measure(bool state, double ref_hz) {
+  // Use the second tacho input as reference input or return it to normal
+  detachInterrupt(digitalPinToInterrupt(PIN_TACHO_B));
+  if (state) {
+    timebase.start(ref_hz);
+    attachInterrupt(digitalPinToInterrupt(PIN_TACHO_B), isr_reference, RISING);
+  } else {
+    timebase.stop();
+    attachInterrupt(digitalPinToInterrupt(PIN_TACHO_B), isr_rising_B, RISING);
+  }
+}
+
+void stream_edges() {
+  // Send the pending up-flank timestamps compressed in a binary frame: header
+  // 'E' 'C', uint16_t number of bytes n and n bytes of encoded edges
+  static uint32_t dropped = 0;
+  uint8_t frame[4 + 256];
+  uint16_t n = 0;
+  uint32_t stamp;
+
+  if (tx.availableForWrite() < (int)sizeof(frame)) {
+    return; // Wait for room for a full frame
+  }
+  if (edge_stamps.dropped() != dropped) {
+    dropped = edge_stamps.dropped();
+    edge_encoder.reset(); // Resync the host at a keyframe
+  }
+  while (n <= 256 - EdgeEncoder::MAX_TOKEN && edge_stamps.pop(stamp)) {
+    n += edge_encoder.encode(stamp, frame + 4 + n);
+  }
+  if (n > 0) {
+    frame[0] = 'E';
+    frame[1] = 'C';
+    frame[2] = (uint8_t)n;
+    frame[3] = (uint8_t)(n >> 8);
+    tx.write(frame, 4 + n);
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Speed control
+------------------------------------------------------------------------------*/
+
+void pid_tick() {
+  // Executed at a fixed rate from the timer interrupt. The rotation rate is
+  // taken from the last slit period, or from the time passed since the last
+  // up-flank when that is longer, i.e. when slowing down.
+  noInterrupts();
+  uint32_t period = T_upflank;
+  uint32_t elapsed = micros() - micros_upflank;
+  interrupts();
+
+  float revps = 0;
+  period = max(period, elapsed);
+  if (period > 0 && period <= SLIT_TIMEOUT) {
+    revps = (float)timebase.ticksPerSecond() /
+            ((float)period * N_SLITS_ON_DISK);
+  }
+  analogWrite(PIN_PID_PWM, (int)pid.update(revps));
+}
+
+void pid_enable(bool state) {
+  pid_enabled = state;
+  if (state) {
+    pid.reset(isnan(freq_upflanks) ? 0 : freq_upflanks / N_SLITS_ON_DISK);
+    control_timer_begin(PID_RATE, pid_tick);
+  } else {
+    control_timer_end();
+    analogWrite(PIN_PID_PWM, 0);
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Torsional vibration spectrum
+------------------------------------------------------------------------------*/
+
+// The order spectrum of the rotation rate fluctuations, see `order_spectrum.h`.
+// When enabled, the OLED screen shows the spectrum as a bar graph.
+OrderSpectrum spectrum(N_SLITS_ON_DISK, SLIT_TIMEOUT);
+bool spectrum_mode = false;
+
+double revps_to_unit(double revps) {
+  // Convert a rotation rate in rev/s to the currently selected unit
+  if (unit == TACHO_UNIT::RPM) {
+    return revps * 60.;
+  } else if (unit == TACHO_UNIT::RADPS) {
+    return revps * TWO_PI;
+  }
+  return revps;
+}
+
+void draw_spectrum() {
+  // Draw the amplitude per order as a bar graph below the top text line. One
+  // pixel column per FFT bin, leaving out the mean rotation rate at bin 0.
+  const uint8_t Y_BOTTOM = 31;
+  const uint8_t H_MAX = 22;
+  const float *amp = spectrum.amplitudes();
+  float amp_max = 0;
+
+  for (uint16_t k = 1; k < OrderSpectrum::N_BINS; ++k) {
+    amp_max = max(amp_max, amp[k]);
+  }
+  if (amp_max <= 0) {
+    return;
+  }
+  for (uint16_t k = 1; k < OrderSpectrum::N_BINS && k <= 128; ++k) {
+    uint8_t h = (uint8_t)(amp[k] / amp_max * H_MAX + .5f);
+    if (h > 0) {
+      display.drawFastVLine(k - 1, Y_BOTTOM - h + 1, h, SSD1306_WHITE);
+    }
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Serial commands
+------------------------------------------------------------------------------*/
+
+using Arg = CommandTable::Arg;
+using ARG = CommandTable::ARG;
+
+void cmd_rate(const Arg &) {
+  // Report rotation rate
+  double tacho_revps = freq_upflanks / N_SLITS_ON_DISK;
+  double tacho_rpm = tacho_revps * 60.;
+  double tacho_radps = tacho_revps * TWO_PI;
+
+  if (unit == TACHO_UNIT::RPM) {
+    tx.print(tacho_rpm, tacho_rpm < 100 ? 2 : 1);
+    tx.println(" rpm");
+
+  } else if (unit == TACHO_UNIT::REVPS) {
+    tx.print(tacho_revps, tacho_revps < 10 ? 3 : 2);
+    tx.println(" rev/s");
+
+  } else if (unit == TACHO_UNIT::RADPS) {
+    tx.print(tacho_radps, tacho_radps < 10 ? 3 : 2);
+    tx.println(" rad/s");
+  }
+}
+
+void cmd_help(const Arg &);
+
+void cmd_id(const Arg &) {
+  // Reply identity string
+  tx.println("Arduino, Tachometer v1.0");
+}
+
+void cmd_unit(const Arg &arg) {
+  // Change unit
+  if (arg.i == int(TACHO_UNIT::REVPS)) {
+    unit = TACHO_UNIT::REVPS;
+  } else if (arg.i == int(TACHO_UNIT::RADPS)) {
+    unit = TACHO_UNIT::RADPS;
+  } else {
+    unit = TACHO_UNIT::RPM;
+  }
+}
+
+void cmd_orders(const Arg &) {
+  // Report the top orders of the torsional vibration spectrum as tab-delimited
+  // pairs of order and amplitude in the current unit
+  const OrderSpectrum::Peak *peaks = spectrum.peaks();
+  for (uint8_t i = 0; i < OrderSpectrum::N_PEAKS; ++i) {
+    tx.print(peaks[i].order, 3);
+    tx.print('\t');
+    if (i < OrderSpectrum::N_PEAKS - 1) {
+      tx.print(revps_to_unit(peaks[i].amplitude), 4);
+      tx.print('\t');
+    } else {
+      tx.println(revps_to_unit(peaks[i].amplitude), 4);
+    }
+  }
+}
+
+void cmd_spectrum(const Arg &arg) {
+  // Enable or disable the torsional vibration spectrum mode
+  spectrum_mode = arg.b;
+  spectrum.reset();
+}
+
+void cmd_sampler_divider(const Arg &arg) {
+  // Sample on every k-th up-flank
+  sampler.setDivider(arg.i);
+}
+
+void cmd_sampler_pin(const Arg &arg) {
+  // Select analog input A1, A2, A3 or A5 for the angle-synchronous sampling
+  if (arg.i < 0 || arg.i >= (int64_t)sizeof(ANALOG_PINS) ||
+      ANALOG_PINS[arg.i] == PIN_DAC || ANALOG_PINS[arg.i] == PIN_PID_PWM ||
+      !sampler.begin(ANALOG_PINS[arg.i])) {
+    tx.println("ERROR: Invalid argument ap");
+  }
+}
+
+void cmd_sampler(const Arg &arg) {
+  // Start or stop streaming the angle-synchronous analog samples
+  sampler.enable(arg.b);
+}
+
+void cmd_ratio(const Arg &) {
+  // Report the speed ratio A/B and slip [%] of B
+  tx.print(ratio.ratio(), 5);
+  tx.print('\t');
+  tx.println(ratio.slip(), 3);
+}
+
+void cmd_ratio_window(const Arg &arg) {
+  // Set the ratio window in up-flanks of the first tacho input
+  ratio.setWindow(arg.i);
+}
+
+void cmd_ratio_nominal(const Arg &arg) {
+  // Set the nominal speed ratio A/B to compute the slip against
+  ratio.setNominalRatio(arg.f);
+}
+
+void cmd_alarm(const Arg &) {
+  // Report the alarm state, number of trips, last and maximum trip latency
+  // [us]
+  SpeedAlarm::Trip trip = speed_alarm.lastTrip();
+  if (speed_alarm.isTripped()) {
+    tx.print(trip.over ? "OVER" : "UNDER");
+  } else {
+    tx.print("OK");
+  }
+  tx.print('\t');
+  tx.print(speed_alarm.tripCount());
+  tx.print('\t');
+  tx.print(trip.latency_us);
+  tx.print('\t');
+  tx.println(speed_alarm.maxLatency());
+}
+
+void cmd_alarm_reset(const Arg &) {
+  // Reset a latched alarm
+  speed_alarm.reset();
+}
+
+void cmd_alarm_latching(const Arg &arg) {
+  // Latch the alarm or let it reset automatically
+  speed_alarm.setLatching(arg.b);
+}
+
+void alarm_configure() {
+  speed_alarm.configure(alarm_over_revps, alarm_under_revps, alarm_hysteresis,
+                        N_SLITS_ON_DISK, timebase.ticksPerSecond());
+}
+
+void cmd_alarm_over(const Arg &arg) {
+  // Set the over-speed threshold in the current unit
+  alarm_over_revps = arg.f / revps_to_unit(1.);
+  alarm_configure();
+}
+
+void cmd_alarm_under(const Arg &arg) {
+  // Set the under-speed threshold in the current unit
+  alarm_under_revps = arg.f / revps_to_unit(1.);
+  alarm_configure();
+}
+
+void cmd_alarm_hysteresis(const Arg &arg) {
+  // Set the hysteresis in %
+  if (!(arg.f >= 0 && arg.f <= ALARM_HYSTERESIS_MAX)) {
+    tx.println("ERROR: Invalid argument xh");
+    return;
+  }
+  alarm_hysteresis = arg.f;
+  alarm_configure();
+}
+
+void cmd_dac(const Arg &) {
+  // Report the DAC value, full scale in the current unit and update interval
+  // [us]
+  tx.print(speed_dac.getValue());
+  tx.print('\t');
+  tx.print(revps_to_unit(speed_dac.getFullScale()), 2);
+  tx.print('\t');
+  tx.println(speed_dac.getInterval());
+}
+
+void cmd_dac_full_scale(const Arg &arg) {
+  // Set the DAC full-scale rotation rate in the current unit
+  speed_dac.configure(arg.f / revps_to_unit(1.), speed_dac.getInterval(),
+                      timebase.ticksPerSecond());
+}
+
+void cmd_dac_interval(const Arg &arg) {
+  // Set the DAC update interval [us]
+  speed_dac.configure(speed_dac.getFullScale(), arg.i,
+                      timebase.ticksPerSecond());
+}
+
+void cmd_dac_enable(const Arg &arg) {
+  // Enable or disable the analog speed output
+  speed_dac.enable(arg.b);
+}
+
+void cmd_tach_out(const Arg &) {
+  // Report the tach-out pulses per revolution, output frequency [Hz],
+  // phase-locked state, number of glitches, number of clipped periods and the
+  // lowest output frequency [Hz] of the timer
+  tx.print(tach_out.getPulsesPerRev());
+  tx.print('\t');
+  tx.print(tach_out.frequency(timebase.ticksPerSecond()), 3);
+  tx.print('\t');
+  tx.print(tach_out.isLocked());
+  tx.print('\t');
+  tx.print(tach_out.glitchCount());
+  tx.print('\t');
+  tx.print(tach_out.clippedCount());
+  tx.print('\t');
+  tx.println(tach_out.minFrequency(timebase.ticksPerSecond()), 3);
+}
+
+void cmd_tach_out_ppr(const Arg &arg) {
+  // Set the tach-out pulses per revolution, 0 to disable
+  tach_out.setPulsesPerRev(arg.i);
+}
+
+void cmd_pid(const Arg &) {
+  // Report the speed control setpoint and ramped setpoint in the current unit,
+  // the output duty cycle and the timing jitter [us]
+  tx.print(revps_to_unit(pid.getSetpoint()), 3);
+  tx.print('\t');
+  tx.print(revps_to_unit(pid.getRampedSetpoint()), 3);
+  tx.print('\t');
+  tx.print(pid.getOutput(), 1);
+  tx.print('\t');
+  tx.println(control_timer_jitter());
+}
+
+void cmd_pid_setpoint(const Arg &arg) {
+  // Set the speed control setpoint in the current unit
+  pid.setSetpoint(arg.f / revps_to_unit(1.));
+}
+
+void cmd_pid_ramp(const Arg &arg) {
+  // Set the setpoint ramp rate in the current unit per second
+  pid.setRampRate(arg.f / revps_to_unit(1.));
+}
+
+// Set a PID gain, in duty cycle units per rev/s
+void cmd_pid_kp(const Arg &arg) {
+  pid.setGains(arg.f, pid.getKi(), pid.getKd());
+}
+
+void cmd_pid_ki(const Arg &arg) {
+  pid.setGains(pid.getKp(), arg.f, pid.getKd());
+}
+
+void cmd_pid_kd(const Arg &arg) {
+  pid.setGains(pid.getKp(), pid.getKi(), arg.f);
+}
+
+void cmd_pid_gains(const Arg &arg) {
+  // Set all PID gains at once: `pg<kp> <ki> <kd>`
+  float kp, ki, kd;
+  if (arg.args.count() == 3 && arg.args[0].toFloat(kp) &&
+      arg.args[1].toFloat(ki) && arg.args[2].toFloat(kd)) {
+    pid.setGains(kp, ki, kd);
+  } else {
+    tx.println("ERROR: Invalid argument pg");
+  }
+}
+
+void cmd_pid_feed_forward(const Arg &arg) {
+  // Set the feed-forward gain, in duty cycle units per rev/s, and optionally
+  // the offset in duty cycle units: `pf<gain> [offset]`
+  float kff, offset = 0;
+  if ((arg.args.count() == 1 || arg.args.count() == 2) &&
+      arg.args[0].toFloat(kff) &&
+      (arg.args.count() == 1 || arg.args[1].toFloat(offset))) {
+    pid.setFeedForward(kff, offset);
+  } else {
+    tx.println("ERROR: Invalid argument pf");
+  }
+}
+
+void cmd_pid_reset_jitter(const Arg &) {
+  // Restart tracking the timing jitter of the control loop
+  control_timer_reset_jitter();
+}
+
+void cmd_pid_enable(const Arg &arg) {
+  // Enable or disable the speed control
+  pid_enable(arg.b);
+}
+
+void cmd_recorder(const Arg &) {
+  // Report the recorder state and number of records
+  const char *states[] = {"IDLE", "ARMED", "RECORDING", "DONE"};
+  tx.print(states[int(recorder.getState())]);
+  tx.print('\t');
+  tx.println(recorder.count());
+}
+
+// Arm the recorder for a run-up (rising) or coast-down (falling)
+void cmd_recorder_rising(const Arg &) {
+  recorder.arm(true, recorder_trigger_revps, recorder_stop_revps,
+               recorder_decimation, timebase.ticksPerSecond());
+}
+
+void cmd_recorder_falling(const Arg &) {
+  recorder.arm(false, recorder_trigger_revps, recorder_stop_revps,
+               recorder_decimation, timebase.ticksPerSecond());
+}
+
+void cmd_recorder_disarm(const Arg &) {
+  // Disarm the recorder or stop the recording
+  recorder.disarm();
+}
+
+void cmd_recorder_send(const Arg &) {
+  // Send the recording as a single binary block. Blocks until sent.
+  tx.flush();
+  recorder.send(Serial);
+}
+
+void cmd_recorder_trigger(const Arg &arg) {
+  // Set the recorder trigger level in the current unit
+  recorder_trigger_revps = arg.f / revps_to_unit(1.);
+}
+
+void cmd_recorder_stop(const Arg &arg) {
+  // Set the recorder stop level in the current unit, 0 to disable
+  recorder_stop_revps = arg.f / revps_to_unit(1.);
+}
+
+void cmd_recorder_decimation(const Arg &arg) {
+  // Set the recorder decimation in slit periods per record, 1 to 65535
+  if (arg.i < 1 || arg.i > 0xFFFF) {
+    tx.println("ERROR: Invalid argument cd");
+    return;
+  }
+  recorder_decimation = arg.i;
+}
+
+void cmd_quality(const Arg &) {
+  // Report the signal quality flags, mean duty cycle [%], largest deviation of
+  // a single slit duty cycle [%], period jitter [%] and the number of slits
+  // processed
+  tx.print(quality.flags());
+  tx.print('\t');
+  tx.print(quality.dutyMean() * 100, 2);
+  tx.print('\t');
+  tx.print(quality.dutySpread() * 100, 2);
+  tx.print('\t');
+  tx.print(quality.jitter() * 100, 3);
+  tx.print('\t');
+  tx.println(quality.count());
+}
+
+void cmd_quality_enable(const Arg &arg) {
+  // Enable or disable the signal quality monitoring
+  quality_enable(arg.b);
+}
+
+void cmd_odometer(const Arg &) {
+  // Report the total revolutions, running hours and the number of checkpoints
+  // written since start-up
+  tx.print((unsigned long long)odometer.revolutions());
+  tx.print('\t');
+  tx.print(odometer.runningHours(), 3);
+  tx.print('\t');
+  tx.println(odometer.checkpointCount());
+}
+
+void cmd_odometer_reset(const Arg &) {
+  // Reset the total revolutions and running hours
+  odometer.reset();
+}
+
+void cmd_edges(const Arg &arg) {
+  // Start or stop streaming the compressed up-flank timestamps
+  edge_stream = false;
+  edge_stamps.clear();
+  edge_encoder.reset();
+  edge_stream = arg.b;
+}
+
+void cmd_logger(const Arg &) {
+  // Report the logger state, raw slit periods state, speed record interval
+  // [ms], number of pages written and dropped since start-up and the sequence
+  // number of the next page
+  tx.print(logger.isErasing()   ? "ERASING"
+               : logger.isEnabled() ? "ON"
+                                    : "OFF");
+  tx.print('\t');
+  tx.print(logger.getEdges());
+  tx.print('\t');
+  tx.print(logger_interval);
+  tx.print('\t');
+  tx.print(logger.pageCount());
+  tx.print('\t');
+  tx.print(logger.droppedCount());
+  tx.print('\t');
+  tx.println(logger.getSequence());
+}
+
+void cmd_logger_edges(const Arg &arg) {
+  // Log the raw slit periods as well or not
+  logger.setEdges(arg.b);
+}
+
+void cmd_logger_interval(const Arg &arg) {
+  // Set the interval of the speed records [ms], 1 to 65535 like the Modbus
+  // register
+  if (arg.i < 1 || arg.i > 0xFFFF) {
+    tx.println("ERROR: Invalid argument li");
+    return;
+  }
+  logger_interval = arg.i;
+}
+
+void cmd_logger_send(const Arg &) {
+  // Send the full log as binary pages. Blocks until sent.
+  tx.flush();
+  logger.send(Serial);
+}
+
+void cmd_logger_erase(const Arg &) {
+  // Erase the full log
+  logger.erase();
+}
+
+void cmd_logger_enable(const Arg &arg) {
+  // Start or stop logging
+  logger.enable(arg.b);
+}
+
+void cmd_sync_ping(const Arg &) {
+  // Ping of the host clock synchronization, reply the device time [us]
+  tx.println((unsigned long long)clock_sync.ping(line_received_us));
+}
+
+void cmd_sync_host_time(const Arg &arg) {
+  // Host time [us] at the moment of the last ping
+  clock_sync.addHostTime(arg.i);
+}
+
+void cmd_sync_reset(const Arg &) {
+  // Reset the host clock synchronization
+  clock_sync.reset();
+}
+
+void cmd_sync(const Arg &) {
+  // Report the reference device time [us], host minus device time at the
+  // reference [us], drift [ppm], accuracy [us] and number of pairs. Host time =
+  // device time + offset + drift * 1e-6 * (device time - reference)
+  tx.print((unsigned long long)clock_sync.getReference());
+  tx.print('\t');
+  tx.print(clock_sync.getOffset(), 1);
+  tx.print('\t');
+  tx.print(clock_sync.getDrift(), 3);
+  tx.print('\t');
+  tx.print(clock_sync.getAccuracy(), 1);
+  tx.print('\t');
+  tx.println(clock_sync.count());
+}
+
+void cmd_sync_reading(const Arg &) {
+  // Report the host time [us] of the last rotation rate measurement, its
+  // accuracy [us] and the rotation rate in the current unit
+  tx.print((long long)clock_sync.toHost(reading_us));
+  tx.print('\t');
+  tx.print(clock_sync.getAccuracy(), 1);
+  tx.print('\t');
+  tx.println(revps_to_unit(freq_upflanks / N_SLITS_ON_DISK), 4);
+}
+
+void cmd_tx_queue(const Arg &) {
+  // Report the number of queued bytes of the serial output, the peak number,
+  // the capacity, the number of dropped bytes and the overflow policy
+  tx.print(tx.depth());
+  tx.print('\t');
+  tx.print(tx.peakDepth());
+  tx.print('\t');
+  tx.print(TxQueue::SIZE);
+  tx.print('\t');
+  tx.print(tx.dropped());
+  tx.print('\t');
+  tx.println(int(tx.getPolicy()));
+}
+
+void cmd_tx_policy(const Arg &arg) {
+  // Set the overflow policy of the serial output: drop newest or oldest
+  tx.setPolicy(arg.b ? TxQueue::POLICY::DROP_OLDEST
+                     : TxQueue::POLICY::DROP_NEWEST);
+}
+
+void cmd_timebase(const Arg &) {
+  // Report the applied timebase correction and its uncertainty [ppm], followed
+  // by the ongoing measurement: measured correction and its uncertainty [ppm],
+  // number of accepted and rejected gates
+  tx.print(timebase.getPPM(), 3);
+  tx.print('\t');
+  tx.print(timebase.getUncertainty(), 3);
+  tx.print('\t');
+  tx.print(timebase.measuredPPM(), 3);
+  tx.print('\t');
+  tx.print(timebase.measuredUncertainty(), 3);
+  tx.print('\t');
+  tx.print(timebase.gateCount());
+  tx.print('\t');
+  tx.println(timebase.rejectCount());
+}
+
+void cmd_timebase_start(const Arg &arg) {
+  // Start measuring the timebase against a reference frequency [Hz] on the
+  // second tacho input, default 1 Hz for a 1-PPS signal
+  timebase_measure(true, arg.f > 0 ? arg.f : 1.);
+}
+
+void cmd_timebase_stop(const Arg &) {
+  // Stop measuring the timebase
+  timebase_measure(false, 0);
+}
+
+void timebase_changed() {
+  // Recompute everything derived from the timebase. An armed curve recorder
+  // keeps its levels until armed again.
+  alarm_configure();
+  speed_dac.configure(speed_dac.getFullScale(), speed_dac.getInterval(),
+                      timebase.ticksPerSecond());
+  spectrum.configure(timebase.ticksPerSecond());
+}
+
+void cmd_timebase_apply(const Arg &) {
+  // Apply the measured timebase correction and store it in flash
+  tx.println(timebase.apply() ? "OK" : "FAIL");
+  timebase_changed();
+}
+
+void cmd_timebase_clear(const Arg &) {
+  // Revert to the nominal timebase and store it in flash
+  tx.println(timebase.clear() ? "OK" : "FAIL");
+  timebase_changed();
+}
+
+/*------------------------------------------------------------------------------
+  Telemetry channels
+------------------------------------------------------------------------------*/
+
+// Slit periods since the last sample of telemetry channel `periods`
+const uint8_t TEL_PERIODS_MAX = 32;   // Periods to report per sample at most
+uint32_t tel_periods[TEL_PERIODS_MAX]; // [us]
+uint32_t n_tel_periods = 0;           // Number of periods, including unstored
+
+void tel_periods_report(const Arg &) {
+  // Report the number of slit periods since the last sample, followed by the
+  // first of those periods [us]
+  tx.print(n_tel_periods);
+  for (uint8_t i = 0; i < min(n_tel_periods, (uint32_t)TEL_PERIODS_MAX); ++i) {
+    tx.print('\t');
+    tx.print(tel_periods[i]);
+  }
+  tx.println();
+  n_tel_periods = 0;
+}
+
+// Each channel reads like the reply to its query command
+// clang-format off
+const Telemetry::Channel TELEMETRY_CHANNELS[] = {
+  {"rate",    cmd_rate},
+  {"reading", cmd_sync_reading},
+  {"periods", tel_periods_report},
+  {"ratio",   cmd_ratio},
+  {"alarm",   cmd_alarm},
+  {"dac",     cmd_dac},
+  {"tach",    cmd_tach_out},
+  {"pid",     cmd_pid},
+  {"quality", cmd_quality},
+  {"odo",     cmd_odometer},
+  {"logger",  cmd_logger},
+  {"sync",    cmd_sync},
+  {"queue",   cmd_tx_queue},
+};
+// clang-format on
+
+Telemetry telemetry(TELEMETRY_CHANNELS, sizeof(TELEMETRY_CHANNELS) /
+                                            sizeof(TELEMETRY_CHANNELS[0]));
+
+void cmd_telemetry(const Arg &) {
+  // List the telemetry channels with their subscribed rate [Hz], number of
+  // samples emitted and skipped and the largest lateness [us]
+  telemetry.list(tx);
+}
+
+void cmd_telemetry_subscribe(const Arg &arg) {
+  // Subscribe to a telemetry channel: `fs<name> <rate [Hz]>`, 0 to unsubscribe
+  float rate_hz;
+  if (arg.args.count() != 2 || !arg.args[1].toFloat(rate_hz) ||
+      !telemetry.subscribe(arg.args[0].c_str(), rate_hz)) {
+    tx.println("ERROR: Invalid argument fs");
+  }
+}
+
+void cmd_telemetry_off(const Arg &) {
+  // Unsubscribe from all telemetry channels
+  telemetry.unsubscribeAll();
+}
+
+/*------------------------------------------------------------------------------
+  Modbus RTU register map
+------------------------------------------------------------------------------*/
+
+// Input registers, read-only. Values of 32 and 64 bits span 2 and 4 registers,
+// high word first. Floats are IEEE 754.
+enum MB_INPUT : uint16_t {
+  MB_RATE_RPM = 0,    // [rpm] float, 0 at standstill
+  MB_RATE_REVPS = 2,  // [rev/s] float
+  MB_RATE_RADPS = 4,  // [rad/s] float
+  MB_STATUS = 6,      // Bits, see `mb_read_input()`
+  MB_QUALITY = 7,     // Signal quality flags, see `q?`
+  MB_REVOLUTIONS = 8, // Total revolutions, uint64
+  MB_HOURS = 12,      // [h] Running hours, float
+  MB_TRIPS = 14,      // Number of alarm trips, uint32
+  MB_RATIO = 16,      // Speed ratio of both tacho inputs, float
+  MB_SLIP = 18,       // [%] Slip of the second tacho input, float
+  MB_UPTIME = 20,     // [s] Time since start-up, uint32
+  MB_N_INPUT = 22
+};
+
+// Holding registers, read/write
+enum MB_HOLDING : uint16_t {
+  MB_UNIT = 0,          // Unit, 0: RPM, 1: rev/s, 2: rad/s
+  MB_ALARM_OVER = 1,    // [rev/s] Over-speed threshold, float, 0 is off
+  MB_ALARM_UNDER = 3,   // [rev/s] Under-speed threshold, float, 0 is off
+  MB_ALARM_HYST = 5,    // [%] Alarm hysteresis, float
+  MB_ALARM_LATCH = 7,   // Latch the alarm, 0 or 1
+  MB_ALARM_RESET = 8,   // Write 1 to reset a latched alarm, reads 0
+  MB_PID_ENABLE = 9,    // Speed control, 0 or 1
+  MB_PID_SETPOINT = 10, // [rev/s] Speed setpoint, float
+  MB_LOG_ENABLE = 12,   // Logging, 0 or 1
+  MB_LOG_INTERVAL = 13, // [ms] Interval of the logged speed records
+  MB_TACH_PPR = 14,     // Tach-out pulses per revolution, 0 is off
+  MB_DAC_ENABLE = 15,   // Analog speed output, 0 or 1
+  MB_N_HOLDING = 16
+};
+
+void mb_put_u32(uint16_t *regs, uint32_t value) {
+  regs[0] = value >> 16;
+  regs[1] = value & 0xFFFF;
+}
+
+void mb_put_float(uint16_t *regs, float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  mb_put_u32(regs, bits);
+}
+
+float mb_get_float(const uint16_t *regs) {
+  uint32_t bits = (uint32_t)regs[0] << 16 | regs[1];
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+void mb_read_input(uint16_t *regs) {
+  double revps = freq_upflanks / N_SLITS_ON_DISK;
+  if (isnan(revps)) {
+    revps = 0;
+  }
+  mb_put_float(&regs[MB_RATE_RPM], revps * 60.);
+  mb_put_float(&regs[MB_RATE_REVPS], revps);
+  mb_put_float(&regs[MB_RATE_RADPS], revps * TWO_PI);
+
+  // Bit 0: rotating, 1: alarm tripped, 2: signal degraded, 3: speed control
+  // on, 4: logging on
+  regs[MB_STATUS] = !isnan(freq_upflanks);
+  regs[MB_STATUS] |= speed_alarm.isTripped() << 1;
+  regs[MB_STATUS] |= (quality_mode && quality.flags()) << 2;
+  regs[MB_STATUS] |= pid_enabled << 3;
+  regs[MB_STATUS] |= logger.isEnabled() << 4;
+  regs[MB_QUALITY] = quality.flags();
+
+  uint64_t revs = odometer.revolutions();
+  mb_put_u32(&regs[MB_REVOLUTIONS], revs >> 32);
+  mb_put_u32(&regs[MB_REVOLUTIONS + 2], (uint32_t)revs);
+  mb_put_float(&regs[MB_HOURS], odometer.runningHours());
+  mb_put_u32(&regs[MB_TRIPS], speed_alarm.tripCount());
+  mb_put_float(&regs[MB_RATIO], ratio.ratio());
+  mb_put_float(&regs[MB_SLIP], ratio.slip());
+  mb_put_u32(&regs[MB_UPTIME], millis() / 1000);
+}
+
+void mb_read_holding(uint16_t *regs) {
+  regs[MB_UNIT] = int(unit);
+  mb_put_float(&regs[MB_ALARM_OVER], alarm_over_revps);
+  mb_put_float(&regs[MB_ALARM_UNDER], alarm_under_revps);
+  mb_put_float(&regs[MB_ALARM_HYST], alarm_hysteresis);
+  regs[MB_ALARM_LATCH] = speed_alarm.isLatching();
+  regs[MB_ALARM_RESET] = 0;
+  regs[MB_PID_ENABLE] = pid_enabled;
+  mb_put_float(&regs[MB_PID_SETPOINT], pid.getSetpoint());
+  regs[MB_LOG_ENABLE] = logger.isEnabled();
+  regs[MB_LOG_INTERVAL] = min(logger_interval, (uint32_t)0xFFFF);
+  regs[MB_TACH_PPR] = tach_out.getPulsesPerRev();
+  regs[MB_DAC_ENABLE] = speed_dac.isEnabled();
+}
+
+uint8_t mb_write_holding(uint16_t addr, uint16_t count,
+                         const uint16_t *values) {
+  // Overlay the written registers onto the current settings. All touched
+  // settings are checked before any of them gets applied.
+  uint16_t regs[MB_N_HOLDING];
+  mb_read_holding(regs);
+  bool written[MB_N_HOLDING] = {false};
+  for (uint16_t i = 0; i < count; ++i) {
+    regs[addr + i] = values[i];
+    written[addr + i] = true;
+  }
+
+  const uint16_t FLOATS[] = {MB_ALARM_OVER, MB_ALARM_UNDER, MB_ALARM_HYST,
+                             MB_PID_SETPOINT};
+  for (uint16_t reg : FLOATS) {
+    if (written[reg] != written[reg + 1]) {
+      return ModbusRTU::ILLEGAL_DATA_ADDRESS; // Half a float
+    }
+    if (written[reg]) {
+      float value = mb_get_float(&regs[reg]);
+      if (!isfinite(value) || value < 0) {
+        return ModbusRTU::ILLEGAL_DATA_VALUE;
+      }
+    }
+  }
+  if (mb_get_float(&regs[MB_ALARM_HYST]) > ALARM_HYSTERESIS_MAX) {
+    return ModbusRTU::ILLEGAL_DATA_VALUE;
+  }
+  const uint16_t BOOLS[] = {MB_ALARM_LATCH, MB_ALARM_RESET, MB_PID_ENABLE,
+                            MB_LOG_ENABLE, MB_DAC_ENABLE};
+  for (uint16_t reg : BOOLS) {
+    if (regs[reg] > 1) {
+      return ModbusRTU::ILLEGAL_DATA_VALUE;
+    }
+  }
+  if (regs[MB_UNIT] >= int(TACHO_UNIT::EOL) || regs[MB_LOG_INTERVAL] == 0) {
+    return ModbusRTU::ILLEGAL_DATA_VALUE;
+  }
+
+  if (written[MB_UNIT]) {
+    unit = static_cast<TACHO_UNIT>(regs[MB_UNIT]);
+  }
+  if (written[MB_ALARM_OVER] || written[MB_ALARM_UNDER] ||
+      written[MB_ALARM_HYST]) {
+    alarm_over_revps = mb_get_float(&regs[MB_ALARM_OVER]);
+    alarm_under_revps = mb_get_float(&regs[MB_ALARM_UNDER]);
+    alarm_hysteresis = mb_get_float(&regs[MB_ALARM_HYST]);
+    alarm_configure();
+  }
+  if (written[MB_ALARM_LATCH]) {
+    speed_alarm.setLatching(regs[MB_ALARM_LATCH]);
+  }
+  if (written[MB_ALARM_RESET] && regs[MB_ALARM_RESET]) {
+    speed_alarm.reset();
+  }
+  if (written[MB_PID_SETPOINT]) {
+    pid.setSetpoint(mb_get_float(&regs[MB_PID_SETPOINT]));
+  }
+  if (written[MB_PID_ENABLE] && regs[MB_PID_ENABLE] != pid_enabled) {
+    pid_enable(regs[MB_PID_ENABLE]);
+  }
+  if (written[MB_LOG_ENABLE]) {
+    logger.enable(regs[MB_LOG_ENABLE]);
+  }
+  if (written[MB_LOG_INTERVAL]) {
+    logger_interval = regs[MB_LOG_INTERVAL];
+  }
+  if (written[MB_TACH_PPR]) {
+    tach_out.setPulsesPerRev(regs[MB_TACH_PPR]);
+  }
+  if (written[MB_DAC_ENABLE]) {
+    speed_dac.enable(regs[MB_DAC_ENABLE]);
+  }
+  return ModbusRTU::NONE;
+}
+
+const ModbusRTU::RegisterMap MODBUS_MAP = {
+    MB_N_INPUT, MB_N_HOLDING, mb_read_input, mb_read_holding, mb_write_holding};
+
+ModbusRTU modbus(Serial1, MODBUS_MAP);
+
+void cmd_modbus(const Arg &) {
+  // Report the Modbus slave address, 0 when off, baud rate [bit/s], number of
+  // requests, dropped frames and exception replies
+  tx.print(modbus.getAddress());
+  tx.print('\t');
+  tx.print(modbus.getBaud());
+  tx.print('\t');
+  tx.print(modbus.requestCount());
+  tx.print('\t');
+  tx.print(modbus.errorCount());
+  tx.print('\t');
+  tx.println(modbus.exceptionCount());
+}
+
+void cmd_modbus_address(const Arg &arg) {
+  // Start the Modbus slave at address 1 to 247, or stop it with 0
+  if (arg.i < 0 || arg.i > 247) {
+    tx.println("ERROR: Invalid argument b");
+    return;
+  }
+  modbus.begin(arg.i, modbus.getBaud());
+}
+
+void cmd_modbus_baud(const Arg &arg) {
+  // Set the Modbus baud rate [bit/s]
+  if (arg.i < 1200 || arg.i > 1000000) {
+    tx.println("ERROR: Invalid argument bb");
+    return;
+  }
+  Serial1.begin(arg.i, SERIAL_8E1);
+  modbus.begin(modbus.getAddress(), arg.i);
+}
+
+// clang-format off
+const CommandTable::Command COMMANDS[] = {
+  {"?",    ARG::NONE,  cmd_rate,                "Rotation rate"},
+  {"help", ARG::NONE,  cmd_help,                "List all commands"},
+  {"id?",  ARG::NONE,  cmd_id,                  "Identity"},
+  {"u",    ARG::INT,   cmd_unit,                "Unit RPM, rev/s or rad/s"},
+  {"o?",   ARG::NONE,  cmd_orders,              "Top orders of the spectrum"},
+  {"o",    ARG::BOOL,  cmd_spectrum,            "Spectrum mode"},
+  {"ak",   ARG::INT,   cmd_sampler_divider,     "Sample every k-th up-flank"},
+  {"ap",   ARG::INT,   cmd_sampler_pin,         "Sample analog input A<n>"},
+  {"a",    ARG::BOOL,  cmd_sampler,             "Stream analog samples"},
+  {"r?",   ARG::NONE,  cmd_ratio,               "Speed ratio and slip [%]"},
+  {"rw",   ARG::INT,   cmd_ratio_window,        "Ratio window [up-flanks]"},
+  {"rn",   ARG::FLOAT, cmd_ratio_nominal,       "Nominal speed ratio"},
+  {"x?",   ARG::NONE,  cmd_alarm,               "Alarm state and trips"},
+  {"xr",   ARG::NONE,  cmd_alarm_reset,         "Reset the alarm"},
+  {"xl",   ARG::BOOL,  cmd_alarm_latching,      "Latch the alarm"},
+  {"xo",   ARG::FLOAT, cmd_alarm_over,          "Over-speed threshold, 0 off"},
+  {"xu",   ARG::FLOAT, cmd_alarm_under,         "Under-speed threshold, 0 off"},
+  {"xh",   ARG::FLOAT, cmd_alarm_hysteresis,    "Alarm hysteresis [%]"},
+  {"d?",   ARG::NONE,  cmd_dac,                 "DAC state"},
+  {"df",   ARG::FLOAT, cmd_dac_full_scale,      "DAC full scale"},
+  {"di",   ARG::INT,   cmd_dac_interval,        "DAC update interval [us]"},
+  {"d",    ARG::BOOL,  cmd_dac_enable,          "Analog speed output"},
+  {"t?",   ARG::NONE,  cmd_tach_out,            "Tach-out state"},
+  {"tp",   ARG::INT,   cmd_tach_out_ppr,        "Tach-out pulses/rev, 0 off"},
+  {"tx?",  ARG::NONE,  cmd_tx_queue,            "Serial output queue"},
+  {"txo",  ARG::BOOL,  cmd_tx_policy,           "Drop oldest output when full"},
+  {"p?",   ARG::NONE,  cmd_pid,                 "Speed control state"},
+  {"ps",   ARG::FLOAT, cmd_pid_setpoint,        "Speed setpoint"},
+  {"pr",   ARG::FLOAT, cmd_pid_ramp,            "Setpoint ramp rate [/s]"},
+  {"pp",   ARG::FLOAT, cmd_pid_kp,              "Proportional gain"},
+  {"pi",   ARG::FLOAT, cmd_pid_ki,              "Integral gain"},
+  {"pd",   ARG::FLOAT, cmd_pid_kd,              "Derivative gain"},
+  {"pg",   ARG::LIST,  cmd_pid_gains,           "All three PID gains"},
+  {"pf",   ARG::LIST,  cmd_pid_feed_forward,    "Feed-forward gain [offset]"},
+  {"pj",   ARG::NONE,  cmd_pid_reset_jitter,    "Reset the control jitter"},
+  {"p",    ARG::BOOL,  cmd_pid_enable,          "Speed control"},
+  {"c?",   ARG::NONE,  cmd_recorder,            "Recorder state"},
+  {"cr",   ARG::NONE,  cmd_recorder_rising,     "Arm for a run-up"},
+  {"cf",   ARG::NONE,  cmd_recorder_falling,    "Arm for a coast-down"},
+  {"cx",   ARG::NONE,  cmd_recorder_disarm,     "Disarm the recorder"},
+  {"cb",   ARG::NONE,  cmd_recorder_send,       "Send the recording"},
+  {"ct",   ARG::FLOAT, cmd_recorder_trigger,    "Recorder trigger level"},
+  {"cs",   ARG::FLOAT, cmd_recorder_stop,       "Recorder stop level, 0 off"},
+  {"cd",   ARG::INT,   cmd_recorder_decimation, "Recorder decimation"},
+  {"q?",   ARG::NONE,  cmd_quality,             "Signal quality"},
+  {"q",    ARG::BOOL,  cmd_quality_enable,      "Signal quality monitoring"},
+  {"m?",   ARG::NONE,  cmd_odometer,            "Revolutions and hours"},
+  {"mr",   ARG::NONE,  cmd_odometer_reset,      "Reset the odometer"},
+  {"e",    ARG::BOOL,  cmd_edges,               "Stream compressed edges"},
+  {"l?",   ARG::NONE,  cmd_logger,              "Logger state"},
+  {"le",   ARG::BOOL,  cmd_logger_edges,        "Log the slit periods"},
+  {"li",   ARG::INT,   cmd_logger_interval,     "Speed record interval [ms]"},
+  {"lb",   ARG::NONE,  cmd_logger_send,         "Send the log"},
+  {"lx",   ARG::NONE,  cmd_logger_erase,        "Erase the log"},
+  {"l",    ARG::BOOL,  cmd_logger_enable,       "Logging"},
+  {"sp",   ARG::NONE,  cmd_sync_ping,           "Clock sync ping"},
+  {"st",   ARG::INT,   cmd_sync_host_time,      "Host time of the ping [us]"},
+  {"sr",   ARG::NONE,  cmd_sync_reset,          "Reset the clock sync"},
+  {"s?",   ARG::NONE,  cmd_sync,                "Clock sync fit"},
+  {"sv",   ARG::NONE,  cmd_sync_reading,        "Reading in host time"},
+  {"k?",   ARG::NONE,  cmd_timebase,            "Timebase correction"},
+  {"ks",   ARG::FLOAT, cmd_timebase_start,      "Measure timebase [Hz]"},
+  {"kx",   ARG::NONE,  cmd_timebase_stop,       "Stop measuring timebase"},
+  {"kw",   ARG::NONE,  cmd_timebase_apply,      "Apply timebase correction"},
+  {"kc",   ARG::NONE,  cmd_timebase_clear,      "Clear timebase correction"},
+  {"b?",   ARG::NONE,  cmd_modbus,              "Modbus slave state"},
+  {"bb",   ARG::INT,   cmd_modbus_baud,         "Modbus baud rate"},
+  {"b",    ARG::INT,   cmd_modbus_address,      "Modbus slave address, 0 off"},
+  {"f?",   ARG::NONE,  cmd_telemetry,           "Telemetry channels"},
+  {"fs",   ARG::LIST,  cmd_telemetry_subscribe, "Subscribe <channel> <Hz>"},
+  {"fx",   ARG::NONE,  cmd_telemetry_off,       "Unsubscribe all channels"},
+};
+// clang-format on
+
+static_assert(sizeof(COMMANDS) / sizeof(COMMANDS[0]) <=
+                  CommandTable::MAX_COMMANDS,
+              "Too many commands for the command table");
+
+CommandTable commands(COMMANDS, sizeof(COMMANDS) / sizeof(COMMANDS[0]));
+
+void cmd_help(const Arg &) {
+  // List all commands with their argument type
+  commands.help(tx);
+}
+
+void execute(char *str_cmd) {
+  // Execute a single command and reply any error
+  switch (commands.dispatch(str_cmd)) {
+    case CommandTable::RESULT::UNKNOWN:
+      tx.print("ERROR: Unknown command ");
+      tx.println(str_cmd);
+      break;
+    case CommandTable::RESULT::BAD_ARG:
+      tx.print("ERROR: Invalid argument ");
+      tx.println(str_cmd);
+      break;
+    default:
+      break;
+  }
+}
+
+void execute_line(char *line) {
+  // Execute a received line. It can start with a sequence tag `#<tag> ` and
+  // hold several commands separated by `;`. Those are executed in order and
+  // their replies are combined into a single line: The tag followed by a
+  // space, when given, and the reply of each command without its line ending,
+  // separated by `;`. Commands without a reply leave their field empty.
+  char *tag = nullptr;
+  if (line[0] == '#') {
+    tag = line + 1;
+    line = tag + strcspn(tag, " ");
+    if (*line != '\0') {
+      *line++ = '\0';
+    }
+  }
+
+  if (tag == nullptr && strchr(line, ';') == nullptr) {
+    // A single command, replied as is
+    if (*line == '\0') {
+      // An empty line queries the rotation rate. Not written into the command
+      // buffer, as that holds the bytes received after the line ending.
+      static char query[] = "?";
+      line = query;
+    }
+    execute(line);
+    return;
+  }
+
+  if (tag != nullptr) {
+    tx.print('#');
+    tx.print(tag);
+    tx.print(' ');
+  }
+  tx.joinLines(true);
+  while (true) {
+    char *end = strchr(line, ';');
+    if (end != nullptr) {
+      *end = '\0';
+    }
+    if (*line != '\0') {
+      execute(line);
+    }
+    if (end == nullptr) {
+      break;
+    }
+    tx.print(';');
+    line = end + 1;
+  }
+  tx.joinLines(false);
+  tx.println();
+}
+
 /*------------------------------------------------------------------------------
   setup
 ------------------------------------------------------------------------------*/
 
 void setup() {
   Serial.begin(9600);
+  commands.check(tx); // Report commands that can not be dispatched
+
+  timebase.begin();
+  odometer.begin();
+  qspi_flash.begin();
+  logger.begin();
 
   // Tacho input
   pinMode(PIN_TACHO, INPUT_PULLDOWN);
   attachInterrupt(digitalPinToInterrupt(PIN_TACHO), isr_rising, RISING);
+  pinMode(PIN_TACHO_B, INPUT_PULLDOWN);
+  attachInterrupt(digitalPinToInterrupt(PIN_TACHO_B), isr_rising_B, RISING);
+  speed_alarm.begin(PIN_ALARM);
+  speed_dac.begin(PIN_DAC);
+  speed_dac.configure(DAC_FULL_SCALE, DAC_INTERVAL, timebase.ticksPerSecond());
+  if (!tach_out.begin(PIN_TACH_OUT)) {
+    tx.println("ERROR: No TCC timer on the tach-out pin");
+  }
+  analogWriteResolution(12); // Duty cycle 0 to PID_PWM_MAX
+  analogWrite(PIN_PID_PWM, 0);
+  spectrum.begin();
+  spectrum.configure(timebase.ticksPerSecond());
+  sampler.begin(PIN_SAMPLER);
+  Serial1.begin(MODBUS_BAUD, SERIAL_8E1);
+  modbus.begin(MODBUS_ADDRESS, MODBUS_BAUD);
 
   // SSD1306_SWITCHCAPVCC = generate display voltage from 3.3V internally
   display.begin(SSD1306_SWITCHCAPVCC, 0x3C); // Address 0x3C for 128x32
@@ -131,9 +1435,11 @@ void loop() {
   static bool alive_blinker = true;
   static bool update_anim = false;
   static uint8_t anim = 0;
+  static bool screensaver = false;
 
   if (isr_done) {
-    freq_upflanks = 1000000. / T_upflanks * N_UPFLANKS;
+    freq_upflanks = timebase.ticksPerSecond() / T_upflanks * N_UPFLANKS;
+    reading_us = micros_done; // Not written by the ISR until `isr_done` clears
     update_anim = true;
     isr_counter = 0;
     isr_done = false;
@@ -148,42 +1454,95 @@ void loop() {
   double tacho_rpm = tacho_revps * 60.;
   double tacho_radps = tacho_revps * TWO_PI;
 
-  // Listen for commands on the serial port
-  if (sc.available()) {
-    char *str_cmd = sc.getCommand();
-
-    if (strcmp(str_cmd, "id?") == 0) {
-      // Reply identity string
-      Serial.println("Arduino, Tachometer v1.0");
-
-    } else if (strncmp(str_cmd, "u", 1) == 0) {
-      // Change unit
-      uint8_t new_unit = parseIntInString(str_cmd, 1);
-      if (new_unit == int(TACHO_UNIT::REVPS)) {
-        unit = TACHO_UNIT::REVPS;
-      } else if (new_unit == int(TACHO_UNIT::RADPS)) {
-        unit = TACHO_UNIT::RADPS;
-      } else {
-        unit = TACHO_UNIT::RPM;
+  // Process the slit periods. The spectrum is computed in stages, one stage
+  // per iteration, to keep the display and serial handling responsive.
+  static uint32_t slit_periods_dropped = 0;
+  uint32_t slit_period;
+  bool tel_periods_on = telemetry.isSubscribed("periods");
+  while (slit_periods.pop(slit_period)) {
+    if (spectrum_mode) {
+      spectrum.push(slit_period);
+    }
+    logger.logEdge(slit_period);
+    if (tel_periods_on) {
+      if (n_tel_periods < TEL_PERIODS_MAX) {
+        tel_periods[n_tel_periods] = slit_period;
       }
+      n_tel_periods++;
+    }
+  }
+  if (!tel_periods_on) {
+    n_tel_periods = 0;
+  }
+  if (slit_periods.dropped() != slit_periods_dropped) {
+    slit_periods_dropped = slit_periods.dropped();
+    spectrum.reset(); // Slits went missing, the angle tracking is lost
+  }
+  if (spectrum_mode) {
+    spectrum.step();
+  }
+
+  // Monitor the signal quality
+  SlitTiming slit_timing;
+  while (slit_timings.pop(slit_timing)) {
+    quality.push(slit_timing.high_us, slit_timing.period_us);
+  }
+
+  // Pair the edges of both tacho inputs
+  RatioSample ratio_sample;
+  while (ratio_samples.pop(ratio_sample)) {
+    ratio.push(ratio_sample);
+  }
 
+  // Stream out the compressed up-flank timestamps
+  if (edge_stream) {
+    stream_edges();
+  }
+
+  // Stream out the angle-synchronous analog samples. Straight from the DMA
+  // buffer to the serial port when nothing else is queued, else through the
+  // queue to keep the order of the output.
+  if (sampler.isEnabled()) {
+    if (tx.depth() == 0) {
+      sampler.stream(Serial);
     } else {
-      // Report rotation rate
-      if (unit == TACHO_UNIT::RPM) {
-        Serial.print(tacho_rpm, tacho_rpm < 100 ? 2 : 1);
-        Serial.println(" rpm");
-
-      } else if (unit == TACHO_UNIT::REVPS) {
-        Serial.print(tacho_revps, tacho_revps < 10 ? 3 : 2);
-        Serial.println(" rev/s");
-
-      } else if (unit == TACHO_UNIT::RADPS) {
-        Serial.print(tacho_radps, tacho_radps < 10 ? 3 : 2);
-        Serial.println(" rad/s");
-      }
+      sampler.stream(tx);
     }
   }
 
+  micros64(); // Keep track of the `micros()` wraparounds
+  timebase.poll();
+  odometer.poll();
+
+  // Log the rotation rate
+  static uint32_t tick_logger = now;
+  if (now - tick_logger >= logger_interval) {
+    tick_logger = now;
+    logger.logSpeed(micros64(), tacho_revps);
+  }
+  logger.poll();
+  speed_alarm.poll();
+  speed_dac.poll();
+  tach_out.poll();
+  recorder.poll();
+
+  // Listen for commands on the serial port
+  if (sc.available()) {
+    line_received_us = micros64(); // Before executing, for `sp`
+    tx.beginLine(); // Reply in full or not at all when the queue is full
+    execute_line(sc.getCommand());
+    tx.endLine();
+  }
+
+  // Answer the Modbus master
+  modbus.poll();
+
+  // Emit the subscribed telemetry channels that are due
+  telemetry.poll(tx);
+
+  // Hand over the queued output to the serial port, without blocking
+  tx.poll();
+
   // Read the buttons
   button_A.poll();
   button_B.poll();
@@ -194,79 +1553,108 @@ void loop() {
 
   // Refresh display
   if (now - tick_isr > T_SCREENSAVER) {
-    // Screensaver engaged
-    display.clearDisplay();
-    display.display();
-    delay(100);
+    // Screensaver engaged. Blank the display once, without blocking `loop()`
+    // any further.
+    if (!screensaver) {
+      screensaver = true;
+      display.clearDisplay();
+      display.display();
+    }
 
   } else {
+    screensaver = false;
     if (now - tick >= T_DISPLAY) {
       tick = now;
       display.clearDisplay();
 
-      // Draw rotation rate value
-      display.setCursor(0, 0);
-      display.setTextSize(3);
-
-      if (unit == TACHO_UNIT::RPM) {
+      if (spectrum_mode) {
+        // Draw rotation rate value on the top line and the spectrum below
+        display.setCursor(0, 0);
+        display.setTextSize(1);
         if (!isnan(freq_upflanks)) {
-          display.print(tacho_rpm, tacho_rpm < 100 ? 2 : 1);
+          display.print(revps_to_unit(tacho_revps), 2);
         } else {
-          display.print("<");
-          display.print(MIN_RPM);
+          display.print("-");
         }
-        display.setTextSize(1);
-        display.setCursor(110, 0);
-        display.print("RPM");
+        display.print(unit == TACHO_UNIT::RPM     ? " RPM"
+                      : unit == TACHO_UNIT::REVPS ? " REV/S"
+                                                  : " RAD/S");
+        display.setCursor(92, 0);
+        display.print("ORDER");
+        draw_spectrum();
 
-      } else if (unit == TACHO_UNIT::REVPS) {
-        if (!isnan(freq_upflanks)) {
-          display.print(tacho_revps, tacho_revps < 10 ? 3 : 2);
-        } else {
-          display.print("<");
-          display.print(MIN_REVPS);
+      } else {
+        // Draw rotation rate value
+        display.setCursor(0, 0);
+        display.setTextSize(3);
+
+        if (unit == TACHO_UNIT::RPM) {
+          if (!isnan(freq_upflanks)) {
+            display.print(tacho_rpm, tacho_rpm < 100 ? 2 : 1);
+          } else {
+            display.print("<");
+            display.print(MIN_RPM);
+          }
+          display.setTextSize(1);
+          display.setCursor(110, 0);
+          display.print("RPM");
+
+        } else if (unit == TACHO_UNIT::REVPS) {
+          if (!isnan(freq_upflanks)) {
+            display.print(tacho_revps, tacho_revps < 10 ? 3 : 2);
+          } else {
+            display.print("<");
+            display.print(MIN_REVPS);
+          }
+          display.setTextSize(1);
+          display.setCursor(110, 0);
+          display.print("REV");
+          display.setCursor(110, 8);
+          display.print("/S");
+
+        } else if (unit == TACHO_UNIT::RADPS) {
+          if (!isnan(freq_upflanks)) {
+            display.print(tacho_radps, tacho_radps < 10 ? 3 : 2);
+          } else {
+            display.print("<");
+            display.print(MIN_RADPS);
+          }
+          display.setTextSize(1);
+          display.setCursor(110, 0);
+          display.print("RAD");
+          display.setCursor(110, 8);
+          display.print("/S");
         }
-        display.setTextSize(1);
-        display.setCursor(110, 0);
-        display.print("REV");
-        display.setCursor(110, 8);
-        display.print("/S");
 
-      } else if (unit == TACHO_UNIT::RADPS) {
-        if (!isnan(freq_upflanks)) {
-          display.print(tacho_radps, tacho_radps < 10 ? 3 : 2);
-        } else {
-          display.print("<");
-          display.print(MIN_RADPS);
+        // Draw signal degradation indicator
+        if (quality_mode && quality.flags()) {
+          display.setTextSize(1);
+          display.setCursor(4, 24);
+          display.print("SIGNAL?");
         }
-        display.setTextSize(1);
-        display.setCursor(110, 0);
-        display.print("RAD");
-        display.setCursor(110, 8);
-        display.print("/S");
-      }
 
-      // Draw alive blinker
-      alive_blinker = !alive_blinker;
-      if (alive_blinker) {
-        display.fillRect(0, 30, 2, 2, SSD1306_WHITE);
-      }
+        // Draw alive blinker
+        alive_blinker = !alive_blinker;
+        if (alive_blinker) {
+          display.fillRect(0, 30, 2, 2, SSD1306_WHITE);
+        }
 
-      // Draw new readout animation
-      display.setTextSize(2);
-      display.setCursor(112, 19);
-      if (update_anim) {
-        update_anim = false;
-        anim = ((anim + 1) % 4);
-      }
-      if (anim == 0) {
-        display.print("|");
-      } else if (anim == 1) {
-        display.print("/");
-      } else if (anim == 2) {
-        display.print("-");
-      } else if (anim == 3) {
-        display.print("\\");
+        // Draw new readout animation
+        display.setTextSize(2);
+        display.setCursor(112, 19);
+        if (update_anim) {
+          update_anim = false;
+          anim = ((anim + 1) % 4);
+        }
+        if (anim == 0) {
+          display.print("|");
+        } else if (anim == 1) {
+          display.print("/");
+        } else if (anim == 2) {
+          display.print("-");
+        } else if (anim == 3) {
+          display.print("\\");
+        }
       }
 
       display.display();
@@ -0,0 +1,47 @@
+/**
+ * @file micros64.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief 64-bit monotonic extension of `micros()` that survives its
+ * wraparound.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "micros64.h"
+
+static uint32_t micros64_hi = 0;   // Number of wraparounds of `micros()`
+static uint32_t micros64_last = 0; // Last `micros()` seen
+
+uint64_t micros64() {
+#if defined(__SAMD51__)
+  // Keep the interrupts disabled when called with them disabled already
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+#else
+  noInterrupts();
+#endif
+
+  // A step back of more than half the range is a wraparound. A smaller one is
+  // `micros()` regressing a tick, as it can when called with the interrupts
+  // disabled, which is held at the last value.
+  uint32_t t32 = micros();
+  if ((int32_t)(t32 - micros64_last) < 0) {
+    t32 = micros64_last;
+  } else if (t32 < micros64_last) {
+    micros64_hi++;
+  }
+  micros64_last = t32;
+  uint64_t t64 = ((uint64_t)micros64_hi << 32) | t32;
+
+#if defined(__SAMD51__)
+  __set_PRIMASK(primask);
+#else
+  interrupts();
+#endif
+  return t64;
+}
+
+uint64_t micros64_extend(uint32_t stamp_us) {
+  // Signed, as a stamp can be slightly ahead when `micros()` stepped back
+  uint64_t t64 = micros64();
+  return t64 + (int32_t)(stamp_us - (uint32_t)t64);
+}
@@ -0,0 +1,34 @@
+/**
+ * @file micros64.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief 64-bit monotonic extension of `micros()` that survives its
+ * wraparound.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef MICROS64_H_
+#define MICROS64_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief Return the time since start-up [us] as 64 bits, monotonic.
+ *
+ * The 32-bit `micros()` clock wraps around every 71 minutes. Each call counts
+ * the wraparounds it sees, so this function must be called at least once per
+ * 35 minutes, e.g. from `loop()`, to tell a wraparound from `micros()` briefly
+ * stepping back. The lower 32 bits equal `micros()`, or the previous value
+ * when it stepped back. Safe to call from interrupt service routines and from
+ * `loop()`; the read-and-update runs with the interrupts disabled for a
+ * handful of cycles.
+ */
+uint64_t micros64();
+
+/**
+ * @brief Extend a `micros()` timestamp of the last 35 minutes to 64 bits, as
+ * returned by @ref micros64(). A timestamp slightly ahead, because `micros()`
+ * stepped back since it was taken, is extended correctly as well.
+ */
+uint64_t micros64_extend(uint32_t stamp_us);
+
+#endif
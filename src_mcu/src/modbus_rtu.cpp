@@ -0,0 +1,240 @@
+/**
+ * @file modbus_rtu.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Modbus RTU slave on a serial port, with non-blocking frame timing.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "modbus_rtu.h"
+
+// CRC16 with the reflected polynomial 0xA001, one entry per byte value
+static const uint16_t CRC16_TABLE[256] = {
+    0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+    0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+    0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+    0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+    0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+    0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+    0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+    0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+    0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+    0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+    0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+    0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+    0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+    0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+    0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+    0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+    0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+    0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+    0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+    0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+    0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+    0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+    0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+    0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+    0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+    0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+    0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+    0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+    0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+    0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+    0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+    0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040,
+};
+
+static inline uint16_t get16(const uint8_t *p) {
+  return (uint16_t)(p[0] << 8 | p[1]); // Big endian
+}
+
+static inline void put16(uint8_t *p, uint16_t value) {
+  p[0] = value >> 8;
+  p[1] = value & 0xFF;
+}
+
+ModbusRTU::ModbusRTU(Stream &port, const RegisterMap &map)
+    : _port(port), _map(map) {}
+
+void ModbusRTU::begin(uint8_t address, uint32_t baud) {
+  _address = (address <= 247) ? address : 0;
+  _baud = (baud > 0) ? baud : 19200;
+  // 3.5 characters of 11 bits, fixed at 1750 us above 19200 baud
+  _t_silence = (_baud > 19200) ? 1750 : (uint32_t)(38500000UL / _baud);
+  _rx_len = 0;
+  _rx_overrun = false;
+  _tx_len = 0;
+  _tx_sent = 0;
+  _n_requests = 0;
+  _n_errors = 0;
+  _n_exceptions = 0;
+  discardInput();
+}
+
+void ModbusRTU::discardInput() {
+  while (_port.available() > 0) {
+    _port.read();
+  }
+}
+
+uint16_t ModbusRTU::crc16(const uint8_t *data, uint16_t len) {
+  uint16_t crc = 0xFFFF;
+  while (len--) {
+    crc = (crc >> 8) ^ CRC16_TABLE[(crc ^ *data++) & 0xFF];
+  }
+  return crc;
+}
+
+void ModbusRTU::poll() {
+  if (_address == 0) {
+    // Ignore the bus, so that no stale bytes precede the first request once
+    // switched on
+    discardInput();
+    return;
+  }
+
+  // Send out the pending reply
+  if (_tx_sent < _tx_len) {
+    int room = _port.availableForWrite();
+    if (room > 0) {
+      size_t n = min((size_t)(_tx_len - _tx_sent), (size_t)room);
+      _tx_sent += _port.write(&_tx[_tx_sent], n);
+    }
+  }
+
+  // Take in the received bytes
+  uint32_t now = micros();
+  int n_avail = _port.available();
+  if (n_avail > 0) {
+    while (n_avail-- > 0) {
+      int c = _port.read();
+      if (_rx_len < MAX_FRAME) {
+        _rx[_rx_len++] = (uint8_t)c;
+      } else {
+        _rx_overrun = true;
+      }
+    }
+    _t_rx = now;
+    return;
+  }
+
+  // The frame ends after a silence of 3.5 characters
+  if ((_rx_len == 0 && !_rx_overrun) || now - _t_rx < _t_silence) {
+    return;
+  }
+  if (_rx_overrun || _rx_len < 4 ||
+      crc16(_rx, _rx_len - 2) != (_rx[_rx_len - 2] | _rx[_rx_len - 1] << 8)) {
+    _n_errors++;
+  } else if (_rx[0] == _address || _rx[0] == 0) {
+    process();
+  }
+  _rx_len = 0;
+  _rx_overrun = false;
+}
+
+void ModbusRTU::process() {
+  uint8_t function = _rx[1];
+  uint8_t exception = NONE;
+  _n_requests++;
+
+  switch (function) {
+    case 3:
+    case 4:
+      exception = readRegisters(function == 4);
+      break;
+    case 6:
+    case 16:
+      exception = writeRegisters();
+      break;
+    default:
+      exception = ILLEGAL_FUNCTION;
+      break;
+  }
+
+  if (exception != NONE) {
+    _n_exceptions++;
+    _tx[1] = function | 0x80;
+    _tx[2] = exception;
+    reply(3);
+  }
+}
+
+uint8_t ModbusRTU::readRegisters(bool input) {
+  if (_rx_len != 8) {
+    _n_errors++;
+    return NONE; // Malformed, no reply
+  }
+  uint16_t addr = get16(&_rx[2]);
+  uint16_t count = get16(&_rx[4]);
+  uint16_t n_regs = input ? _map.n_input : _map.n_holding;
+  if (count < 1 || count > 125) {
+    return ILLEGAL_DATA_VALUE;
+  }
+  if ((uint32_t)addr + count > n_regs) {
+    return ILLEGAL_DATA_ADDRESS;
+  }
+
+  uint16_t regs[MAX_REGISTERS];
+  if (input) {
+    _map.readInput(regs);
+  } else {
+    _map.readHolding(regs);
+  }
+  _tx[1] = _rx[1];
+  _tx[2] = count * 2;
+  for (uint16_t i = 0; i < count; ++i) {
+    put16(&_tx[3 + 2 * i], regs[addr + i]);
+  }
+  reply(3 + count * 2);
+  return NONE;
+}
+
+uint8_t ModbusRTU::writeRegisters() {
+  uint16_t addr = get16(&_rx[2]);
+  uint16_t count = 1;
+  uint16_t regs[MAX_REGISTERS];
+
+  if (_rx[1] == 6) {
+    if (_rx_len != 8) {
+      _n_errors++;
+      return NONE;
+    }
+    regs[0] = get16(&_rx[4]);
+  } else {
+    count = get16(&_rx[4]);
+    if (_rx_len < 9 || _rx_len != 9 + _rx[6]) {
+      _n_errors++;
+      return NONE;
+    }
+    if (count < 1 || count > 123 || _rx[6] != count * 2) {
+      return ILLEGAL_DATA_VALUE;
+    }
+  }
+  if ((uint32_t)addr + count > _map.n_holding) {
+    return ILLEGAL_DATA_ADDRESS;
+  }
+  if (_rx[1] == 16) {
+    for (uint16_t i = 0; i < count; ++i) {
+      regs[i] = get16(&_rx[7 + 2 * i]);
+    }
+  }
+
+  uint8_t exception = _map.writeHolding(addr, count, regs);
+  if (exception == NONE) {
+    // Echo the address and value, or the address and count
+    memcpy(&_tx[1], &_rx[1], 5);
+    reply(6);
+  }
+  return exception;
+}
+
+void ModbusRTU::reply(uint8_t len) {
+  if (_rx[0] == 0) {
+    return; // No reply to a broadcast
+  }
+  _tx[0] = _address;
+  uint16_t crc = crc16(_tx, len);
+  _tx[len] = crc & 0xFF;
+  _tx[len + 1] = crc >> 8;
+  _tx_len = len + 2;
+  _tx_sent = 0;
+}
@@ -0,0 +1,139 @@
+/**
+ * @file modbus_rtu.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Modbus RTU slave on a serial port, with non-blocking frame timing.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef MODBUS_RTU_H_
+#define MODBUS_RTU_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief Class to answer the requests of a Modbus RTU master to a register
+ * map.
+ *
+ * Supported are the function codes 3 (read holding registers), 4 (read input
+ * registers), 6 (write single register) and 16 (write multiple registers).
+ * Broadcasts to address 0 get executed when writing, without a reply.
+ * Requests to other slave addresses, and frames with a wrong CRC or length,
+ * are ignored. Other errors are answered with the Modbus exception codes.
+ *
+ * The register map is provided as a set of callbacks. On a read request, the
+ * full register image gets filled in once and the requested range is copied
+ * from it. On a write request, the written range is handed over as a whole,
+ * so that values spanning several registers are applied at once.
+ *
+ * A frame ends after a silence of 3.5 characters on the line, i.e. 1.75 ms
+ * above 19200 baud. @ref poll() takes in the received bytes and detects this
+ * silence, without blocking and without an interrupt. Because the line can
+ * only be checked once per `loop()` iteration, the reply may be delayed by one
+ * iteration and back-to-back frames are only separated when `loop()` is fast
+ * enough. This is fine for a master that waits for each reply, as Modbus
+ * prescribes. The reply is handed over to the port as far as it takes it
+ * without blocking.
+ */
+class ModbusRTU {
+public:
+  static constexpr uint8_t MAX_FRAME = 255; // [bytes] RTU frame size limit
+  static constexpr uint8_t MAX_REGISTERS = 64; // Size of a register image
+
+  /**
+   * @brief Modbus exception codes.
+   */
+  enum EXCEPTION : uint8_t {
+    NONE = 0,
+    ILLEGAL_FUNCTION = 1,
+    ILLEGAL_DATA_ADDRESS = 2,
+    ILLEGAL_DATA_VALUE = 3,
+    SLAVE_DEVICE_FAILURE = 4,
+  };
+
+  /**
+   * @brief Register map, provided by the application.
+   */
+  struct RegisterMap {
+    uint16_t n_input;   // Number of input registers, at most MAX_REGISTERS
+    uint16_t n_holding; // Number of holding registers, at most MAX_REGISTERS
+
+    // Fill in all input or holding registers
+    void (*readInput)(uint16_t *regs);
+    void (*readHolding)(uint16_t *regs);
+
+    // Apply @p count holding registers starting at @p addr and return an
+    // exception code, or NONE on success. The range is checked already.
+    uint8_t (*writeHolding)(uint16_t addr, uint16_t count,
+                            const uint16_t *regs);
+  };
+
+  /**
+   * @brief Construct a new ModbusRTU object, disabled.
+   *
+   * @param port Serial port, to be opened by the caller with the baud rate
+   * passed to @ref begin(), usually 8 data bits, even parity and 1 stop bit
+   * @param map Register map, which must outlive this object
+   */
+  ModbusRTU(Stream &port, const RegisterMap &map);
+
+  /**
+   * @brief Start answering as slave @p address, from 1 to 247, or stop when
+   * @p address is 0. Bytes received so far are discarded, as are all bytes
+   * received while stopped.
+   *
+   * @param baud [bit/s] Baud rate of the port, to derive the frame timing
+   */
+  void begin(uint8_t address, uint32_t baud);
+
+  /**
+   * @brief Take in the received bytes, answer a completed frame and send out
+   * the reply. This method should be called repeatedly from `loop()`.
+   */
+  void poll();
+
+  /**
+   * @brief Return the CRC16 of @p len bytes at @p data, as appended to a
+   * frame low byte first.
+   */
+  static uint16_t crc16(const uint8_t *data, uint16_t len);
+
+  inline uint8_t getAddress() const { return _address; }
+  inline uint32_t getBaud() const { return _baud; }
+
+  /**
+   * @brief Return the number of requests to this slave, the number of frames
+   * dropped for a wrong CRC, length or overrun and the number of exception
+   * replies, since @ref begin().
+   */
+  inline uint32_t requestCount() const { return _n_requests; }
+  inline uint32_t errorCount() const { return _n_errors; }
+  inline uint32_t exceptionCount() const { return _n_exceptions; }
+
+private:
+  void process();
+  uint8_t readRegisters(bool input);
+  uint8_t writeRegisters();
+  void reply(uint8_t len);
+  void discardInput();
+
+  Stream &_port;
+  const RegisterMap &_map;
+  uint8_t _address = 0;
+  uint32_t _baud = 19200;
+  uint32_t _t_silence = 0; // [us] 3.5 characters
+
+  uint8_t _rx[MAX_FRAME];
+  uint8_t _rx_len = 0;
+  bool _rx_overrun = false;
+  uint32_t _t_rx = 0; // [us] Time of the last received byte
+
+  uint8_t _tx[MAX_FRAME];
+  uint8_t _tx_len = 0;
+  uint8_t _tx_sent = 0;
+
+  uint32_t _n_requests = 0;
+  uint32_t _n_errors = 0;
+  uint32_t _n_exceptions = 0;
+};
+
+#endif
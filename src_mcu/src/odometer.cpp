@@ -0,0 +1,184 @@
+/**
+ * @file odometer.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Total revolutions and running hours counter with power-loss-safe
+ * persistence in flash.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "odometer.h"
+
+static const uint64_t MAGIC = 0x5245544D4F444F54; // "TODOMETR"
+
+Odometer::Odometer(uint16_t n_slits, uint32_t timeout_us, uint8_t flash_block)
+    : _blocks{FlashStore(flash_block), FlashStore(flash_block + 1)} {
+  _n_slits = n_slits;
+  _timeout_us = timeout_us;
+}
+
+bool Odometer::isValid(const Record &rec) {
+  return rec.crc == FlashStore::crc32(&rec, offsetof(Record, crc));
+}
+
+Odometer::Record Odometer::makeRecord(uint64_t n_slits, uint32_t run_s) {
+  Record rec = {n_slits, run_s, 0};
+  rec.crc = FlashStore::crc32(&rec, offsetof(Record, crc));
+  return rec;
+}
+
+Odometer::Record Odometer::readSlot(uint8_t block, uint16_t slot) const {
+  Record rec;
+  memcpy(&rec, _blocks[block].at(slot * sizeof(Record)), sizeof(rec));
+  return rec;
+}
+
+uint32_t Odometer::generationOf(uint8_t block) const {
+  // 0 when the block holds no valid header
+  Record hdr = readSlot(block, 0);
+  return (isValid(hdr) && hdr.n_slits == MAGIC ? hdr.run_s : 0);
+}
+
+bool Odometer::findLast(uint8_t block, Record &rec, uint16_t &next_slot) const {
+  // Find the last valid record and the first free slot after the last written
+  // one, skipping torn records
+  const Record erased = {UINT64_MAX, UINT32_MAX, UINT32_MAX};
+  bool found = false;
+  next_slot = 1;
+  for (uint16_t i = 1; i < N_SLOTS; ++i) {
+    Record slot = readSlot(block, i);
+    if (memcmp(&slot, &erased, sizeof(slot)) == 0) {
+      continue;
+    }
+    next_slot = i + 1;
+    if (isValid(slot)) {
+      rec = slot;
+      found = true;
+    }
+  }
+  return found;
+}
+
+void Odometer::begin() {
+  uint32_t gen_0 = generationOf(0);
+  uint32_t gen_1 = generationOf(1);
+  if (gen_0 == 0 && gen_1 == 0) {
+    _generation = 0; // Fresh start, the first checkpoint erases block 0
+    return;
+  }
+  _active = (gen_1 > gen_0 ? 1 : 0);
+  _generation = max(gen_0, gen_1);
+
+  // A power loss right after switching blocks leaves the new block without
+  // records, in which case the old block still holds the last checkpoint
+  Record rec;
+  uint16_t unused;
+  bool found = findLast(_active, rec, _slot);
+  if (!found && generationOf(1 - _active) != 0) {
+    found = findLast(1 - _active, rec, unused);
+  }
+  if (found) {
+    noInterrupts();
+    _n_slits_total = rec.n_slits;
+    _run_us = (uint64_t)rec.run_s * 1000000;
+    interrupts();
+    _ckpt_slits = rec.n_slits;
+    _ckpt_run_us = (uint64_t)rec.run_s * 1000000;
+  }
+}
+
+void Odometer::snapshot(uint64_t &n_slits, uint64_t &run_us) const {
+  noInterrupts();
+  n_slits = _n_slits_total;
+  run_us = _run_us;
+  interrupts();
+}
+
+void Odometer::writeRecord() {
+  _blocks[_active].beginWriteQuad(_slot * sizeof(Record), &_pending);
+  _state = STATE::WRITING;
+}
+
+void Odometer::poll() {
+  switch (_state) {
+    case STATE::IDLE: {
+      uint64_t n_slits;
+      uint64_t run_us;
+      snapshot(n_slits, run_us);
+      uint32_t now = millis();
+      if (!_reset_pending &&
+          (now - _ckpt_ms < CHECKPOINT_MIN_MS || // Limit the flash wear
+           (n_slits - _ckpt_slits < (uint64_t)CHECKPOINT_REVS * _n_slits &&
+            run_us - _ckpt_run_us < (uint64_t)CHECKPOINT_MS * 1000))) {
+        return;
+      }
+      _reset_pending = false;
+      _pending = makeRecord(n_slits, run_us / 1000000);
+      _ckpt_slits = n_slits;
+      _ckpt_run_us = run_us;
+      _ckpt_ms = now;
+
+      if (_generation == 0 || _slot >= N_SLOTS) {
+        // Continue in a freshly erased block
+        _next = (_generation == 0 ? _active : 1 - _active);
+        _blocks[_next].beginErase();
+        _state = STATE::ERASING;
+      } else {
+        writeRecord();
+      }
+      break;
+    }
+
+    case STATE::ERASING: {
+      if (FlashStore::isBusy()) {
+        return;
+      }
+      Record hdr = makeRecord(MAGIC, _generation + 1);
+      _blocks[_next].beginWriteQuad(0, &hdr);
+      _state = STATE::WRITE_HEADER;
+      break;
+    }
+
+    case STATE::WRITE_HEADER:
+      if (FlashStore::isBusy()) {
+        return;
+      }
+      _active = _next;
+      _generation++;
+      _slot = 1;
+      writeRecord();
+      break;
+
+    case STATE::WRITING:
+      if (FlashStore::isBusy()) {
+        return;
+      }
+      _slot++;
+      _n_checkpoints++;
+      _state = STATE::IDLE;
+      break;
+  }
+}
+
+void Odometer::reset() {
+  noInterrupts();
+  _n_slits_total = 0;
+  _run_us = 0;
+  interrupts();
+  _ckpt_slits = 0;
+  _ckpt_run_us = 0;
+  _reset_pending = true;
+}
+
+uint64_t Odometer::revolutions() const {
+  uint64_t n_slits;
+  uint64_t run_us;
+  snapshot(n_slits, run_us);
+  return n_slits / _n_slits;
+}
+
+double Odometer::runningHours() const {
+  uint64_t n_slits;
+  uint64_t run_us;
+  snapshot(n_slits, run_us);
+  return run_us / 3.6e9;
+}
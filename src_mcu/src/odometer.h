@@ -0,0 +1,149 @@
+/**
+ * @file odometer.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Total revolutions and running hours counter with power-loss-safe
+ * persistence in flash.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef ODOMETER_H_
+#define ODOMETER_H_
+
+#include <Arduino.h>
+
+#include "flash_store.h"
+
+/**
+ * @brief Class to count the total number of slits passed and the running time,
+ * i.e. the summed slit periods while not at standstill, for maintenance
+ * scheduling.
+ *
+ * The counters are checkpointed to flash every @ref CHECKPOINT_REVS
+ * revolutions or every @ref CHECKPOINT_MS of running, whichever comes first,
+ * but never sooner than @ref CHECKPOINT_MIN_MS after the previous checkpoint.
+ * Hence, a power loss loses at most that much running time and at most that
+ * many revolutions, or the revolutions of one minute when running faster.
+ *
+ * The checkpoints are appended to a log in two flash blocks used in turn, as
+ * 16-byte records of which each one carries a CRC32. Only when the active
+ * block is full, the other block gets erased and a header with an incremented
+ * generation number is written to it. This levels the wear over both blocks
+ * and over 2 x 511 checkpoints per erase. With at most one checkpoint per
+ * minute, each block gets erased at most once per 17 hours, i.e. 10,000 erase
+ * cycles last over 19 years of running non-stop. A power loss while writing
+ * leaves either a torn record, which fails its CRC and is skipped, or a torn
+ * block header, in which case the other block with the older generation stays
+ * active. On start-up, the last valid record of the active block is restored.
+ *
+ * Writing is done by a state machine in @ref poll() that never waits for the
+ * flash, so that neither the edge capture nor the display refresh is blocked.
+ */
+class Odometer {
+public:
+  static constexpr uint32_t CHECKPOINT_REVS = 1000;    // Max. revs lost
+  static constexpr uint32_t CHECKPOINT_MS = 60000;     // [ms] Max. running lost
+  static constexpr uint32_t CHECKPOINT_MIN_MS = 60000; // [ms] Min. in between
+
+  /**
+   * @brief Construct a new Odometer object.
+   *
+   * @param n_slits Number of slits on the encoder disk
+   * @param timeout_us [us] Slit periods longer than this are considered to be a
+   * standstill and do not add to the running time
+   * @param flash_block First of the two flash blocks to use, see
+   * @ref FlashStore
+   */
+  Odometer(uint16_t n_slits, uint32_t timeout_us, uint8_t flash_block);
+
+  /**
+   * @brief Restore the counters from the last valid checkpoint in flash.
+   */
+  void begin();
+
+  /**
+   * @brief To be called from the up-flank ISR.
+   *
+   * @param period_us [us] Last slit period
+   */
+  inline void onPeriod(uint32_t period_us) {
+    _n_slits_total++;
+    if (period_us <= _timeout_us) {
+      _run_us += period_us;
+    }
+  }
+
+  /**
+   * @brief Take a checkpoint when due and advance the flash writes. This method
+   * should be called repeatedly from `loop()`.
+   */
+  void poll();
+
+  /**
+   * @brief Reset both counters to zero and checkpoint them.
+   */
+  void reset();
+
+  /**
+   * @brief Return the total number of revolutions.
+   */
+  uint64_t revolutions() const;
+
+  /**
+   * @brief Return the total running time [h].
+   */
+  double runningHours() const;
+
+  /**
+   * @brief Return the number of checkpoints written since start-up.
+   */
+  inline uint32_t checkpointCount() const { return _n_checkpoints; }
+
+private:
+  enum class STATE {
+    IDLE,         // Waiting for the next checkpoint
+    ERASING,      // Erasing the next block
+    WRITE_HEADER, // Writing the header of the next block
+    WRITING       // Writing a record
+  };
+
+  // 16-byte record, also used as block header in slot 0 by setting
+  // `n_slits` to the magic number and `run_s` to the generation
+  struct Record {
+    uint64_t n_slits; // Total number of slits passed
+    uint32_t run_s;   // [s] Total running time
+    uint32_t crc;     // CRC32 of the above
+  };
+
+  static constexpr uint16_t N_SLOTS = FlashStore::BLOCK_SIZE / sizeof(Record);
+
+  void snapshot(uint64_t &n_slits, uint64_t &run_us) const;
+  Record readSlot(uint8_t block, uint16_t slot) const;
+  uint32_t generationOf(uint8_t block) const;
+  bool findLast(uint8_t block, Record &rec, uint16_t &next_slot) const;
+  void writeRecord();
+
+  static bool isValid(const Record &rec);
+  static Record makeRecord(uint64_t n_slits, uint32_t run_s);
+
+  uint16_t _n_slits;
+  uint32_t _timeout_us;
+  FlashStore _blocks[2];
+
+  // Written by the ISR
+  volatile uint64_t _n_slits_total = 0;
+  volatile uint64_t _run_us = 0; // [us]
+
+  STATE _state = STATE::IDLE;
+  uint8_t _active = 0;       // Index of the active block
+  uint8_t _next = 0;         // Index of the block being erased
+  uint32_t _generation = 0;  // Generation of the active block, 0 when none
+  uint16_t _slot = 1;        // Next free slot in the active block
+  Record _pending;           // Record being written
+  uint64_t _ckpt_slits = 0;  // Total slits at the last checkpoint
+  uint64_t _ckpt_run_us = 0; // [us] Running time at the last checkpoint
+  uint32_t _ckpt_ms = 0;     // [ms] `millis()` at the last checkpoint
+  bool _reset_pending = false;
+  uint32_t _n_checkpoints = 0;
+};
+
+#endif
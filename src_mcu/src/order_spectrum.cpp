@@ -0,0 +1,214 @@
+/**
+ * @file order_spectrum.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Torsional vibration analysis: Order spectrum of the instantaneous
+ * rotation rate as measured per slit of the optical encoder disk.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "order_spectrum.h"
+
+#include <math.h>
+
+#ifndef ORDER_SPECTRUM_USE_CMSIS
+/**
+ * @brief In-place iterative radix-2 complex FFT, used when the CMSIS-DSP
+ * kernels are not available.
+ */
+static void fft_radix2(float *re, float *im, uint16_t n) {
+  // Bit-reversal permutation
+  for (uint16_t i = 1, j = 0; i < n; ++i) {
+    uint16_t bit = n >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j) {
+      float tmp = re[i];
+      re[i] = re[j];
+      re[j] = tmp;
+      tmp = im[i];
+      im[i] = im[j];
+      im[j] = tmp;
+    }
+  }
+
+  // Butterflies
+  for (uint16_t len = 2; len <= n; len <<= 1) {
+    float ang = -2.f * (float)M_PI / len;
+    for (uint16_t k = 0; k < len / 2; ++k) {
+      float w_re = cosf(ang * k);
+      float w_im = sinf(ang * k);
+      for (uint16_t i = k; i < n; i += len) {
+        uint16_t j = i + len / 2;
+        float t_re = re[j] * w_re - im[j] * w_im;
+        float t_im = re[j] * w_im + im[j] * w_re;
+        re[j] = re[i] - t_re;
+        im[j] = im[i] - t_im;
+        re[i] += t_re;
+        im[i] += t_im;
+      }
+    }
+  }
+}
+#endif
+
+OrderSpectrum::OrderSpectrum(uint16_t n_slits, uint32_t max_period_us) {
+  _n_slits = n_slits;
+  _max_period_us = max_period_us;
+  _step = (float)n_slits / SAMPLES_PER_REV;
+  _in = _frame_A;
+  _work = _frame_B;
+  _stage = STAGE::IDLE;
+  _n_frames = 0;
+  _n_dropped = 0;
+  for (uint16_t k = 0; k < N_BINS; ++k) {
+    _mag[k] = 0.f;
+  }
+  for (uint8_t i = 0; i < N_PEAKS; ++i) {
+    _peaks[i] = {0.f, 0.f};
+  }
+  reset();
+}
+
+void OrderSpectrum::begin() {
+  // Hann window
+  for (uint16_t i = 0; i < FFT_LEN; ++i) {
+    _window[i] = 0.5f - 0.5f * cosf(2.f * (float)M_PI * i / FFT_LEN);
+  }
+
+#ifdef ORDER_SPECTRUM_USE_CMSIS
+  arm_rfft_fast_init_f32(&_rfft, FFT_LEN);
+#endif
+}
+
+void OrderSpectrum::reset() {
+  _primed = false;
+  _v_prev = 0.f;
+  _frac = 0.f;
+  _n_in = 0;
+}
+
+void OrderSpectrum::push(uint32_t period_us) {
+  if (period_us == 0 || period_us > _max_period_us) {
+    // Standstill: The angle tracking is lost
+    reset();
+    return;
+  }
+
+  float v = _ticks_per_s / ((float)period_us * _n_slits); // [rev/s]
+  if (!_primed) {
+    _primed = true;
+    _v_prev = v;
+    return;
+  }
+
+  // Linearly interpolate all output angles lying in between the previous and
+  // the current slit center
+  while (_frac < 1.f) {
+    emit(_v_prev + (v - _v_prev) * _frac);
+    _frac += _step;
+  }
+  _frac -= 1.f;
+  _v_prev = v;
+}
+
+void OrderSpectrum::emit(float revps) {
+  _in[_n_in++] = revps;
+  if (_n_in < FFT_LEN) {
+    return;
+  }
+
+  _n_in = 0;
+  if (_stage == STAGE::IDLE) {
+    float *tmp = _work;
+    _work = _in;
+    _in = tmp;
+    _stage = STAGE::WINDOW;
+  } else {
+    _n_dropped++;
+  }
+}
+
+bool OrderSpectrum::step() {
+  switch (_stage) {
+    case STAGE::IDLE:
+      return false;
+
+    case STAGE::WINDOW: {
+      // Remove the mean and apply the window
+      float mean = 0.f;
+      for (uint16_t i = 0; i < FFT_LEN; ++i) {
+        mean += _work[i];
+      }
+      mean /= FFT_LEN;
+      for (uint16_t i = 0; i < FFT_LEN; ++i) {
+        _fft[i] = (_work[i] - mean) * _window[i];
+      }
+      _mag[0] = mean;
+      _stage = STAGE::FFT;
+      return false;
+    }
+
+    case STAGE::FFT:
+#ifdef ORDER_SPECTRUM_USE_CMSIS
+      // The input gets modified, hence the copy in `_work` is used
+      for (uint16_t i = 0; i < FFT_LEN; ++i) {
+        _work[i] = _fft[i];
+      }
+      arm_rfft_fast_f32(&_rfft, _work, _fft, 0);
+#else
+      for (uint16_t i = 0; i < FFT_LEN; ++i) {
+        _im[i] = 0.f;
+      }
+      fft_radix2(_fft, _im, FFT_LEN);
+#endif
+      _stage = STAGE::MAGNITUDE;
+      return false;
+
+    case STAGE::MAGNITUDE: {
+      // Single-sided amplitude, corrected for the coherent gain of the Hann
+      // window: 2 / sum(w) = 4 / N
+      const float scale = 4.f / FFT_LEN;
+#ifdef ORDER_SPECTRUM_USE_CMSIS
+      // Packed format: [Re(0), Re(N/2), Re(1), Im(1), Re(2), Im(2), ...]
+      arm_cmplx_mag_f32(&_fft[2], &_mag[1], FFT_LEN / 2 - 1);
+      arm_scale_f32(&_mag[1], scale, &_mag[1], FFT_LEN / 2 - 1);
+      _mag[N_BINS - 1] = fabsf(_fft[1]) * scale / 2;
+#else
+      for (uint16_t k = 1; k < N_BINS - 1; ++k) {
+        _mag[k] = sqrtf(_fft[k] * _fft[k] + _im[k] * _im[k]) * scale;
+      }
+      _mag[N_BINS - 1] = fabsf(_fft[N_BINS - 1]) * scale / 2;
+#endif
+      _stage = STAGE::PEAKS;
+      return false;
+    }
+
+    case STAGE::PEAKS:
+      // Keep the largest local maxima, sorted by descending amplitude
+      for (uint8_t i = 0; i < N_PEAKS; ++i) {
+        _peaks[i] = {0.f, 0.f};
+      }
+      for (uint16_t k = 1; k < N_BINS; ++k) {
+        float a = _mag[k];
+        if ((k > 1 && a <= _mag[k - 1]) ||
+            (k < N_BINS - 1 && a < _mag[k + 1])) {
+          continue;
+        }
+        if (a <= _peaks[N_PEAKS - 1].amplitude) {
+          continue;
+        }
+        uint8_t i = N_PEAKS - 1;
+        for (; i > 0 && _peaks[i - 1].amplitude < a; --i) {
+          _peaks[i] = _peaks[i - 1];
+        }
+        _peaks[i] = {orderOfBin(k), a};
+      }
+      _n_frames++;
+      _stage = STAGE::IDLE;
+      return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,158 @@
+/**
+ * @file order_spectrum.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Torsional vibration analysis: Order spectrum of the instantaneous
+ * rotation rate as measured per slit of the optical encoder disk.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef ORDER_SPECTRUM_H_
+#define ORDER_SPECTRUM_H_
+
+#include <stdint.h>
+
+#if defined(ARM_MATH_CM4)
+#  include <arm_math.h>
+#  define ORDER_SPECTRUM_USE_CMSIS
+#endif
+
+/**
+ * @brief Class to compute the order spectrum of the instantaneous rotation
+ * rate, i.e. the spectrum of the speed fluctuations as a function of the
+ * number of cycles per revolution instead of cycles per second.
+ *
+ * Each measured slit period gives the instantaneous rotation rate at the angle
+ * halfway that slit. These samples get linearly resampled onto a fixed number
+ * of @ref SAMPLES_PER_REV equidistant angles per revolution (order tracking),
+ * such that a frame of @ref FFT_LEN samples always spans an integer number of
+ * revolutions. A Hann-windowed real FFT then gives the amplitude per order.
+ *
+ * The resampling is done per slit period inside @ref push(), while the heavy
+ * lifting is split up into stages of which only one gets executed per call to
+ * @ref step(). This keeps the time spent per `loop()` iteration bounded. On the
+ * SAMD51 the FFT runs on the CMSIS-DSP kernels. Elsewhere, e.g. on a host PC, a
+ * plain radix-2 FFT is used instead, so that this file builds anywhere.
+ */
+class OrderSpectrum {
+public:
+  static constexpr uint16_t FFT_LEN = 256;          // Samples per frame
+  static constexpr uint16_t SAMPLES_PER_REV = 32;   // Angular resampling rate
+  static constexpr uint16_t N_BINS = FFT_LEN / 2 + 1; // Incl. DC and Nyquist
+  static constexpr uint8_t N_PEAKS = 5;             // Top orders to report
+
+  struct Peak {
+    float order;     // [cycles/rev]
+    float amplitude; // [rev/s] Single-sided amplitude of the speed fluctuation
+  };
+
+  /**
+   * @brief Construct a new OrderSpectrum object.
+   *
+   * @param n_slits Number of slits on the optical encoder disk
+   * @param max_period_us [us] Slit periods longer than this are considered to
+   * be a standstill, which restarts the resampling.
+   */
+  OrderSpectrum(uint16_t n_slits, uint32_t max_period_us);
+
+  /**
+   * @brief Initialize the FFT and the window function. Call once in `setup()`.
+   */
+  void begin();
+
+  /**
+   * @brief Set the calibrated number of `micros()` ticks per second, used to
+   * convert the slit periods into rotation rates. Default 1e6.
+   */
+  inline void configure(double ticks_per_s) { _ticks_per_s = ticks_per_s; }
+
+  /**
+   * @brief Discard the partially collected frame and restart the resampling.
+   */
+  void reset();
+
+  /**
+   * @brief Feed in the next measured slit period. Cheap, O(1) amortized.
+   *
+   * @param period_us [us] Time between two consecutive up-flanks
+   */
+  void push(uint32_t period_us);
+
+  /**
+   * @brief Execute the next stage of processing a completely collected frame,
+   * if any. This method should be called repeatedly.
+   *
+   * @return True when a new spectrum has just become available, false
+   * otherwise.
+   */
+  bool step();
+
+  /**
+   * @brief Return the order corresponding to FFT bin @p k.
+   */
+  inline float orderOfBin(uint16_t k) const {
+    return (float)k * SAMPLES_PER_REV / FFT_LEN;
+  }
+
+  /**
+   * @brief Return the amplitude spectrum [rev/s] of the last processed frame
+   * as an array of @ref N_BINS values, with index 0 being the mean rotation
+   * rate.
+   */
+  inline const float *amplitudes() const { return _mag; }
+
+  /**
+   * @brief Return the top @ref N_PEAKS orders of the last processed frame,
+   * sorted by descending amplitude. Unused entries have an amplitude of 0.
+   */
+  inline const Peak *peaks() const { return _peaks; }
+
+  /**
+   * @brief Return the number of frames processed since power up.
+   */
+  inline uint32_t frameCount() const { return _n_frames; }
+
+  /**
+   * @brief Return the number of completely collected frames that got dropped
+   * because the previous frame was still being processed.
+   */
+  inline uint32_t framesDropped() const { return _n_dropped; }
+
+private:
+  enum class STAGE { IDLE, WINDOW, FFT, MAGNITUDE, PEAKS };
+
+  void emit(float revps);
+
+  uint16_t _n_slits;
+  uint32_t _max_period_us;
+  float _ticks_per_s = 1e6f; // Calibrated `micros()` ticks per second
+
+  // Resampler state
+  bool _primed;   // Has a first slit been received after a reset?
+  float _v_prev;  // [rev/s] Rotation rate at the previous slit center
+  float _frac;    // Position of the next output sample after the previous
+                  // slit center, in units of slits
+  float _step;    // Output sample spacing, in units of slits
+  uint16_t _n_in; // Number of samples collected in the current frame
+
+  // Frames. The collecting and processing frames get swapped once full.
+  float _frame_A[FFT_LEN];
+  float _frame_B[FFT_LEN];
+  float *_in;   // Frame being collected
+  float *_work; // Frame being processed
+  float _fft[FFT_LEN];
+  float _window[FFT_LEN];
+  float _mag[N_BINS];
+  Peak _peaks[N_PEAKS];
+
+  STAGE _stage;
+  uint32_t _n_frames;
+  uint32_t _n_dropped;
+
+#ifdef ORDER_SPECTRUM_USE_CMSIS
+  arm_rfft_fast_instance_f32 _rfft;
+#else
+  float _im[FFT_LEN]; // Scratch space for the imaginary parts
+#endif
+};
+
+#endif
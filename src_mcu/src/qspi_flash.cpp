@@ -0,0 +1,218 @@
+/**
+ * @file qspi_flash.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Minimal driver for the 2 MB QSPI NOR flash chip of the Feather M4
+ * Express, with a file-backed simulator for off-target builds.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "qspi_flash.h"
+
+// Standard SPI NOR flash instructions
+static const uint8_t CMD_READ_JEDEC_ID = 0x9F;
+static const uint8_t CMD_READ_STATUS = 0x05;
+static const uint8_t CMD_WRITE_ENABLE = 0x06;
+static const uint8_t CMD_ERASE_SECTOR = 0x20;
+static const uint8_t CMD_ERASE_CHIP = 0xC7;
+static const uint8_t CMD_PAGE_PROGRAM = 0x02;
+static const uint8_t CMD_FAST_READ = 0x0B;
+static const uint8_t CMD_ENABLE_RESET = 0x66;
+static const uint8_t CMD_RESET = 0x99;
+
+#if defined(__SAMD51__)
+static const uint32_t F_SCK = 24000000; // [Hz] QSPI clock
+
+// Instruction frame fields shared by all instructions
+static const uint32_t IFRAME = QSPI_INSTRFRAME_WIDTH_SINGLE_BIT_SPI |
+                               QSPI_INSTRFRAME_ADDRLEN_24BITS |
+                               QSPI_INSTRFRAME_INSTREN;
+
+static void run_instruction(uint8_t cmd, uint32_t iframe, uint32_t addr,
+                            void *data, uint32_t len) {
+  // The memory-mapped QSPI region is cached, so disable and invalidate the
+  // cache for the duration of the instruction
+  CMCC->CTRL.bit.CEN = 0;
+  while (CMCC->SR.bit.CSTS) {}
+  CMCC->MAINT0.bit.INVALL = 1;
+
+  QSPI->INSTRADDR.reg = addr;
+  QSPI->INSTRCTRL.bit.INSTR = cmd;
+  QSPI->INSTRFRAME.reg = iframe;
+  (void)QSPI->INSTRFRAME.reg; // Synchronize
+
+  if (data && len) {
+    uint8_t *mem = (uint8_t *)(QSPI_AHB + addr);
+    uint32_t type = iframe & QSPI_INSTRFRAME_TFRTYPE_Msk;
+    if (type == QSPI_INSTRFRAME_TFRTYPE_READ ||
+        type == QSPI_INSTRFRAME_TFRTYPE_READMEMORY) {
+      memcpy(data, mem, len);
+    } else {
+      memcpy(mem, data, len);
+    }
+  }
+
+  __DSB();
+  __ISB();
+  QSPI->CTRLA.reg = QSPI_CTRLA_ENABLE | QSPI_CTRLA_LASTXFER;
+  while (!QSPI->INTFLAG.bit.INSTREND) {}
+  QSPI->INTFLAG.reg = QSPI_INTFLAG_INSTREND;
+
+  CMCC->CTRL.bit.CEN = 1;
+}
+
+static void run_command(uint8_t cmd) {
+  run_instruction(cmd, IFRAME | QSPI_INSTRFRAME_TFRTYPE_READ, 0, nullptr, 0);
+}
+
+static void read_command(uint8_t cmd, void *data, uint32_t len) {
+  run_instruction(cmd,
+                  IFRAME | QSPI_INSTRFRAME_TFRTYPE_READ |
+                      QSPI_INSTRFRAME_DATAEN,
+                  0, data, len);
+}
+
+static void set_pin_function_H(uint8_t group, uint8_t pin) {
+  PORT->Group[group].PINCFG[pin].bit.PMUXEN = 1;
+  if (pin & 1) {
+    PORT->Group[group].PMUX[pin >> 1].bit.PMUXO = 7;
+  } else {
+    PORT->Group[group].PMUX[pin >> 1].bit.PMUXE = 7;
+  }
+}
+
+bool QSPIFlash::begin() {
+  MCLK->APBCMASK.reg |= MCLK_APBCMASK_QSPI;
+  MCLK->AHBMASK.reg |= MCLK_AHBMASK_QSPI;
+  MCLK->AHBMASK.reg &= ~MCLK_AHBMASK_QSPI_2X;
+
+  QSPI->CTRLA.bit.SWRST = 1;
+
+  // DATA0-3 on PA08-PA11, SCK on PB10 and CS on PB11
+  for (uint8_t pin = 8; pin <= 11; ++pin) {
+    set_pin_function_H(0, pin);
+  }
+  set_pin_function_H(1, 10);
+  set_pin_function_H(1, 11);
+
+  QSPI->CTRLB.reg = QSPI_CTRLB_MODE_MEMORY | QSPI_CTRLB_CSMODE_LASTXFER |
+                    QSPI_CTRLB_DATALEN_8BITS;
+  QSPI->BAUD.reg = QSPI_BAUD_BAUD(F_CPU / F_SCK - 1); // SPI mode 0
+  QSPI->CTRLA.reg = QSPI_CTRLA_ENABLE;
+
+  run_command(CMD_ENABLE_RESET);
+  run_command(CMD_RESET);
+  delayMicroseconds(50);
+
+  // The capacity is encoded as a power of 2 in the last byte of the ID
+  uint8_t id[3];
+  read_command(CMD_READ_JEDEC_ID, id, sizeof(id));
+  if (id[0] == 0x00 || id[0] == 0xFF || id[2] < 16 || id[2] > 24) {
+    _size = 0;
+    return false;
+  }
+  _size = 1UL << id[2];
+  return true;
+}
+
+bool QSPIFlash::isBusy() {
+  uint8_t status;
+  read_command(CMD_READ_STATUS, &status, 1);
+  return status & 0x01; // Write in progress
+}
+
+void QSPIFlash::beginEraseSector(uint32_t addr) {
+  run_command(CMD_WRITE_ENABLE);
+  run_instruction(CMD_ERASE_SECTOR,
+                  IFRAME | QSPI_INSTRFRAME_TFRTYPE_WRITE |
+                      QSPI_INSTRFRAME_ADDREN,
+                  addr, nullptr, 0);
+}
+
+void QSPIFlash::beginEraseChip() {
+  run_command(CMD_WRITE_ENABLE);
+  run_command(CMD_ERASE_CHIP);
+}
+
+void QSPIFlash::beginProgram(uint32_t addr, const void *data, uint32_t len) {
+  run_command(CMD_WRITE_ENABLE);
+  run_instruction(CMD_PAGE_PROGRAM,
+                  IFRAME | QSPI_INSTRFRAME_TFRTYPE_WRITEMEMORY |
+                      QSPI_INSTRFRAME_ADDREN | QSPI_INSTRFRAME_DATAEN,
+                  addr, (void *)data, len);
+}
+
+void QSPIFlash::read(uint32_t addr, void *data, uint32_t len) {
+  run_instruction(CMD_FAST_READ,
+                  IFRAME | QSPI_INSTRFRAME_TFRTYPE_READMEMORY |
+                      QSPI_INSTRFRAME_ADDREN | QSPI_INSTRFRAME_DATAEN |
+                      QSPI_INSTRFRAME_DUMMYLEN(8),
+                  addr, data, len);
+}
+
+#else
+void QSPIFlash::setSimulationFile(const char *path, uint32_t size) {
+  _sim_path = path;
+  _sim_size = size;
+}
+
+bool QSPIFlash::begin() {
+  if (!_sim_path) {
+    return false;
+  }
+  if (!_sim) {
+    _sim = (uint8_t *)malloc(_sim_size);
+  }
+  memset(_sim, 0xFF, _sim_size);
+
+  // Load the existing image, or create an erased one
+  if (_sim_file) {
+    fclose(_sim_file);
+  }
+  _sim_file = fopen(_sim_path, "r+b");
+  if (_sim_file) {
+    size_t n = fread(_sim, 1, _sim_size, _sim_file);
+    (void)n;
+  } else {
+    _sim_file = fopen(_sim_path, "w+b");
+    if (!_sim_file) {
+      return false;
+    }
+  }
+  simSync(0, _sim_size);
+  _size = _sim_size;
+  return true;
+}
+
+void QSPIFlash::simSync(uint32_t addr, uint32_t len) {
+  fseek(_sim_file, addr, SEEK_SET);
+  fwrite(_sim + addr, 1, len, _sim_file);
+  fflush(_sim_file);
+}
+
+bool QSPIFlash::isBusy() { return false; }
+
+void QSPIFlash::beginEraseSector(uint32_t addr) {
+  addr &= ~(SECTOR_SIZE - 1);
+  memset(_sim + addr, 0xFF, SECTOR_SIZE);
+  simSync(addr, SECTOR_SIZE);
+}
+
+void QSPIFlash::beginEraseChip() {
+  memset(_sim, 0xFF, _size);
+  simSync(0, _size);
+}
+
+void QSPIFlash::beginProgram(uint32_t addr, const void *data, uint32_t len) {
+  // Programming can only clear bits and wraps around within the page
+  const uint8_t *src = (const uint8_t *)data;
+  uint32_t page = addr & ~(PAGE_SIZE - 1);
+  for (uint32_t i = 0; i < len; ++i) {
+    _sim[page + ((addr + i) & (PAGE_SIZE - 1))] &= src[i];
+  }
+  simSync(page, PAGE_SIZE);
+}
+
+void QSPIFlash::read(uint32_t addr, void *data, uint32_t len) {
+  memcpy(data, _sim + addr, len);
+}
+#endif
@@ -0,0 +1,95 @@
+/**
+ * @file qspi_flash.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Minimal driver for the 2 MB QSPI NOR flash chip of the Feather M4
+ * Express, with a file-backed simulator for off-target builds.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef QSPI_FLASH_H_
+#define QSPI_FLASH_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief Class to erase, program and read the external NOR flash chip over the
+ * QSPI peripheral of the SAMD51, in single-bit SPI mode.
+ *
+ * Erasing and programming only start the operation on the chip and return
+ * right away, so that the caller can poll @ref isBusy() instead of blocking.
+ * The usual NOR flash rules apply: erasing sets a 4 kB sector to 0xFF,
+ * programming can only clear bits and must not cross a 256-byte page.
+ *
+ * Off-target, the flash is simulated by a file on disk that is kept in sync
+ * after every operation. Killing the program at any point hence leaves the
+ * same state as a power loss would, at operation granularity.
+ */
+class QSPIFlash {
+public:
+  static constexpr uint32_t PAGE_SIZE = 256;    // [bytes] Program granularity
+  static constexpr uint32_t SECTOR_SIZE = 4096; // [bytes] Erase granularity
+
+  /**
+   * @brief Set up the QSPI peripheral and identify the flash chip.
+   *
+   * @return True when a flash chip was found
+   */
+  bool begin();
+
+  /**
+   * @brief Return the size of the flash [bytes], 0 when not found.
+   */
+  inline uint32_t size() const { return _size; }
+
+  /**
+   * @brief Return true while the chip is still erasing or programming.
+   */
+  bool isBusy();
+
+  /**
+   * @brief Start erasing the 4 kB sector at @p addr.
+   */
+  void beginEraseSector(uint32_t addr);
+
+  /**
+   * @brief Start erasing the full chip, which can take tens of seconds.
+   */
+  void beginEraseChip();
+
+  /**
+   * @brief Start programming @p len bytes of @p data at @p addr, not crossing
+   * a page boundary.
+   */
+  void beginProgram(uint32_t addr, const void *data, uint32_t len);
+
+  /**
+   * @brief Read @p len bytes at @p addr into @p data. The chip should not be
+   * busy.
+   */
+  void read(uint32_t addr, void *data, uint32_t len);
+
+#if !defined(__SAMD51__)
+  /**
+   * @brief Simulate the flash by the file at @p path, created when it does not
+   * exist yet. To be called before @ref begin().
+   *
+   * @param path File path
+   * @param size [bytes] Size of the simulated flash
+   */
+  void setSimulationFile(const char *path, uint32_t size = 2097152);
+#endif
+
+private:
+  uint32_t _size = 0;
+
+#if !defined(__SAMD51__)
+  void simSync(uint32_t addr, uint32_t len);
+
+  const char *_sim_path = nullptr;
+  uint32_t _sim_size = 0;
+  uint8_t *_sim = nullptr;
+  FILE *_sim_file = nullptr;
+#endif
+};
+
+#endif
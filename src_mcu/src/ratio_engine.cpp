@@ -0,0 +1,83 @@
+/**
+ * @file ratio_engine.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Speed ratio and slip between two tacho channels, computed from
+ * time-aligned edge streams.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "ratio_engine.h"
+
+#include <math.h>
+
+RatioEngine::RatioEngine(uint16_t n_slits_A, uint16_t n_slits_B,
+                         uint16_t window, uint32_t timeout_us) {
+  _n_slits_A = n_slits_A;
+  _n_slits_B = n_slits_B;
+  _timeout_us = timeout_us;
+  _nominal = 1.f;
+  setWindow(window);
+}
+
+void RatioEngine::setWindow(uint16_t window) {
+  if (window < 1) {
+    window = 1;
+  } else if (window > MAX_WINDOW) {
+    window = MAX_WINDOW;
+  }
+  _window = window;
+  reset();
+}
+
+void RatioEngine::reset() {
+  _idx = 0;
+  _count = 0;
+  _ratio = NAN;
+}
+
+void RatioEngine::push(const RatioSample &s) {
+  if (s.n_B == 0 || s.t_A - s.t_B > _timeout_us) {
+    // Channel B is at standstill
+    reset();
+    return;
+  }
+  if (_count > 0 && s.n_A != _n_A + 1) {
+    reset(); // Samples got dropped, the window would span more edges
+  }
+  _n_A = s.n_A;
+
+  // Interpolate the position of channel B at the up-flank of channel A
+  float frac = 0.f;
+  if (s.period_B > 0) {
+    frac = (float)(s.t_A - s.t_B) / s.period_B;
+    if (frac > 1.f) {
+      frac = 1.f; // Channel B is slowing down, don't extrapolate too far
+    }
+  }
+
+  _pos_n[_idx] = s.n_B;
+  _pos_frac[_idx] = frac;
+  if (_count <= _window) {
+    _count++;
+  }
+
+  if (_count > _window) {
+    // Compare against the entry exactly one window ago
+    uint16_t old = (_idx + MAX_WINDOW + 1 - _window) % (MAX_WINDOW + 1);
+    float slits_B = (float)(s.n_B - _pos_n[old]) + frac - _pos_frac[old];
+    if (slits_B > 0) {
+      _ratio = ((float)_window / _n_slits_A) / (slits_B / _n_slits_B);
+    } else {
+      _ratio = NAN;
+    }
+  }
+
+  _idx = (_idx + 1) % (MAX_WINDOW + 1);
+}
+
+float RatioEngine::slip() const {
+  if (isnan(_ratio) || _ratio <= 0) {
+    return NAN;
+  }
+  return (1.f - _nominal / _ratio) * 100.f;
+}
@@ -0,0 +1,112 @@
+/**
+ * @file ratio_engine.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Speed ratio and slip between two tacho channels, computed from
+ * time-aligned edge streams.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef RATIO_ENGINE_H_
+#define RATIO_ENGINE_H_
+
+#include <stdint.h>
+
+/**
+ * @brief Snapshot of channel B taken at the moment of an up-flank on channel A.
+ * Taken inside the ISR of channel A, so that both channels are sampled at the
+ * exact same time.
+ */
+struct RatioSample {
+  uint32_t t_A;      // [us] Timestamp of the up-flank on channel A
+  uint32_t n_A;      // Number of up-flanks on channel A so far
+  uint32_t n_B;      // Number of up-flanks on channel B so far
+  uint32_t t_B;      // [us] Timestamp of the last up-flank on channel B
+  uint32_t period_B; // [us] Last period between up-flanks on channel B
+};
+
+/**
+ * @brief Class to compute the ratio of the rotation rates of two shafts, e.g.
+ * the gearbox ratio or belt slip, each shaft having its own encoder disk.
+ *
+ * Instead of dividing two independently averaged rates, the edges of both
+ * channels get paired by time. At every up-flank on channel A the angular
+ * position of channel B is interpolated, in units of slits, from the last
+ * edge and period of channel B. The ratio then follows from the number of
+ * revolutions of both shafts over the same window of up-flanks on channel A.
+ *
+ * Each sample costs O(1), regardless of the window length, by keeping a ring
+ * buffer of the interpolated positions of channel B. A gap in the count of
+ * channel A, i.e. samples that got dropped on the way, restarts the windowing.
+ */
+class RatioEngine {
+public:
+  static constexpr uint16_t MAX_WINDOW = 256; // Max. window in channel A edges
+
+  /**
+   * @brief Construct a new RatioEngine object.
+   *
+   * @param n_slits_A Number of slits on the encoder disk of channel A
+   * @param n_slits_B Number of slits on the encoder disk of channel B
+   * @param window Number of up-flanks on channel A to compute the ratio over
+   * @param timeout_us [us] Channel B is considered to be at standstill when no
+   * up-flank was detected for longer than this
+   */
+  RatioEngine(uint16_t n_slits_A, uint16_t n_slits_B, uint16_t window,
+              uint32_t timeout_us);
+
+  /**
+   * @brief Set the window length in up-flanks on channel A, clamped to
+   * [1, @ref MAX_WINDOW]. Restarts the windowing.
+   */
+  void setWindow(uint16_t window);
+
+  inline uint16_t getWindow() const { return _window; }
+
+  /**
+   * @brief Set the expected ratio of rev/s of A over rev/s of B, to compute
+   * the slip against.
+   */
+  inline void setNominalRatio(float ratio) { _nominal = ratio; }
+
+  inline float getNominalRatio() const { return _nominal; }
+
+  /**
+   * @brief Restart the windowing.
+   */
+  void reset();
+
+  /**
+   * @brief Process the snapshot of the next up-flank on channel A.
+   */
+  void push(const RatioSample &s);
+
+  /**
+   * @brief Return the ratio of rev/s of A over rev/s of B over the last
+   * window, or NAN when not (yet) available.
+   */
+  inline float ratio() const { return _ratio; }
+
+  /**
+   * @brief Return the slip [%] of shaft B lagging behind the nominal ratio,
+   * i.e. (1 - nominal / ratio) * 100, or NAN when not (yet) available.
+   */
+  float slip() const;
+
+private:
+  uint16_t _n_slits_A;
+  uint16_t _n_slits_B;
+  uint16_t _window;
+  uint32_t _timeout_us;
+  float _nominal;
+  float _ratio;
+
+  // Ring buffer of the interpolated positions of channel B at the up-flanks
+  // of channel A, split in whole slits and fraction to retain precision
+  uint32_t _pos_n[MAX_WINDOW + 1];
+  float _pos_frac[MAX_WINDOW + 1];
+  uint16_t _idx;   // Write position
+  uint16_t _count; // Number of valid entries
+  uint32_t _n_A;   // Count of channel A of the last sample
+};
+
+#endif
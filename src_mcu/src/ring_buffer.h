@@ -0,0 +1,91 @@
+/**
+ * @file ring_buffer.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Lock-free single-producer single-consumer ring buffer to hand over
+ * data from an interrupt service routine to `loop()`.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef RING_BUFFER_H_
+#define RING_BUFFER_H_
+
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * @brief Fixed-size ring buffer with exactly one producer and one consumer,
+ * typically an ISR pushing and `loop()` popping.
+ *
+ * The read and write indices are free-running 16-bit counters that are each
+ * only written by one side, so no interrupts have to be disabled. When the
+ * buffer is full, new items get dropped and counted.
+ *
+ * @tparam T Item type
+ * @tparam N Capacity in number of items. Must be a power of 2 and not exceed
+ * 2^^15 = 32768.
+ */
+template <typename T, uint16_t N> class RingBuffer {
+  static_assert((N & (N - 1)) == 0, "N must be a power of 2");
+  static_assert(N <= 32768, "N must not exceed 32768");
+
+public:
+  /**
+   * @brief Append an item. To be called from the producer side only.
+   *
+   * @return True when successful, false when the buffer was full and the item
+   * got dropped.
+   */
+  inline bool push(const T &item) {
+    uint16_t head = _head;
+    if ((uint16_t)(head - _tail) >= N) {
+      _dropped++;
+      return false;
+    }
+    _buf[head & (N - 1)] = item;
+    std::atomic_signal_fence(std::memory_order_release);
+    _head = head + 1;
+    return true;
+  }
+
+  /**
+   * @brief Take out the oldest item. To be called from the consumer side only.
+   *
+   * @return True when an item was popped into @p item, false when empty.
+   */
+  inline bool pop(T &item) {
+    uint16_t tail = _tail;
+    if (tail == _head) {
+      return false;
+    }
+    std::atomic_signal_fence(std::memory_order_acquire);
+    item = _buf[tail & (N - 1)];
+    std::atomic_signal_fence(std::memory_order_release);
+    _tail = tail + 1;
+    return true;
+  }
+
+  /**
+   * @brief Discard all pending items. To be called from the consumer side only.
+   */
+  inline void clear() { _tail = _head; }
+
+  /**
+   * @brief Return the number of pending items.
+   */
+  inline uint16_t size() const { return (uint16_t)(_head - _tail); }
+
+  /**
+   * @brief Return the number of items dropped because the buffer was full.
+   */
+  inline uint32_t dropped() const { return _dropped; }
+
+  static constexpr uint16_t capacity = N;
+
+private:
+  T _buf[N];
+  volatile uint16_t _head = 0;    // Write index, only written by the producer
+  volatile uint16_t _tail = 0;    // Read index, only written by the consumer
+  volatile uint32_t _dropped = 0; // Number of items dropped when full
+};
+
+#endif
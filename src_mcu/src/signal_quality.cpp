@@ -0,0 +1,133 @@
+/**
+ * @file signal_quality.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Monitoring of the per-slit duty cycle and period variance of the
+ * tacho signal, to detect signal degradation.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "signal_quality.h"
+
+#include <math.h>
+
+SignalQuality::SignalQuality(uint16_t n_slits, uint32_t timeout_us) {
+  _n_slits = (n_slits > MAX_SLITS ? MAX_SLITS : n_slits);
+  _timeout_us = timeout_us;
+  reset();
+}
+
+void SignalQuality::reset() {
+  _idx = 0;
+  _n = 0;
+  _missed = 0;
+  for (uint16_t i = 0; i < _n_slits; ++i) {
+    _duty[i] = 0.5f;
+    _norm_period[i] = 1.f;
+    _var_period[i] = 0.f;
+  }
+  restartRevolution();
+}
+
+void SignalQuality::restartRevolution() {
+  _n_rev = 0;
+  _sum_rev = 0;
+  for (uint16_t i = 0; i < _n_slits; ++i) {
+    _periods[i] = 0;
+  }
+}
+
+void SignalQuality::push(uint32_t high_us, uint32_t period_us) {
+  if (period_us == 0) {
+    return;
+  }
+  if (period_us > _timeout_us) {
+    // Coming out of standstill, the period is meaningless
+    _idx = (_idx + 1) % _n_slits;
+    restartRevolution();
+    return;
+  }
+
+  // Number of slits spanned by this period, estimated from the last
+  // revolution. A missed up-flank shows up as a period spanning several slits,
+  // a missed down-flank as a high time equal to the period.
+  uint32_t n_spanned = 1;
+  if (_n_rev >= _n_slits) {
+    n_spanned = ((uint64_t)period_us * _n_slits + _sum_rev / 2) / _sum_rev;
+    n_spanned = (n_spanned > 1 ? n_spanned : 1);
+  }
+  bool missed = (high_us >= period_us || n_spanned > 1);
+  _missed += ALPHA * ((missed ? 1.f : 0.f) - _missed);
+  if (missed) {
+    // Skip the spanned slits to stay aligned
+    _idx = (_idx + n_spanned) % _n_slits;
+    restartRevolution();
+    return;
+  }
+
+  // Running sum over the last revolution
+  _sum_rev += period_us - _periods[_idx];
+  _periods[_idx] = period_us;
+  _n++;
+  if (_n_rev < _n_slits) {
+    _n_rev++;
+  }
+
+  float a = (_n <= _n_slits ? 1.f : ALPHA); // Take the first values as is
+  float duty = (float)high_us / period_us;
+  _duty[_idx] += a * (duty - _duty[_idx]);
+
+  if (_n_rev >= _n_slits) {
+    float norm = (float)period_us * _n_slits / _sum_rev;
+    float dev = norm - _norm_period[_idx];
+    _norm_period[_idx] += ALPHA * dev;
+    _var_period[_idx] += ALPHA * (dev * dev - _var_period[_idx]);
+  }
+
+  if (++_idx >= _n_slits) {
+    _idx = 0;
+  }
+}
+
+float SignalQuality::dutyMean() const {
+  float sum = 0;
+  for (uint16_t i = 0; i < _n_slits; ++i) {
+    sum += _duty[i];
+  }
+  return sum / _n_slits;
+}
+
+float SignalQuality::dutySpread() const {
+  float mean = dutyMean();
+  float spread = 0;
+  for (uint16_t i = 0; i < _n_slits; ++i) {
+    spread = fmaxf(spread, fabsf(_duty[i] - mean));
+  }
+  return spread;
+}
+
+float SignalQuality::jitter() const {
+  float sum = 0;
+  for (uint16_t i = 0; i < _n_slits; ++i) {
+    sum += _var_period[i];
+  }
+  return sqrtf(sum / _n_slits);
+}
+
+uint8_t SignalQuality::flags() const {
+  uint8_t flags = (_missed > MISSED_MAX ? FLAG_MISSED_EDGES : 0);
+  if (_n < N_WARMUP * _n_slits) {
+    return flags;
+  }
+
+  float mean = dutyMean();
+  if (mean < DUTY_MIN || mean > DUTY_MAX) {
+    flags |= FLAG_DUTY_RANGE;
+  }
+  if (dutySpread() > SPREAD_MAX) {
+    flags |= FLAG_DUTY_SPREAD;
+  }
+  if (jitter() > JITTER_MAX) {
+    flags |= FLAG_JITTER;
+  }
+  return flags;
+}
@@ -0,0 +1,121 @@
+/**
+ * @file signal_quality.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Monitoring of the per-slit duty cycle and period variance of the
+ * tacho signal, to detect signal degradation.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef SIGNAL_QUALITY_H_
+#define SIGNAL_QUALITY_H_
+
+#include <stdint.h>
+
+/**
+ * @brief Class to keep track of the quality of the tacho signal per slit.
+ *
+ * For every slit, the duty cycle (high time over slit period) and the slit
+ * period normalized by the average period of the last revolution are fed in.
+ * Each slit keeps an exponential moving average of its duty cycle, its
+ * normalized period and the variance thereof. This costs O(1) per slit. The
+ * slits are indexed relative to the first slit seen, as the encoder disk has
+ * no index mark. When edges got missed, the index is advanced by the number of
+ * slits the period spans. The periods get normalized only once a full
+ * revolution has been seen since the start, a standstill or missed edges.
+ *
+ * Degradation gets flagged when
+ *   - the mean duty cycle over all slits leaves the expected range, e.g. by a
+ *     dying LED emitter shifting the switching threshold,
+ *   - a single slit deviates too far from the mean duty cycle, e.g. by a
+ *     half-blocked slit or a misaligned sensor,
+ *   - the slit periods vary too much, i.e. jitter,
+ *   - edges got missed, i.e. the high time reached the period or the period
+ *     spanned several slits, for more than @ref MISSED_MAX of the recent
+ *     slits. A single glitch hence raises the
+ *     flag for about one revolution only.
+ */
+class SignalQuality {
+public:
+  static constexpr uint16_t MAX_SLITS = 128;
+
+  // Bit flags, see @ref flags()
+  static constexpr uint8_t FLAG_DUTY_RANGE = 1 << 0;
+  static constexpr uint8_t FLAG_DUTY_SPREAD = 1 << 1;
+  static constexpr uint8_t FLAG_JITTER = 1 << 2;
+  static constexpr uint8_t FLAG_MISSED_EDGES = 1 << 3;
+
+  /**
+   * @brief Construct a new SignalQuality object.
+   *
+   * @param n_slits Number of slits on the encoder disk, at most
+   * @ref MAX_SLITS
+   * @param timeout_us [us] Slit periods longer than this are considered to be a
+   * standstill
+   */
+  SignalQuality(uint16_t n_slits, uint32_t timeout_us);
+
+  /**
+   * @brief Clear all statistics.
+   */
+  void reset();
+
+  /**
+   * @brief Feed in the next slit.
+   *
+   * @param high_us [us] Time the signal was high during the slit
+   * @param period_us [us] Period from this up-flank to the next up-flank
+   */
+  void push(uint32_t high_us, uint32_t period_us);
+
+  /**
+   * @brief Return the mean duty cycle over all slits [0 - 1].
+   */
+  float dutyMean() const;
+
+  /**
+   * @brief Return the largest deviation of a single slit from the mean duty
+   * cycle [0 - 1].
+   */
+  float dutySpread() const;
+
+  /**
+   * @brief Return the RMS relative deviation of the slit periods [0 - 1].
+   */
+  float jitter() const;
+
+  /**
+   * @brief Return the number of slits processed since the last reset.
+   */
+  inline uint32_t count() const { return _n; }
+
+  /**
+   * @brief Return the degradation flags, 0 when the signal is healthy or not
+   * enough slits have been processed yet.
+   */
+  uint8_t flags() const;
+
+private:
+  static constexpr float ALPHA = 1.f / 64;   // Weight of moving averages
+  static constexpr float DUTY_MIN = 0.2f;    // Expected range of the mean
+  static constexpr float DUTY_MAX = 0.8f;    // duty cycle
+  static constexpr float SPREAD_MAX = 0.1f;  // Max. single slit deviation
+  static constexpr float JITTER_MAX = 0.05f; // Max. RMS period deviation
+  static constexpr uint32_t N_WARMUP = 64;   // Revs before flagging
+  static constexpr float MISSED_MAX = 0.01f; // Max. fraction of missed edges
+
+  void restartRevolution();
+
+  uint16_t _n_slits;
+  uint32_t _timeout_us;
+  uint16_t _idx;                 // Current slit index
+  uint32_t _n;                   // Number of slits processed
+  uint16_t _n_rev;               // Slits since restarting the revolution
+  float _missed;                 // Moving average of the missed edges [0 - 1]
+  uint32_t _sum_rev;             // [us] Sum of the periods of last revolution
+  uint32_t _periods[MAX_SLITS];  // [us] Periods of the last revolution
+  float _duty[MAX_SLITS];        // Moving average of the duty cycle
+  float _norm_period[MAX_SLITS]; // Moving average of the normalized period
+  float _var_period[MAX_SLITS];  // Moving variance of the normalized period
+};
+
+#endif
@@ -0,0 +1,76 @@
+/**
+ * @file speed_alarm.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Low-latency over- and under-speed alarm output, driven directly from
+ * the up-flank ISR.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "speed_alarm.h"
+
+void SpeedAlarm::begin(uint8_t pin) {
+  _pin = pin;
+#if defined(__SAMD51__) || defined(__SAMD21__)
+  _port_set = &PORT->Group[g_APinDescription[pin].ulPort].OUTSET.reg;
+  _port_clr = &PORT->Group[g_APinDescription[pin].ulPort].OUTCLR.reg;
+  _port_mask = 1ul << g_APinDescription[pin].ulPin;
+#endif
+  pinMode(pin, OUTPUT);
+  reset();
+}
+
+void SpeedAlarm::configure(float over_revps, float under_revps,
+                           float hysteresis, uint16_t n_slits,
+                           double ticks_per_s) {
+  float hyst = 1.f + hysteresis / 100.f;
+  float ticks = (float)ticks_per_s;
+  float T_over = (over_revps > 0 ? ticks / (over_revps * n_slits) : 0);
+  float T_under = (under_revps > 0 ? ticks / (under_revps * n_slits) : 0);
+
+  noInterrupts();
+  if (T_over > 0) {
+    _T_over_trip = (uint32_t)T_over;
+    _T_over_release = (uint32_t)(T_over * hyst);
+  } else {
+    _T_over_trip = 0;
+    _T_over_release = 0;
+  }
+  if (T_under > 0) {
+    _T_under_trip = (uint32_t)T_under;
+    _T_under_release = (uint32_t)(T_under / hyst);
+  } else {
+    _T_under_trip = UINT32_MAX;
+    _T_under_release = 0;
+  }
+  interrupts();
+
+  reset();
+}
+
+void SpeedAlarm::reset() {
+  noInterrupts();
+  _tripped = false;
+  _over_active = false;
+  _under_active = false;
+  _under_armed = false;
+  write(false);
+  interrupts();
+}
+
+void SpeedAlarm::poll() {
+  noInterrupts();
+  uint32_t elapsed = micros() - _last_edge_us;
+  if (_under_armed && elapsed > _T_under_trip) {
+    // Take the moment the threshold got crossed as the reference for the
+    // latency, i.e. the polling latency gets logged
+    update(_over_active, true, elapsed, _last_edge_us + _T_under_trip);
+  }
+  interrupts();
+}
+
+SpeedAlarm::Trip SpeedAlarm::lastTrip() const {
+  noInterrupts();
+  Trip trip = _trip;
+  interrupts();
+  return trip;
+}
@@ -0,0 +1,183 @@
+/**
+ * @file speed_alarm.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Low-latency over- and under-speed alarm output, driven directly from
+ * the up-flank ISR.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef SPEED_ALARM_H_
+#define SPEED_ALARM_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief Class to drive a digital alarm output as soon as the rotation rate
+ * exceeds the over-speed threshold or drops below the under-speed threshold.
+ *
+ * The thresholds are converted once into slit periods, such that the up-flank
+ * ISR only has to compare the last slit period against them using integer
+ * arithmetic. Hence, the output trips within one slit period. Both thresholds
+ * have hysteresis. The under-speed alarm gets armed only after the rotation
+ * rate has risen above its release level once, so that a machine starting up
+ * from standstill does not trip it. A standstill, i.e. no up-flanks at all,
+ * can only be detected by polling, see @ref poll().
+ *
+ * The alarm output is active high and either resets automatically once the
+ * rotation rate is back within limits, or stays latched until @ref reset().
+ *
+ * For verification, every trip logs the latency between the up-flank that
+ * crossed the threshold and the moment the output got asserted.
+ */
+class SpeedAlarm {
+public:
+  struct Trip {
+    uint32_t stamp_us;   // [us] Time of the up-flank that tripped the alarm
+    uint32_t period_us;  // [us] Slit period that tripped the alarm
+    uint32_t latency_us; // [us] Time from up-flank to asserted output
+    bool over;           // True for over-speed, false for under-speed
+  };
+
+  /**
+   * @brief Configure the alarm output pin. The alarm is disabled until
+   * thresholds are set with @ref configure().
+   */
+  void begin(uint8_t pin);
+
+  /**
+   * @brief Set the thresholds and compute the slit periods to compare against.
+   * Resets the alarm.
+   *
+   * @param over_revps [rev/s] Over-speed threshold, 0 to disable
+   * @param under_revps [rev/s] Under-speed threshold, 0 to disable
+   * @param hysteresis [%] Relative distance between trip and release level
+   * @param n_slits Number of slits on the encoder disk
+   * @param ticks_per_s Calibrated number of `micros()` ticks per second
+   */
+  void configure(float over_revps, float under_revps, float hysteresis,
+                 uint16_t n_slits, double ticks_per_s);
+
+  /**
+   * @brief Keep the alarm asserted after a trip until @ref reset(), or else
+   * release it automatically.
+   */
+  inline void setLatching(bool state) { _latching = state; }
+
+  inline bool isLatching() const { return _latching; }
+
+  /**
+   * @brief Release the alarm output and rearm the under-speed alarm.
+   */
+  void reset();
+
+  /**
+   * @brief To be called from the up-flank ISR as early as possible.
+   *
+   * @param period_us [us] Last slit period
+   * @param stamp_us [us] Timestamp of the up-flank
+   */
+  inline void onPeriod(uint32_t period_us, uint32_t stamp_us) {
+    _last_edge_us = stamp_us;
+
+    bool over = _over_active ? (period_us < _T_over_release)
+                             : (period_us < _T_over_trip);
+    bool under = false;
+    if (_under_armed) {
+      under = _under_active ? (period_us > _T_under_release)
+                            : (period_us > _T_under_trip);
+    } else if (period_us < _T_under_release) {
+      _under_armed = true;
+    }
+
+    update(over, under, period_us, stamp_us);
+  }
+
+  /**
+   * @brief Check for an under-speed caused by the absence of up-flanks. This
+   * method should be called repeatedly from `loop()`.
+   */
+  void poll();
+
+  /**
+   * @brief Return the current state of the alarm output.
+   */
+  inline bool isTripped() const { return _tripped; }
+
+  /**
+   * @brief Return the number of trips since power up.
+   */
+  inline uint32_t tripCount() const { return _n_trips; }
+
+  /**
+   * @brief Return a consistent copy of the last trip.
+   */
+  Trip lastTrip() const;
+
+  /**
+   * @brief Return the maximum trip latency [us] since power up.
+   */
+  inline uint32_t maxLatency() const { return _latency_max; }
+
+private:
+  inline void update(bool over, bool under, uint32_t period_us,
+                     uint32_t stamp_us) {
+    _over_active = over;
+    _under_active = under;
+
+    if ((over || under) && !_tripped) {
+      write(true);
+      _tripped = true;
+      _trip.latency_us = micros() - stamp_us;
+      _trip.stamp_us = stamp_us;
+      _trip.period_us = period_us;
+      _trip.over = over;
+      if (_trip.latency_us > _latency_max) {
+        _latency_max = _trip.latency_us;
+      }
+      _n_trips++;
+
+    } else if (!over && !under && _tripped && !_latching) {
+      write(false);
+      _tripped = false;
+    }
+  }
+
+  inline void write(bool state) {
+#if defined(__SAMD51__) || defined(__SAMD21__)
+    // Direct port access, bypassing the overhead of `digitalWrite()`
+    if (state) {
+      *_port_set = _port_mask;
+    } else {
+      *_port_clr = _port_mask;
+    }
+#else
+    digitalWrite(_pin, state);
+#endif
+  }
+
+  uint8_t _pin;
+#if defined(__SAMD51__) || defined(__SAMD21__)
+  volatile uint32_t *_port_set;
+  volatile uint32_t *_port_clr;
+  uint32_t _port_mask;
+#endif
+
+  // Thresholds as slit periods [us]. 0 and UINT32_MAX respectively disable.
+  volatile uint32_t _T_over_trip = 0;
+  volatile uint32_t _T_over_release = 0;
+  volatile uint32_t _T_under_trip = UINT32_MAX;
+  volatile uint32_t _T_under_release = 0;
+
+  volatile bool _latching = false;
+  volatile bool _tripped = false;
+  volatile bool _over_active = false;
+  volatile bool _under_active = false;
+  volatile bool _under_armed = false;
+  volatile uint32_t _last_edge_us = 0;
+
+  volatile uint32_t _n_trips = 0;
+  volatile uint32_t _latency_max = 0;
+  Trip _trip = {0, 0, 0, false};
+};
+
+#endif
@@ -0,0 +1,65 @@
+/**
+ * @file speed_dac.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Analog speed output via the DAC, driven directly from the up-flank
+ * ISR.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "speed_dac.h"
+
+SpeedDAC::SpeedDAC(uint16_t n_slits, uint32_t timeout_us) {
+  _n_slits = n_slits;
+  _timeout_us = timeout_us;
+}
+
+void SpeedDAC::begin(uint8_t pin) {
+  _pin = pin;
+  _channel = (pin == A0 ? 0 : 1);
+
+  // Let the Arduino core enable the DAC and configure the pin
+  analogWriteResolution(12);
+  analogWrite(pin, 0);
+  _value = 0;
+}
+
+void SpeedDAC::configure(float full_scale_revps, uint32_t interval_us,
+                         double ticks_per_s) {
+  noInterrupts();
+  _full_scale_revps = full_scale_revps;
+  if (full_scale_revps > 0) {
+    // Clipped to 32 bits, i.e. a full scale of at least ~1 / `_n_slits` rev/s
+    double K = ticks_per_s * DAC_MAX / (_n_slits * (double)full_scale_revps);
+    _K = (uint32_t)min(K, (double)UINT32_MAX);
+  } else {
+    _K = 0;
+  }
+  _interval_us = interval_us;
+  _sum_T = 0;
+  _n_T = 0;
+  interrupts();
+}
+
+void SpeedDAC::enable(bool state) {
+  noInterrupts();
+  _enabled = state;
+  _sum_T = 0;
+  _n_T = 0;
+  _last_update_us = micros();
+  _last_edge_us = _last_update_us;
+  write(0, _last_update_us);
+  interrupts();
+}
+
+void SpeedDAC::poll() {
+  noInterrupts();
+  if (_enabled && _value > 0) {
+    uint32_t now = micros();
+    if (now - _last_edge_us > _timeout_us) {
+      write(0, now);
+      _sum_T = 0;
+      _n_T = 0;
+    }
+  }
+  interrupts();
+}
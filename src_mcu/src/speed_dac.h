@@ -0,0 +1,175 @@
+/**
+ * @file speed_dac.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Analog speed output via the DAC, driven directly from the up-flank
+ * ISR.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef SPEED_DAC_H_
+#define SPEED_DAC_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief Class to output the rotation rate as an analog voltage on the DAC,
+ * scaled linearly from 0 V at standstill to 3.3 V at the full-scale rotation
+ * rate.
+ *
+ * The up-flank ISR accumulates the slit periods and, once the update interval
+ * has passed, writes the rotation rate averaged over all slits since the last
+ * update to the DAC. This involves a single 32-bit division and does not
+ * depend on `loop()`, so the latency is deterministic and the output keeps
+ * updating while `loop()` is busy with the display or serial port. Only a
+ * standstill has to be detected by polling, see @ref poll().
+ *
+ * When not compiled for the SAMD51, the DAC writes get handed to a
+ * user-supplied function instead, e.g. to record them.
+ */
+class SpeedDAC {
+public:
+  static constexpr uint16_t DAC_MAX = 4095; // 12-bit DAC
+
+  /**
+   * @brief Construct a new SpeedDAC object.
+   *
+   * @param n_slits Number of slits on the encoder disk
+   * @param timeout_us [us] Slit periods longer than this are considered to be a
+   * standstill
+   */
+  SpeedDAC(uint16_t n_slits, uint32_t timeout_us);
+
+  /**
+   * @brief Configure the DAC on pin @p pin, i.e. A0 or A1, and output 0 V.
+   */
+  void begin(uint8_t pin);
+
+  /**
+   * @brief Set the rotation rate corresponding to the maximum output voltage,
+   * and the minimum interval between DAC updates.
+   *
+   * @param full_scale_revps [rev/s] Full-scale rotation rate
+   * @param interval_us [us] Update interval, 0 to update on every up-flank
+   * @param ticks_per_s Calibrated number of `micros()` ticks per second
+   */
+  void configure(float full_scale_revps, uint32_t interval_us,
+                 double ticks_per_s);
+
+  /**
+   * @brief Start or stop updating the DAC. Outputs 0 V when stopped.
+   */
+  void enable(bool state);
+
+  inline bool isEnabled() const { return _enabled; }
+
+  inline float getFullScale() const { return _full_scale_revps; }
+
+  inline uint32_t getInterval() const { return _interval_us; }
+
+  /**
+   * @brief Return the last value written to the DAC.
+   */
+  inline uint16_t getValue() const { return _value; }
+
+  /**
+   * @brief To be called from the up-flank ISR.
+   *
+   * @param period_us [us] Last slit period
+   * @param stamp_us [us] Timestamp of the up-flank
+   */
+  inline void onPeriod(uint32_t period_us, uint32_t stamp_us) {
+    if (!_enabled) {
+      return;
+    }
+    _last_edge_us = stamp_us;
+    if (period_us > _timeout_us) {
+      // Coming out of standstill, the period is meaningless
+      _sum_T = 0;
+      _n_T = 0;
+      _last_update_us = stamp_us;
+      return;
+    }
+
+    _sum_T += period_us;
+    _n_T++;
+    if (_sum_T > 0 && stamp_us - _last_update_us >= _interval_us) {
+      write(average(), stamp_us);
+      _sum_T = 0;
+      _n_T = 0;
+      _last_update_us = stamp_us;
+    }
+  }
+
+  /**
+   * @brief Output 0 V once no up-flanks have been detected for longer than the
+   * timeout. This method should be called repeatedly from `loop()`.
+   */
+  void poll();
+
+#if !defined(__SAMD51__)
+  /**
+   * @brief Install the simulated DAC, receiving every value written together
+   * with the timestamp of the up-flank that caused it.
+   */
+  inline void setSimulatedDAC(void (*dac)(uint16_t value, uint32_t stamp_us)) {
+    _sim_dac = dac;
+  }
+#endif
+
+private:
+  inline uint16_t average() const {
+    // DAC value = _K * _n_T / _sum_T, clipped to DAC_MAX. The product takes a
+    // single 32x32 to 64-bit multiply. When it exceeds 32 bits, numerator and
+    // denominator get shifted right together so that a 32-bit division, which
+    // is a single instruction on the Cortex-M4, suffices. The shift is at most
+    // 12 bits as the unclipped value is below 2^12, leaving at least 8
+    // significant bits in the denominator.
+    uint64_t num = (uint64_t)_K * _n_T;
+    uint32_t den = _sum_T;
+    if (num >= (uint64_t)(DAC_MAX + 1) * den) {
+      return DAC_MAX;
+    }
+    uint32_t num_hi = (uint32_t)(num >> 32);
+    if (num_hi) {
+      uint8_t shift = 32 - __builtin_clz(num_hi);
+      num >>= shift;
+      den >>= shift;
+    }
+    return (uint16_t)((uint32_t)num / den);
+  }
+
+  inline void write(uint16_t value, uint32_t stamp_us) {
+    _value = value;
+#if defined(__SAMD51__)
+    (void)stamp_us;
+    while (DAC->SYNCBUSY.reg & (_channel ? DAC_SYNCBUSY_DATA1
+                                         : DAC_SYNCBUSY_DATA0)) {}
+    DAC->DATA[_channel].reg = value;
+#else
+    if (_sim_dac) {
+      _sim_dac(value, stamp_us);
+    }
+#endif
+  }
+
+  uint16_t _n_slits;
+  uint32_t _timeout_us;
+  uint8_t _pin = A0;
+  uint8_t _channel = 0;        // DAC channel, 0 for A0 and 1 for A1
+  float _full_scale_revps = 0; // [rev/s]
+  uint32_t _K = 0;             // DAC value = _K / average slit period [us]
+
+  volatile bool _enabled = false;
+  volatile uint32_t _interval_us = 0;
+  volatile uint32_t _sum_T = 0; // [us] Sum of the slit periods since update
+  volatile uint32_t _n_T = 0;   // Number of slit periods since update
+  volatile uint32_t _last_update_us = 0;
+  volatile uint32_t _last_edge_us = 0;
+  volatile uint16_t _value = 0;
+
+#if !defined(__SAMD51__)
+  void (*_sim_dac)(uint16_t value, uint32_t stamp_us) = nullptr;
+#endif
+};
+
+#endif
@@ -0,0 +1,75 @@
+/**
+ * @file speed_pid.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief PID speed controller with feed-forward, anti-windup and setpoint
+ * ramping.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "speed_pid.h"
+
+SpeedPID::SpeedPID(float dt, float out_min, float out_max) {
+  _dt = dt;
+  _out_min = out_min;
+  _out_max = out_max;
+  _out = out_min;
+}
+
+void SpeedPID::setGains(float kp, float ki, float kd) {
+  _kp = kp;
+  _ki = ki;
+  _kd = kd;
+}
+
+void SpeedPID::setFeedForward(float kff, float ff_offset) {
+  _kff = kff;
+  _ff_offset = ff_offset;
+}
+
+void SpeedPID::reset(float revps) {
+  _sp_ramped = revps;
+  _integral = 0;
+  _prev = revps;
+  _out = _out_min;
+}
+
+float SpeedPID::update(float revps) {
+  // Ramp the setpoint
+  if (_ramp_rate > 0) {
+    float step = _ramp_rate * _dt;
+    if (_sp > _sp_ramped + step) {
+      _sp_ramped += step;
+    } else if (_sp < _sp_ramped - step) {
+      _sp_ramped -= step;
+    } else {
+      _sp_ramped = _sp;
+    }
+  } else {
+    _sp_ramped = _sp;
+  }
+
+  float error = _sp_ramped - revps;
+  float ff = _kff * _sp_ramped + _ff_offset;
+  float p = _kp * error;
+  float d = -_kd * (revps - _prev) / _dt;
+  float i = _integral + _ki * error * _dt;
+  _prev = revps;
+
+  float out = ff + p + i + d;
+  if (out > _out_max) {
+    out = _out_max;
+    if (error < 0) {
+      _integral = i; // Helps to get out of saturation
+    }
+  } else if (out < _out_min) {
+    out = _out_min;
+    if (error > 0) {
+      _integral = i;
+    }
+  } else {
+    _integral = i;
+  }
+
+  _out = out;
+  return out;
+}
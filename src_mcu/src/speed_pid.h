@@ -0,0 +1,107 @@
+/**
+ * @file speed_pid.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief PID speed controller with feed-forward, anti-windup and setpoint
+ * ramping.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef SPEED_PID_H_
+#define SPEED_PID_H_
+
+#include <stdint.h>
+
+/**
+ * @brief Class implementing a discrete PID controller for the rotation rate,
+ * to be executed at a fixed rate.
+ *
+ * Output = feed-forward + P + I + D, clamped to [out_min, out_max], where
+ *   - feed-forward = kff * setpoint + ff_offset,
+ *   - P = kp * error,
+ *   - I = ki * sum of error * dt,
+ *   - D = -kd * d(measurement)/dt, i.e. on the measurement to prevent a kick
+ *     on setpoint changes.
+ *
+ * Anti-windup is implemented by conditional integration: The integral is
+ * frozen while the output is saturated and the error would drive it further
+ * into saturation. The setpoint can be ramped at a maximum rate to prevent
+ * large steps.
+ *
+ * This class has no hardware dependencies, so that the loop can be simulated
+ * on a host PC against a model of the motor.
+ */
+class SpeedPID {
+public:
+  /**
+   * @brief Construct a new SpeedPID object.
+   *
+   * @param dt [s] Fixed interval between calls to @ref update()
+   * @param out_min Minimum output, e.g. 0 for a PWM duty cycle
+   * @param out_max Maximum output, e.g. 4095 for a 12-bit PWM duty cycle
+   */
+  SpeedPID(float dt, float out_min, float out_max);
+
+  void setGains(float kp, float ki, float kd);
+  void setFeedForward(float kff, float ff_offset);
+
+  /**
+   * @brief Set the target rotation rate [rev/s].
+   */
+  inline void setSetpoint(float sp) { _sp = sp; }
+
+  /**
+   * @brief Set the maximum rate of change of the setpoint [rev/s^2], 0 to
+   * apply setpoint changes immediately.
+   */
+  inline void setRampRate(float rate) { _ramp_rate = rate; }
+
+  inline float getKp() const { return _kp; }
+  inline float getKi() const { return _ki; }
+  inline float getKd() const { return _kd; }
+  inline float getKff() const { return _kff; }
+  inline float getSetpoint() const { return _sp; }
+  inline float getRampRate() const { return _ramp_rate; }
+
+  /**
+   * @brief Return the ramped setpoint as used during the last update.
+   */
+  inline float getRampedSetpoint() const { return _sp_ramped; }
+
+  /**
+   * @brief Return the last computed output.
+   */
+  inline float getOutput() const { return _out; }
+
+  /**
+   * @brief Clear the integral and derivative state and start ramping from
+   * rotation rate @p revps.
+   */
+  void reset(float revps = 0);
+
+  /**
+   * @brief Execute one control step.
+   *
+   * @param revps [rev/s] Measured rotation rate
+   * @return The new output
+   */
+  float update(float revps);
+
+private:
+  float _dt;
+  float _out_min;
+  float _out_max;
+  float _kp = 0;
+  float _ki = 0;
+  float _kd = 0;
+  float _kff = 0;
+  float _ff_offset = 0;
+  float _ramp_rate = 0; // [rev/s^2]
+
+  float _sp = 0;        // [rev/s] Target setpoint
+  float _sp_ramped = 0; // [rev/s] Ramped setpoint
+  float _integral = 0;  // Integral term, in output units
+  float _prev = 0;      // [rev/s] Previous measurement
+  float _out = 0;
+};
+
+#endif
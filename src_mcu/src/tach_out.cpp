@@ -0,0 +1,206 @@
+/**
+ * @file tach_out.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Re-emission of the measured rotation rate as a clean square wave with
+ * a configurable number of pulses per revolution.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "tach_out.h"
+
+#if defined(__SAMD51__)
+#  include "wiring_private.h"
+
+static const uint8_t TCC_GCLK_IDS[] = {TCC0_GCLK_ID, TCC1_GCLK_ID,
+                                       TCC2_GCLK_ID, TCC3_GCLK_ID,
+                                       TCC4_GCLK_ID};
+#endif
+
+static uint16_t gcd(uint16_t a, uint16_t b) {
+  while (b != 0) {
+    uint16_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+TachOut::TachOut(uint16_t n_slits, uint32_t timeout_us) {
+  _n_slits = n_slits;
+  _timeout_us = timeout_us;
+  _per_max = 0xFFFF;
+}
+
+bool TachOut::begin(uint8_t pin) {
+#if defined(__SAMD51__)
+  // Connect the pin to its TCC timer, like `analogWrite()` would do
+  const PinDescription &desc = g_APinDescription[pin];
+  uint32_t tcc_num = GetTCNumber(desc.ulPWMChannel);
+  if (tcc_num >= TCC_INST_NUM) {
+    return false;
+  }
+  if (desc.ulPinAttribute & PIN_ATTR_PWM_E) {
+    pinPeripheral(pin, PIO_TIMER);
+  } else if (desc.ulPinAttribute & PIN_ATTR_PWM_F) {
+    pinPeripheral(pin, PIO_TIMER_ALT);
+  } else if (desc.ulPinAttribute & PIN_ATTR_PWM_G) {
+    pinPeripheral(pin, PIO_TCC_PDEC);
+  } else {
+    return false;
+  }
+  GCLK->PCHCTRL[TCC_GCLK_IDS[tcc_num]].reg =
+      GCLK_PCHCTRL_GEN_GCLK0 | GCLK_PCHCTRL_CHEN;
+  while (!(GCLK->PCHCTRL[TCC_GCLK_IDS[tcc_num]].reg & GCLK_PCHCTRL_CHEN)) {}
+
+  _tcc = (Tcc *)GetTC(desc.ulPWMChannel);
+  _ch = GetTCChannelNumber(desc.ulPWMChannel);
+  _per_max = (tcc_num <= 1 ? 0xFFFFFF : 0xFFFF); // TCC0 and TCC1 are 24-bit
+
+  // Normal PWM, output high while the count is below the compare value
+  _tcc->CTRLA.bit.ENABLE = 0;
+  while (_tcc->SYNCBUSY.bit.ENABLE) {}
+  _tcc->CTRLA.reg = TCC_CTRLA_PRESCALER_DIV16 | TCC_CTRLA_PRESCSYNC_PRESC;
+  _tcc->WAVE.reg = TCC_WAVE_WAVEGEN_NPWM;
+  while (_tcc->SYNCBUSY.bit.WAVE) {}
+  _tcc->PER.reg = _per_max;
+  while (_tcc->SYNCBUSY.bit.PER) {}
+  _tcc->CC[_ch].reg = 0;
+  while (_tcc->SYNCBUSY.reg & (TCC_SYNCBUSY_CC0 << _ch)) {}
+  _tcc->CTRLA.bit.ENABLE = 1;
+  while (_tcc->SYNCBUSY.bit.ENABLE) {}
+#else
+  (void)pin;
+  _per_max = 0xFFFFFF;
+#endif
+
+  stop();
+  return true;
+}
+
+void TachOut::setPulsesPerRev(uint16_t n) {
+  noInterrupts();
+  _ppr = n;
+  if (n > 0) {
+    uint16_t g = gcd(_n_slits, n);
+    _group_slits = _n_slits / g;
+    _group_pulses = n / g;
+  }
+  _sum_T = 0;
+  _n_T = 0;
+  _T_avg = 0;
+  _n_rejected = 0;
+  stop();
+  interrupts();
+}
+
+float TachOut::frequency(double ticks_per_s) const {
+  if (!_running || _per == 0) {
+    return 0.f;
+  }
+  return (float)(F_TIMER * (ticks_per_s / 1e6) / (_per + 1));
+}
+
+float TachOut::minFrequency(double ticks_per_s) const {
+  return (float)(F_TIMER * (ticks_per_s / 1e6) / ((double)_per_max + 1));
+}
+
+void TachOut::poll() {
+  noInterrupts();
+  if (_running && (_ppr == 0 || micros() - _last_edge_us > _timeout_us)) {
+    stop();
+    _T_avg = 0;
+    _n_rejected = 0;
+  }
+  interrupts();
+}
+
+void TachOut::update(uint32_t per) {
+  // The timer counts from 0 up to and including `per`
+  per = (per > 2 ? per - 1 : 1);
+  if (per > _per_max) {
+    per = _per_max;
+    _n_clipped++;
+  }
+
+  if (!_running) {
+    write(per, true);
+    _per = per;
+    _running = true;
+    _locked = false;
+    return;
+  }
+
+  if (_group_pulses == 1) {
+    // The output pulse should start at the end of the group. A count just
+    // past 0 means the output leads, a count just below the period means it
+    // lags.
+    uint32_t count = readCount();
+    int32_t err = (count < _per / 2 ? (int32_t)count
+                                    : (int32_t)count - (int32_t)(_per + 1));
+    int32_t corr = err / 4;
+    int32_t corr_max = (int32_t)(per / 8);
+    corr = (corr > corr_max ? corr_max : (corr < -corr_max ? -corr_max : corr));
+    _locked = ((uint32_t)abs(err) < per / 32);
+    _per = per;
+    write(per + corr, false);
+
+  } else {
+    _locked = false;
+    _per = per;
+    write(per, false);
+  }
+}
+
+void TachOut::stop() {
+  _running = false;
+  _locked = false;
+  _per = 0;
+#if defined(__SAMD51__)
+  if (_tcc) {
+    _tcc->CC[_ch].reg = 0;
+    while (_tcc->SYNCBUSY.reg & (TCC_SYNCBUSY_CC0 << _ch)) {}
+  }
+#else
+  if (_sim.write) {
+    _sim.write(_per_max, 0, true);
+  }
+#endif
+}
+
+uint32_t TachOut::readCount() {
+#if defined(__SAMD51__)
+  if (!_tcc) {
+    return 0;
+  }
+  _tcc->CTRLBSET.reg = TCC_CTRLBSET_CMD_READSYNC;
+  while (_tcc->SYNCBUSY.bit.CTRLB) {}
+  while (_tcc->SYNCBUSY.bit.COUNT) {}
+  return _tcc->COUNT.reg;
+#else
+  return (_sim.count ? _sim.count() : 0);
+#endif
+}
+
+void TachOut::write(uint32_t per, bool restart) {
+#if defined(__SAMD51__)
+  if (!_tcc) {
+    return; // `begin()` failed
+  }
+  if (restart) {
+    _tcc->PER.reg = per;
+    while (_tcc->SYNCBUSY.bit.PER) {}
+    _tcc->CC[_ch].reg = per / 2 + 1;
+    while (_tcc->SYNCBUSY.reg & (TCC_SYNCBUSY_CC0 << _ch)) {}
+    _tcc->CTRLBSET.reg = TCC_CTRLBSET_CMD_RETRIGGER;
+    while (_tcc->SYNCBUSY.bit.CTRLB) {}
+  } else {
+    // Buffered, taking effect at the next overflow
+    _tcc->PERBUF.reg = per;
+    _tcc->CCBUF[_ch].reg = per / 2 + 1;
+  }
+#else
+  if (_sim.write) {
+    _sim.write(per, per / 2 + 1, restart);
+  }
+#endif
+}
@@ -0,0 +1,214 @@
+/**
+ * @file tach_out.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Re-emission of the measured rotation rate as a clean square wave with
+ * a configurable number of pulses per revolution.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef TACH_OUT_H_
+#define TACH_OUT_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief Class to regenerate a tacho signal of N pulses per revolution on a
+ * PWM pin, e.g. for legacy controllers expecting 1 pulse per revolution.
+ *
+ * The square wave is generated by a TCC timer in normal PWM mode at 50% duty
+ * cycle, so there is no CPU involvement per output pulse. The slits get
+ * grouped such that each group of @ref slitsPerGroup() slits spans exactly an
+ * integer number of output pulses. At the end of every group, the up-flank ISR
+ * sets the timer period to the average slit period of that group. The period
+ * is written to the buffered period register, which the timer only applies at
+ * its next overflow, so the output never glitches.
+ *
+ * When a group spans exactly one output pulse, e.g. 1 pulse per revolution
+ * with 24 slits, the output gets phase-locked to the slits: The timer count at
+ * the end of the group is the phase error, of which a fraction is added to the
+ * next period.
+ *
+ * Slit periods deviating more than a factor of 2 from the running average are
+ * considered to be glitches, e.g. caused by electrical noise, and are ignored.
+ * After @ref N_RESYNC such periods in a row, the speed is taken to have
+ * changed instead, and the average starts over.
+ *
+ * When not compiled for the SAMD51, the timer writes get handed to a
+ * user-supplied function instead, e.g. to record them.
+ */
+class TachOut {
+public:
+#if defined(__SAMD51__)
+  static constexpr uint32_t F_TIMER = F_CPU / 16; // [Hz] Timer clock, DIV16
+#else
+  static constexpr uint32_t F_TIMER = 7500000; // [Hz] Simulated timer clock
+#endif
+
+  // Number of consecutive deviating slit periods taken as a change of speed
+  static constexpr uint8_t N_RESYNC = 4;
+
+  /**
+   * @brief Construct a new TachOut object.
+   *
+   * @param n_slits Number of slits on the encoder disk
+   * @param timeout_us [us] Slit periods longer than this are considered to be a
+   * standstill
+   */
+  TachOut(uint16_t n_slits, uint32_t timeout_us);
+
+  /**
+   * @brief Configure the TCC timer driving pin @p pin and keep the output low.
+   *
+   * @return True when successful, false when @p pin is not connected to a TCC
+   * timer, in which case the output stays disabled.
+   */
+  bool begin(uint8_t pin);
+
+  /**
+   * @brief Set the number of output pulses per revolution, 0 to disable.
+   */
+  void setPulsesPerRev(uint16_t n);
+
+  inline uint16_t getPulsesPerRev() const { return _ppr; }
+
+  /**
+   * @brief Return the number of slits per update of the output period.
+   */
+  inline uint16_t slitsPerGroup() const { return _group_slits; }
+
+  /**
+   * @brief Return true when the output is phase-locked to the slits.
+   */
+  inline bool isLocked() const { return _locked; }
+
+  /**
+   * @brief Return the number of slit periods ignored as glitches.
+   */
+  inline uint32_t glitchCount() const { return _n_glitches; }
+
+  /**
+   * @brief Return the number of output periods that got clipped to the
+   * longest period the timer can hold, i.e. the output ran faster than
+   * requested.
+   */
+  inline uint32_t clippedCount() const { return _n_clipped; }
+
+  /**
+   * @brief Return the lowest output frequency [Hz] the timer can reach. The
+   * 24-bit TCC0 and TCC1 reach down to 0.45 Hz, the 16-bit TCC2 to TCC4 only
+   * to 114 Hz.
+   *
+   * @param ticks_per_s Calibrated number of `micros()` ticks per second
+   */
+  float minFrequency(double ticks_per_s) const;
+
+  /**
+   * @brief Return the current output frequency [Hz], 0 when stopped.
+   *
+   * The output period itself needs no calibration, as the timer and
+   * `micros()` run off the same crystal. Only its conversion to Hz does.
+   *
+   * @param ticks_per_s Calibrated number of `micros()` ticks per second
+   */
+  float frequency(double ticks_per_s) const;
+
+  /**
+   * @brief To be called from the up-flank ISR.
+   *
+   * @param period_us [us] Last slit period
+   * @param stamp_us [us] Timestamp of the up-flank
+   */
+  inline void onPeriod(uint32_t period_us, uint32_t stamp_us) {
+    if (_ppr == 0) {
+      return;
+    }
+    _last_edge_us = stamp_us;
+    if (period_us > _timeout_us) {
+      // Coming out of standstill, the period is meaningless
+      _sum_T = 0;
+      _n_T = 0;
+      _T_avg = 0;
+      _n_rejected = 0;
+      return;
+    }
+
+    if (_T_avg > 0 && (period_us < _T_avg / 2 || period_us > _T_avg * 2)) {
+      if (++_n_rejected < N_RESYNC) {
+        _n_glitches++;
+        return;
+      }
+      // Not a glitch but a change of speed: Start over from this period
+      _n_glitches -= N_RESYNC - 1;
+      _sum_T = 0;
+      _n_T = 0;
+      _T_avg = 0;
+    }
+    _n_rejected = 0;
+
+    _sum_T += period_us;
+    if (++_n_T < _group_slits) {
+      return;
+    }
+
+    // End of a group: Set the period of the next output pulses. The nominal
+    // ratio of timer ticks per `micros()` tick is exact, as both run off the
+    // same crystal, so no timebase calibration is needed here.
+    _T_avg = _sum_T / _n_T;
+    uint32_t per = (uint32_t)((uint64_t)_sum_T * F_TIMER /
+                              (1000000ULL * _group_pulses));
+    _sum_T = 0;
+    _n_T = 0;
+    update(per);
+  }
+
+  /**
+   * @brief Stop the output once no up-flanks have been detected for longer
+   * than the timeout. This method should be called repeatedly from `loop()`.
+   */
+  void poll();
+
+#if !defined(__SAMD51__)
+  /**
+   * @brief Install the simulated timer, returning its count when read and
+   * receiving every period and compare value written.
+   */
+  struct SimTimer {
+    uint32_t (*count)();
+    void (*write)(uint32_t per, uint32_t cc, bool restart);
+  };
+  inline void setSimulatedTimer(SimTimer timer) { _sim = timer; }
+#endif
+
+private:
+  void update(uint32_t per);
+  void stop();
+  uint32_t readCount();
+  void write(uint32_t per, bool restart);
+
+  uint16_t _n_slits;
+  uint32_t _timeout_us;
+  uint32_t _per_max; // Maximum period the timer can hold
+
+  volatile uint16_t _ppr = 0;          // Output pulses per revolution
+  volatile uint16_t _group_slits = 1;  // Slits per group
+  volatile uint16_t _group_pulses = 1; // Output pulses per group
+  volatile bool _running = false;
+  volatile bool _locked = false;
+  volatile uint32_t _per = 0;     // Nominal period of the running output
+  volatile uint32_t _sum_T = 0;   // [us] Sum of the slit periods in group
+  volatile uint16_t _n_T = 0;     // Number of slit periods in group
+  volatile uint32_t _T_avg = 0;   // [us] Average slit period of last group
+  volatile uint32_t _n_glitches = 0;
+  volatile uint32_t _n_clipped = 0; // Periods clipped to `_per_max`
+  volatile uint8_t _n_rejected = 0; // Consecutive periods ignored as glitches
+  volatile uint32_t _last_edge_us = 0;
+
+#if defined(__SAMD51__)
+  Tcc *_tcc = nullptr;
+  uint8_t _ch = 0;
+#else
+  SimTimer _sim = {nullptr, nullptr};
+#endif
+};
+
+#endif
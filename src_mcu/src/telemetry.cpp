@@ -0,0 +1,138 @@
+/**
+ * @file telemetry.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Publish/subscribe telemetry channels, emitted over serial at the
+ * subscribed rates by a scheduler in `loop()`.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "telemetry.h"
+#include "micros64.h"
+
+Telemetry::Telemetry(const Channel *channels, uint8_t n_channels) {
+  _channels = channels;
+  _n_channels = (n_channels < MAX_CHANNELS) ? n_channels : MAX_CHANNELS;
+  unsubscribeAll();
+}
+
+int8_t Telemetry::find(const char *name) const {
+  for (uint8_t idx = 0; idx < _n_channels; ++idx) {
+    if (strcmp(_channels[idx].name, name) == 0) {
+      return idx;
+    }
+  }
+  return -1;
+}
+
+bool Telemetry::subscribe(const char *name, float rate_hz) {
+  int8_t idx = find(name);
+  if (idx < 0 || !(rate_hz >= 0)) {
+    return false;
+  }
+  if (rate_hz == 0) {
+    _interval[idx] = 0;
+    return true;
+  }
+
+  uint32_t interval = MIN_INTERVAL;
+  if (rate_hz < 1e6f / MIN_INTERVAL) {
+    interval = (uint32_t)min(1e6f / rate_hz + .5f, 4e9f);
+  }
+  _interval[idx] = interval;
+  _next[idx] = (micros64() / interval + 1) * interval; // Next multiple
+  _emitted[idx] = 0;
+  _skipped[idx] = 0;
+  _max_late[idx] = 0;
+  return true;
+}
+
+void Telemetry::unsubscribeAll() {
+  for (uint8_t idx = 0; idx < MAX_CHANNELS; ++idx) {
+    _interval[idx] = 0;
+    _next[idx] = 0;
+    _emitted[idx] = 0;
+    _skipped[idx] = 0;
+    _max_late[idx] = 0;
+  }
+}
+
+bool Telemetry::isSubscribed(const char *name) const {
+  int8_t idx = find(name);
+  return (idx >= 0 && _interval[idx] > 0);
+}
+
+void Telemetry::poll(TxQueue &out) {
+  uint64_t now = micros64();
+
+  // Collect the channels that are due and schedule their next sample
+  uint16_t due = 0;
+  uint32_t late_us[MAX_CHANNELS];
+  for (uint8_t idx = 0; idx < _n_channels; ++idx) {
+    uint32_t interval = _interval[idx];
+    if (interval == 0 || now < _next[idx]) {
+      continue;
+    }
+    uint64_t late = now - _next[idx];
+    uint32_t n_missed = (uint32_t)(late / interval);
+    late -= (uint64_t)n_missed * interval; // Relative to the latest multiple
+    _next[idx] += (uint64_t)(n_missed + 1) * interval;
+    _skipped[idx] += n_missed;
+    late_us[idx] = (uint32_t)late;
+    due |= 1 << idx;
+  }
+  if (due == 0) {
+    return;
+  }
+
+  // Format the due channels once, into a single line. The room gets checked
+  // for the whole line up front. A line that does not fit after all gets
+  // dropped whole by the queue.
+  bool sent = (out.availableForWrite() >= MIN_ROOM);
+  if (sent) {
+    CommandTable::Arg arg;
+    arg.b = false;
+    arg.i = 0;
+    arg.f = 0;
+    out.beginLine();
+    out.print('$');
+    out.print((unsigned long long)now);
+    out.joinLines(true);
+    for (uint8_t idx = 0; idx < _n_channels; ++idx) {
+      if (due & (1 << idx)) {
+        out.print(';');
+        out.print(_channels[idx].name);
+        out.print('\t');
+        _channels[idx].handler(arg);
+      }
+    }
+    out.joinLines(false);
+    out.println();
+    sent = out.endLine();
+  }
+
+  for (uint8_t idx = 0; idx < _n_channels; ++idx) {
+    if (!(due & (1 << idx))) {
+      continue;
+    }
+    if (sent) {
+      _emitted[idx]++;
+      _max_late[idx] = max(_max_late[idx], late_us[idx]);
+    } else {
+      _skipped[idx]++;
+    }
+  }
+}
+
+void Telemetry::list(Print &out) const {
+  for (uint8_t idx = 0; idx < _n_channels; ++idx) {
+    out.print(_channels[idx].name);
+    out.print('\t');
+    out.print(_interval[idx] ? 1e6 / _interval[idx] : 0., 3);
+    out.print('\t');
+    out.print(_emitted[idx]);
+    out.print('\t');
+    out.print(_skipped[idx]);
+    out.print('\t');
+    out.println(_max_late[idx]);
+  }
+}
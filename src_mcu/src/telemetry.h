@@ -0,0 +1,111 @@
+/**
+ * @file telemetry.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Publish/subscribe telemetry channels, emitted over serial at the
+ * subscribed rates by a scheduler in `loop()`.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <Arduino.h>
+
+#include "command_table.h"
+#include "tx_queue.h"
+
+/**
+ * @brief Class to emit named telemetry channels, each at its own subscribed
+ * rate.
+ *
+ * A channel gets formatted by a query command handler, so that a channel
+ * reads exactly like the reply to that query. All channels that are due in
+ * the same call to @ref poll() share a single line with a single timestamp:
+ *
+ *   `$<time>;<name>\t<reply>;<name>\t<reply>`
+ *
+ * with `<time>` the device time [us] of `micros64()` and `<reply>` the
+ * handler output without its line ending.
+ *
+ * The sample times of a channel are the multiples of its interval in device
+ * time. They do not drift with the loop timing, and channels with
+ * commensurate rates fall due together, e.g. every 10th sample at 10 Hz
+ * shares its line with the 1 Hz sample. A sample that is due gets emitted on
+ * the first call to @ref poll() after its time, so that its jitter is bounded
+ * by the duration of one `loop()` iteration. Samples that are late by a full
+ * interval or more, e.g. after a blocking flash erase, are skipped instead of
+ * emitted in a burst. So are the samples of a line that does not fit in the
+ * transmit queue, so that a line is never cut short. The room is checked for
+ * the whole line at once, against @ref MIN_ROOM, and a longer line gets
+ * dropped whole by the queue, see @ref TxQueue::endLine().
+ */
+class Telemetry {
+public:
+  static constexpr uint8_t MAX_CHANNELS = 16;
+  static constexpr uint32_t MIN_INTERVAL = 1000; // [us] Highest rate 1 kHz
+  static constexpr uint16_t MIN_ROOM = 1024;     // [bytes] About longest line
+
+  /**
+   * @brief Entry of the channel table.
+   */
+  struct Channel {
+    const char *name;              // Channel name
+    CommandTable::Handler handler; // Query command that formats the channel
+  };
+
+  /**
+   * @brief Construct a new Telemetry object, with no channel subscribed.
+   *
+   * @param channels Table of channels, which must outlive this object. Only
+   * the first @ref MAX_CHANNELS entries are used.
+   * @param n_channels Number of entries in @p channels
+   */
+  Telemetry(const Channel *channels, uint8_t n_channels);
+
+  /**
+   * @brief Subscribe to a channel at the given rate [Hz], or unsubscribe when
+   * the rate is 0. Rates above 1 kHz are capped.
+   *
+   * @return False when there is no channel called @p name or the rate is
+   * negative, true otherwise
+   */
+  bool subscribe(const char *name, float rate_hz);
+
+  /**
+   * @brief Unsubscribe from all channels.
+   */
+  void unsubscribeAll();
+
+  /**
+   * @brief Return whether the channel is subscribed to.
+   */
+  bool isSubscribed(const char *name) const;
+
+  /**
+   * @brief Emit the channels that are due. This method should be called
+   * repeatedly from `loop()`.
+   *
+   * @param out Transmit queue that the channel handlers print to
+   */
+  void poll(TxQueue &out);
+
+  /**
+   * @brief Print all channels in table order, one per line as the name, the
+   * subscribed rate [Hz], number of samples emitted, number of samples
+   * skipped and the largest lateness of an emitted sample [us], tab-delimited.
+   */
+  void list(Print &out) const;
+
+private:
+  int8_t find(const char *name) const;
+
+  const Channel *_channels;
+  uint8_t _n_channels;
+  uint32_t _interval[MAX_CHANNELS]; // [us] Sample interval, 0 when off
+  uint64_t _next[MAX_CHANNELS];     // [us] Device time of the next sample
+  uint32_t _emitted[MAX_CHANNELS];  // Number of samples emitted
+  uint32_t _skipped[MAX_CHANNELS];  // Number of samples skipped
+  uint32_t _max_late[MAX_CHANNELS]; // [us] Largest lateness when emitted
+};
+
+#endif
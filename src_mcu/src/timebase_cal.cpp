@@ -0,0 +1,94 @@
+/**
+ * @file timebase_cal.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Calibration of the `micros()` timebase against an external reference
+ * frequency or 1-PPS signal.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "timebase_cal.h"
+
+TimebaseCal::TimebaseCal(uint8_t flash_block) : _store(flash_block) {}
+
+void TimebaseCal::begin() {
+  Stored stored;
+  if (_store.read(&stored, sizeof(stored)) && !isnan(stored.ppm) &&
+      fabs(stored.ppm) <= MAX_PPM) {
+    _stored = stored;
+  }
+  _ticks_per_s = 1e6 * (1 + _stored.ppm * 1e-6);
+}
+
+void TimebaseCal::start(double ref_hz) {
+  noInterrupts();
+  _running = false;
+  _gate_open = false;
+  _gates.clear();
+  interrupts();
+
+  _ref_hz = ref_hz;
+  _sum_cycles = 0;
+  _sum_us = 0;
+  _n_gates = 0;
+  _n_rejected = 0;
+  _mean = 0;
+  _m2 = 0;
+  _running = true;
+}
+
+void TimebaseCal::stop() {
+  _running = false;
+  poll();
+}
+
+void TimebaseCal::poll() {
+  Gate gate;
+  while (_gates.pop(gate)) {
+    double ppm = (_ref_hz * gate.dt_us / (1e6 * gate.n_cycles) - 1) * 1e6;
+    if (fabs(ppm) > MAX_PPM) {
+      _n_rejected++;
+      continue;
+    }
+    _sum_cycles += gate.n_cycles;
+    _sum_us += gate.dt_us;
+
+    // Welford's running variance
+    _n_gates++;
+    double delta = ppm - _mean;
+    _mean += delta / _n_gates;
+    _m2 += delta * (ppm - _mean);
+  }
+}
+
+double TimebaseCal::measuredPPM() const {
+  if (_n_gates == 0) {
+    return NAN;
+  }
+  // From the totals rather than the mean of the gates, as the contiguous gates
+  // let the timestamp errors at the gate boundaries cancel out
+  return (_ref_hz * _sum_us / (1e6 * _sum_cycles) - 1) * 1e6;
+}
+
+double TimebaseCal::measuredUncertainty() const {
+  if (_n_gates < 2) {
+    return NAN;
+  }
+  double se = sqrt(_m2 / (_n_gates - 1) / _n_gates);
+  double resolution = 1e6 / _sum_us;
+  return sqrt(se * se + resolution * resolution);
+}
+
+bool TimebaseCal::apply() {
+  if (_n_gates < 2) {
+    return false;
+  }
+  return store(measuredPPM(), measuredUncertainty());
+}
+
+bool TimebaseCal::clear() { return store(0, 0); }
+
+bool TimebaseCal::store(float ppm, float uncertainty) {
+  _stored = {ppm, uncertainty};
+  _ticks_per_s = 1e6 * (1 + ppm * 1e-6);
+  return _store.write(&_stored, sizeof(_stored));
+}
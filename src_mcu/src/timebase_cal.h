@@ -0,0 +1,178 @@
+/**
+ * @file timebase_cal.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Calibration of the `micros()` timebase against an external reference
+ * frequency or 1-PPS signal.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef TIMEBASE_CAL_H_
+#define TIMEBASE_CAL_H_
+
+#include <Arduino.h>
+
+#include "flash_store.h"
+#include "ring_buffer.h"
+
+/**
+ * @brief Class to measure and apply the frequency error of `micros()`, caused
+ * by the tolerance of the crystal of the microcontroller, in parts per million.
+ *
+ * While measuring, the up-flanks of a reference signal of known frequency are
+ * timestamped by an ISR, e.g. the 1-PPS output of a GPS receiver or a signal
+ * generator up to some tens of kHz. The up-flanks are grouped into contiguous
+ * gates of at least @ref GATE_US. Each gate gives an estimate of the
+ * frequency error, of which the mean and the standard error are tracked.
+ * Gates that deviate more than @ref MAX_PPM, e.g. due to a missing or
+ * glitching reference, are rejected.
+ *
+ * The applied correction is stored persistently in flash and is folded into a
+ * single constant, @ref ticksPerSecond(), which replaces the nominal 1e6
+ * `micros()` ticks per second in the period-to-frequency conversions. Hence,
+ * the correction comes at no cost per sample.
+ */
+class TimebaseCal {
+public:
+  static constexpr uint32_t GATE_US = 1000000; // [us] Minimum gate time
+  static constexpr double MAX_PPM = 1000;      // [ppm] Reject gates beyond
+
+  /**
+   * @brief Construct a new TimebaseCal object.
+   *
+   * @param flash_block Flash block to store the correction in, see
+   * @ref FlashStore
+   */
+  TimebaseCal(uint8_t flash_block);
+
+  /**
+   * @brief Load the stored correction from flash, if any.
+   */
+  void begin();
+
+  /**
+   * @brief Start measuring, discarding any previous measurement.
+   *
+   * @param ref_hz [Hz] Frequency of the reference signal, 1 for a 1-PPS signal
+   */
+  void start(double ref_hz);
+
+  /**
+   * @brief Stop measuring. The measured correction is kept.
+   */
+  void stop();
+
+  inline bool isRunning() const { return _running; }
+
+  /**
+   * @brief To be called from the ISR of the reference input.
+   *
+   * @param stamp_us [us] Timestamp of the up-flank of the reference
+   */
+  inline void onEdge(uint32_t stamp_us) {
+    if (!_running) {
+      return;
+    }
+    if (!_gate_open) {
+      _gate_start_us = stamp_us;
+      _n_cycles = 0;
+      _gate_open = true;
+      return;
+    }
+    _n_cycles++;
+    uint32_t dt = stamp_us - _gate_start_us;
+    if (dt >= GATE_US) {
+      _gates.push({_n_cycles, dt});
+      _gate_start_us = stamp_us; // Next gate starts at this very up-flank
+      _n_cycles = 0;
+    }
+  }
+
+  /**
+   * @brief Process the completed gates. This method should be called
+   * repeatedly from `loop()`.
+   */
+  void poll();
+
+  /**
+   * @brief Return the number of accepted and rejected gates of the current
+   * measurement.
+   */
+  inline uint32_t gateCount() const { return _n_gates; }
+  inline uint32_t rejectCount() const { return _n_rejected; }
+
+  /**
+   * @brief Return the measured frequency error of `micros()` [ppm], positive
+   * when it runs fast. NAN when no gate has been accepted yet.
+   */
+  double measuredPPM() const;
+
+  /**
+   * @brief Return the 1-sigma uncertainty of @ref measuredPPM() [ppm],
+   * combining the standard error of the gates and the 1 us resolution of
+   * `micros()` over the full measurement. NAN when less than two gates have
+   * been accepted.
+   */
+  double measuredUncertainty() const;
+
+  /**
+   * @brief Apply the measured correction and store it in flash.
+   *
+   * @return True when successful, false when less than two gates have been
+   * accepted or the flash write failed
+   */
+  bool apply();
+
+  /**
+   * @brief Revert to the nominal timebase, i.e. 0 ppm, and store it in flash.
+   *
+   * @return True when successful
+   */
+  bool clear();
+
+  /**
+   * @brief Return the applied correction [ppm] and its uncertainty [ppm].
+   */
+  inline float getPPM() const { return _stored.ppm; }
+  inline float getUncertainty() const { return _stored.uncertainty; }
+
+  /**
+   * @brief Return the corrected number of `micros()` ticks per true second.
+   */
+  inline double ticksPerSecond() const { return _ticks_per_s; }
+
+private:
+  struct Gate {
+    uint32_t n_cycles; // Number of reference cycles
+    uint32_t dt_us;    // [us] Duration
+  };
+
+  // Record as stored in flash
+  struct Stored {
+    float ppm;
+    float uncertainty;
+  };
+
+  bool store(float ppm, float uncertainty);
+
+  FlashStore _store;
+  Stored _stored = {0, 0};
+  double _ticks_per_s = 1e6;
+
+  // Written by the ISR
+  volatile bool _running = false;
+  volatile bool _gate_open = false;
+  volatile uint32_t _gate_start_us = 0;
+  volatile uint32_t _n_cycles = 0;
+  RingBuffer<Gate, 8> _gates;
+
+  // Measurement, processed in `loop()`
+  double _ref_hz = 1;
+  uint64_t _sum_cycles = 0; // Total reference cycles of the accepted gates
+  uint64_t _sum_us = 0;     // [us] Total duration of the accepted gates
+  uint32_t _n_gates = 0;
+  uint32_t _n_rejected = 0;
+  double _mean = 0; // [ppm] Running mean of the gates
+  double _m2 = 0;   // [ppm^2] Running sum of squared deviations
+};
+
+#endif
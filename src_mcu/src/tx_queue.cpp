@@ -0,0 +1,117 @@
+/**
+ * @file tx_queue.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Non-blocking transmit queue in front of a stream, drained from
+ * `loop()`.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "tx_queue.h"
+
+static_assert((TxQueue::SIZE & (TxQueue::SIZE - 1)) == 0,
+              "SIZE must be a power of 2");
+
+TxQueue::TxQueue(Print &out, POLICY policy) : _out(out) {
+  _policy = policy;
+}
+
+size_t TxQueue::write(uint8_t byte) { return write(&byte, 1); }
+
+size_t TxQueue::write(const uint8_t *buf, size_t len) {
+  if (!_join_lines) {
+    return store(buf, len);
+  }
+
+  // Store the runs in between the line endings
+  size_t n_stored = 0;
+  size_t start = 0;
+  for (size_t i = 0; i <= len; ++i) {
+    if (i == len || buf[i] == '\r' || buf[i] == '\n') {
+      if (i > start) {
+        n_stored += store(buf + start, i - start);
+      }
+      n_stored += (i < len); // Left out on purpose, so count as written
+      start = i + 1;
+    }
+  }
+  return n_stored;
+}
+
+size_t TxQueue::store(const uint8_t *buf, size_t len) {
+  size_t free = SIZE - depth();
+  if (len > free) {
+    if (_policy == POLICY::DROP_NEWEST) {
+      _dropped += len;
+      return 0;
+    }
+    if (len > SIZE) {
+      // Only the last part fits at all
+      _dropped += len - SIZE;
+      buf += len - SIZE;
+      len = SIZE;
+    }
+    _dropped += len - free;
+    _tail += (uint16_t)(len - free);
+  }
+
+  // Copy in at most two parts, around the end of the ring
+  uint16_t idx = _head & (SIZE - 1);
+  size_t n = min(len, (size_t)(SIZE - idx));
+  memcpy(&_buf[idx], buf, n);
+  memcpy(&_buf[0], buf + n, len - n);
+  _head += (uint16_t)len;
+  _peak = max(_peak, depth());
+  return len;
+}
+
+int TxQueue::availableForWrite() { return SIZE - depth(); }
+
+void TxQueue::beginLine() {
+  _line_head = _head;
+  _line_dropped = _dropped;
+}
+
+bool TxQueue::endLine() {
+  if (_policy != POLICY::DROP_NEWEST || _dropped == _line_dropped) {
+    return true;
+  }
+
+  // Take back the stored part, unless handed over already by `flush()`
+  uint16_t n = _head - _line_head;
+  if (n <= depth()) {
+    _dropped += n;
+    _head = _line_head;
+  }
+  return false;
+}
+
+void TxQueue::poll() {
+  size_t budget = POLL_MAX;
+  while (depth() > 0 && budget > 0) {
+    int room = _out.availableForWrite();
+    if (room <= 0) {
+      return;
+    }
+    uint16_t idx = _tail & (SIZE - 1);
+    size_t n = min((size_t)depth(), (size_t)(SIZE - idx));
+    n = min(n, min((size_t)room, budget));
+    n = _out.write(&_buf[idx], n);
+    if (n == 0) {
+      return;
+    }
+    _tail += (uint16_t)n;
+    budget -= n;
+  }
+}
+
+void TxQueue::flush() {
+  while (depth() > 0) {
+    uint16_t idx = _tail & (SIZE - 1);
+    size_t n = min((size_t)depth(), (size_t)(SIZE - idx));
+    n = _out.write(&_buf[idx], n);
+    if (n == 0) {
+      return; // Stream closed
+    }
+    _tail += (uint16_t)n;
+  }
+}
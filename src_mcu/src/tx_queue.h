@@ -0,0 +1,128 @@
+/**
+ * @file tx_queue.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Non-blocking transmit queue in front of a stream, drained from
+ * `loop()`.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef TX_QUEUE_H_
+#define TX_QUEUE_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief Class to buffer all output to a stream, such as Serial, in a
+ * fixed-size byte ring, so that printing never waits for the host to read.
+ *
+ * Print to this object like to Serial. @ref poll() hands over as many queued
+ * bytes as the stream can take without blocking, as reported by its
+ * `availableForWrite()`, and at most @ref POLL_MAX bytes. The cap matters for
+ * the native USB serial port of the SAMD core, which reports a constant room
+ * of one packet whether or not the host reads, and whose `write()` waits for
+ * the host. Each call hence waits for at most one packet. When the queue is
+ * full, the overflow policy decides:
+ *   - DROP_NEWEST: Each `write()` call is stored in full or dropped in full,
+ *     so binary frames that are written in one call stay intact. Text written
+ *     in several calls, e.g. by `println()`, is kept whole by enclosing it in
+ *     @ref beginLine() and @ref endLine().
+ *   - DROP_OLDEST: The oldest queued bytes make room, so that the latest
+ *     output always gets through.
+ *
+ * Dropped bytes are counted. Producers of binary frames should check
+ * @ref availableForWrite() for the full frame first.
+ *
+ * To combine several text replies into a single line, line endings can be
+ * left out temporarily, see @ref joinLines().
+ */
+class TxQueue : public Print {
+public:
+  static constexpr uint16_t SIZE = 4096;   // [bytes] Capacity, power of 2
+  static constexpr uint16_t POLL_MAX = 64; // [bytes] Per @ref poll(), 1 packet
+
+  enum class POLICY : uint8_t {
+    DROP_NEWEST, // Drop the bytes that do not fit
+    DROP_OLDEST  // Discard the oldest bytes to make room
+  };
+
+  /**
+   * @brief Construct a new TxQueue object.
+   *
+   * @param out Stream to drain the queue into, e.g. Serial
+   * @param policy What to do when the queue is full
+   */
+  TxQueue(Print &out, POLICY policy = POLICY::DROP_NEWEST);
+
+  size_t write(uint8_t byte) override;
+  size_t write(const uint8_t *buf, size_t len) override;
+  using Print::write;
+
+  /**
+   * @brief Return the free space in the queue [bytes].
+   */
+  int availableForWrite() override;
+
+  /**
+   * @brief Hand over queued bytes to the stream, as many as it takes without
+   * blocking and at most @ref POLL_MAX. This method should be called
+   * repeatedly from `loop()`.
+   */
+  void poll();
+
+  /**
+   * @brief Block until the queue has been handed over to the stream in full,
+   * e.g. before writing to the stream directly.
+   */
+  void flush();
+
+  /**
+   * @brief Start a reply line, or several, that is to be stored whole or not
+   * at all, see @ref endLine().
+   */
+  void beginLine();
+
+  /**
+   * @brief End the reply started by @ref beginLine(). When part of it got
+   * dropped under DROP_NEWEST, the part that got stored is taken back as well.
+   *
+   * @return True when the reply was stored whole, false when dropped.
+   */
+  bool endLine();
+
+  /**
+   * @brief Leave out all carriage return and line feed characters written
+   * from now on, or stop doing so.
+   */
+  inline void joinLines(bool state) { _join_lines = state; }
+
+  inline void setPolicy(POLICY policy) { _policy = policy; }
+  inline POLICY getPolicy() const { return _policy; }
+
+  /**
+   * @brief Return the number of queued bytes and the highest number since
+   * start-up.
+   */
+  inline uint16_t depth() const { return (uint16_t)(_head - _tail); }
+  inline uint16_t peakDepth() const { return _peak; }
+
+  /**
+   * @brief Return the number of bytes dropped since start-up.
+   */
+  inline uint32_t dropped() const { return _dropped; }
+
+private:
+  size_t store(const uint8_t *buf, size_t len);
+
+  Print &_out;
+  POLICY _policy;
+  bool _join_lines = false;
+  uint8_t _buf[SIZE];
+  uint16_t _head = 0; // Write index, free-running
+  uint16_t _tail = 0; // Read index, free-running
+  uint16_t _peak = 0;
+  uint32_t _dropped = 0;
+  uint16_t _line_head = 0;    // Write index at @ref beginLine()
+  uint32_t _line_dropped = 0; // Bytes dropped before @ref beginLine()
+};
+
+#endif
@@ -0,0 +1,48 @@
+/**
+ * @file varint.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Unsigned LEB128 varints and zigzag encoding, shared by the edge
+ * codec and the data logger.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef VARINT_H_
+#define VARINT_H_
+
+#include <stdint.h>
+
+// Maximum number of bytes of a 32-bit varint
+static constexpr uint8_t VARINT_MAX_LEN = 5;
+
+/**
+ * @brief Write @p value as an unsigned LEB128 varint, 7 bits per byte, least
+ * significant first.
+ *
+ * @param buf Output, at least @ref VARINT_MAX_LEN bytes of room
+ * @return The number of bytes written
+ */
+inline uint8_t put_varint(uint8_t *buf, uint32_t value) {
+  uint8_t n = 0;
+  while (value >= 0x80) {
+    buf[n++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  buf[n++] = (uint8_t)value;
+  return n;
+}
+
+/**
+ * @brief Map signed to unsigned, small magnitudes to small values.
+ */
+inline uint32_t zigzag(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+/**
+ * @brief Inverse of @ref zigzag().
+ */
+inline int32_t unzigzag(uint32_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+#endif
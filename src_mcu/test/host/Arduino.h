@@ -0,0 +1,193 @@
+/**
+ * @file Arduino.h
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Minimal host implementation of the Arduino API, so that the firmware
+ * modules and their tests build and run natively, see `[env:native]` in
+ * `platformio.ini`.
+ * @copyright MIT License. See the LICENSE file for details.
+ *
+ * Time only advances when a test says so, through @ref host::micros_now or
+ * `delay()`. Pin writes are recorded in @ref host::pin_value. Interrupts are
+ * never taken, so disabling them does nothing.
+ */
+
+#ifndef ARDUINO_HOST_H_
+#define ARDUINO_HOST_H_
+
+#include <algorithm>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+using std::max;
+using std::min;
+
+#define PI 3.1415926535897932384626433832795
+#define TWO_PI 6.283185307179586476925286766559
+
+#define DEC 10
+#define HEX 16
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define INPUT_PULLDOWN 3
+#define RISING 4
+#define FALLING 5
+#define CHANGE 6
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+
+#define SERIAL_8N1 0x0400
+#define SERIAL_8E1 0x0422
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+namespace host {
+inline uint32_t micros_now = 0; // [us] Simulated `micros()`
+inline int pin_value[64] = {};  // Last value written per pin
+} // namespace host
+
+inline uint32_t micros() { return host::micros_now; }
+inline uint32_t millis() { return host::micros_now / 1000; }
+inline void delay(uint32_t ms) { host::micros_now += ms * 1000; }
+inline void delayMicroseconds(uint32_t us) { host::micros_now += us; }
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t pin, uint8_t val) {
+  host::pin_value[pin & 63] = val;
+}
+inline int digitalRead(uint8_t pin) { return host::pin_value[pin & 63]; }
+inline void analogWrite(uint8_t pin, int val) {
+  host::pin_value[pin & 63] = val;
+}
+inline int analogRead(uint8_t pin) { return host::pin_value[pin & 63]; }
+inline void analogWriteResolution(int) {}
+inline void analogReadResolution(int) {}
+
+inline int digitalPinToInterrupt(int pin) { return pin; }
+inline void attachInterrupt(int, void (*)(), int) {}
+inline void detachInterrupt(int) {}
+inline void noInterrupts() {}
+inline void interrupts() {}
+inline void __disable_irq() {}
+inline void __enable_irq() {}
+
+class Print {
+public:
+  virtual ~Print() = default;
+  virtual size_t write(uint8_t byte) = 0;
+  virtual size_t write(const uint8_t *buf, size_t len) {
+    size_t n = 0;
+    while (n < len && write(buf[n])) {
+      n++;
+    }
+    return n;
+  }
+  size_t write(const char *str) {
+    return write((const uint8_t *)str, strlen(str));
+  }
+  virtual int availableForWrite() { return 0; }
+  virtual void flush() {}
+
+  size_t print(const char *str) { return write(str); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v, int base = DEC) { return print((long long)v, base); }
+  size_t print(unsigned int v, int base = DEC) {
+    return print((unsigned long long)v, base);
+  }
+  size_t print(long v, int base = DEC) { return print((long long)v, base); }
+  size_t print(unsigned long v, int base = DEC) {
+    return print((unsigned long long)v, base);
+  }
+  size_t print(long long v, int base = DEC) {
+    return format(base == HEX ? "%llX" : "%lld", v);
+  }
+  size_t print(unsigned long long v, int base = DEC) {
+    return format(base == HEX ? "%llX" : "%llu", v);
+  }
+  size_t print(double v, int digits = 2) { return format("%.*f", digits, v); }
+
+  size_t println() { return write("\r\n"); }
+  template <typename T> size_t println(T v) { return print(v) + println(); }
+  template <typename T> size_t println(T v, int arg) {
+    return print(v, arg) + println();
+  }
+
+private:
+  template <typename... Args> size_t format(const char *fmt, Args... args) {
+    char buf[48];
+    int n = snprintf(buf, sizeof(buf), fmt, args...);
+    return write((const uint8_t *)buf, min(n, (int)sizeof(buf) - 1));
+  }
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  void setTimeout(unsigned long) {}
+  size_t readBytes(char *buf, size_t len) {
+    size_t n = 0;
+    for (int c; n < len && (c = read()) >= 0; ++n) {
+      buf[n] = (char)c;
+    }
+    return n;
+  }
+  size_t readBytes(uint8_t *buf, size_t len) {
+    return readBytes((char *)buf, len);
+  }
+};
+
+/**
+ * @brief Serial port that keeps its output in @ref tx and serves its input
+ * from @ref rx.
+ */
+class HostSerial : public Stream {
+public:
+  std::string tx; // Bytes written
+  std::string rx; // Bytes to be read
+  size_t rx_pos = 0;
+
+  void begin(unsigned long) {}
+  void begin(unsigned long, uint16_t) {}
+  operator bool() const { return true; }
+
+  size_t write(uint8_t byte) override {
+    tx += (char)byte;
+    return 1;
+  }
+  size_t write(const uint8_t *buf, size_t len) override {
+    tx.append((const char *)buf, len);
+    return len;
+  }
+  using Print::write;
+  int availableForWrite() override { return 4096; }
+
+  int available() override { return (int)(rx.size() - rx_pos); }
+  int read() override {
+    return (rx_pos < rx.size() ? (uint8_t)rx[rx_pos++] : -1);
+  }
+  int peek() override {
+    return (rx_pos < rx.size() ? (uint8_t)rx[rx_pos] : -1);
+  }
+};
+
+inline HostSerial Serial;
+inline HostSerial Serial1;
+
+#endif
@@ -0,0 +1,182 @@
+/**
+ * @file test_main.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Host test of the angle-synchronous sampler, with the ADC simulated by
+ * a function of the edge timestamp.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <vector>
+
+#include "angle_sampler.h"
+
+static const uint16_t N_BUF = AngleSampler::N_BUF;
+
+static AngleSampler sampler;
+static uint32_t stamp_us = 0; // [us] Timestamp of the last edge
+
+static uint16_t sim_adc(uint32_t stamp) { return (stamp / 10) & 0x0FFF; }
+
+/**
+ * @brief Output stream with a limited room to write in.
+ */
+class Sink : public HostSerial {
+public:
+  int room = 4096;
+  int availableForWrite() override { return room; }
+};
+
+struct Frame {
+  std::vector<uint32_t> stamps;
+  std::vector<uint16_t> samples;
+};
+
+/**
+ * @brief Parse all frames in @p bytes, checking their headers.
+ */
+static std::vector<Frame> parse(const std::string &bytes) {
+  std::vector<Frame> frames;
+  size_t i = 0;
+  while (i < bytes.size()) {
+    TEST_ASSERT_TRUE(i + 4 <= bytes.size());
+    TEST_ASSERT_EQUAL(0xA5, (uint8_t)bytes[i]);
+    TEST_ASSERT_EQUAL(0x5A, (uint8_t)bytes[i + 1]);
+    uint16_t n;
+    memcpy(&n, &bytes[i + 2], 2);
+    i += 4;
+    TEST_ASSERT_TRUE(i + n * 6 <= bytes.size());
+
+    Frame frame;
+    frame.stamps.resize(n);
+    frame.samples.resize(n);
+    memcpy(frame.stamps.data(), &bytes[i], n * 4);
+    memcpy(frame.samples.data(), &bytes[i + n * 4], n * 2);
+    i += n * 6;
+    frames.push_back(frame);
+  }
+  return frames;
+}
+
+static void edges(uint32_t n) {
+  for (uint32_t i = 0; i < n; ++i) {
+    stamp_us += 1234;
+    sampler.onEdge(stamp_us);
+  }
+}
+
+void setUp() {
+  stamp_us = 0;
+  sampler.setSimulatedADC(sim_adc);
+  TEST_ASSERT_TRUE(sampler.begin(A1));
+  sampler.setDivider(1);
+  sampler.enable(true);
+}
+
+void tearDown() { sampler.enable(false); }
+
+void test_disabled_ignores_edges() {
+  sampler.enable(false);
+  edges(10);
+  TEST_ASSERT_EQUAL(0, sampler.available());
+
+  sampler.enable(true);
+  edges(10);
+  TEST_ASSERT_EQUAL(10, sampler.available());
+  sampler.enable(true); // Clears the ring buffers
+  TEST_ASSERT_EQUAL(0, sampler.available());
+}
+
+void test_divider() {
+  sampler.setDivider(3);
+  edges(10);
+  TEST_ASSERT_EQUAL(3, sampler.available());
+
+  Sink out;
+  TEST_ASSERT_EQUAL(3, sampler.stream(out));
+  std::vector<Frame> frames = parse(out.tx);
+  TEST_ASSERT_EQUAL(1, frames.size());
+  for (uint32_t i = 0; i < 3; ++i) {
+    uint32_t stamp = 1234 * 3 * (i + 1); // Every 3rd edge
+    TEST_ASSERT_EQUAL(stamp, frames[0].stamps[i]);
+    TEST_ASSERT_EQUAL(sim_adc(stamp), frames[0].samples[i]);
+  }
+
+  // Changing the divider restarts the count
+  edges(1);
+  sampler.setDivider(2);
+  edges(1);
+  TEST_ASSERT_EQUAL(0, sampler.available());
+  edges(1);
+  TEST_ASSERT_EQUAL(1, sampler.available());
+
+  sampler.setDivider(0);
+  TEST_ASSERT_EQUAL(1, sampler.getDivider());
+}
+
+void test_drops_when_full() {
+  edges(N_BUF + 44);
+  TEST_ASSERT_EQUAL(N_BUF, sampler.available());
+  TEST_ASSERT_EQUAL(44, sampler.dropped());
+
+  // The dropped edges are the newest ones, the buffer keeps the oldest
+  Sink out;
+  TEST_ASSERT_EQUAL(N_BUF, sampler.stream(out));
+  std::vector<Frame> frames = parse(out.tx);
+  TEST_ASSERT_EQUAL(1234, frames[0].stamps[0]);
+  TEST_ASSERT_EQUAL(1234 * N_BUF, frames[0].stamps[N_BUF - 1]);
+
+  // Sampling resumes once streamed
+  edges(1);
+  TEST_ASSERT_EQUAL(1, sampler.available());
+  TEST_ASSERT_EQUAL(44, sampler.dropped());
+}
+
+void test_frame_split_at_the_end_of_the_ring() {
+  Sink out;
+  edges(200);
+  TEST_ASSERT_EQUAL(200, sampler.stream(out));
+
+  // The next 100 samples wrap around the end of the ring buffers
+  out.tx.clear();
+  edges(100);
+  TEST_ASSERT_EQUAL(N_BUF - 200, sampler.stream(out));
+  TEST_ASSERT_EQUAL(100 - (N_BUF - 200), sampler.stream(out));
+  TEST_ASSERT_EQUAL(0, sampler.stream(out));
+
+  std::vector<Frame> frames = parse(out.tx);
+  TEST_ASSERT_EQUAL(2, frames.size());
+  std::vector<uint32_t> stamps = frames[0].stamps;
+  stamps.insert(stamps.end(), frames[1].stamps.begin(),
+                frames[1].stamps.end());
+  TEST_ASSERT_EQUAL(100, stamps.size());
+  for (uint32_t i = 0; i < 100; ++i) {
+    TEST_ASSERT_EQUAL(1234 * (201 + i), stamps[i]);
+  }
+}
+
+void test_frame_limited_by_the_room_to_write() {
+  Sink out;
+  edges(50);
+
+  out.room = 4 + 5; // Not even one sample fits
+  TEST_ASSERT_EQUAL(0, sampler.stream(out));
+  TEST_ASSERT_EQUAL(0, out.tx.size());
+
+  out.room = 4 + 6 * 10 + 5;
+  TEST_ASSERT_EQUAL(10, sampler.stream(out));
+  TEST_ASSERT_EQUAL(4 + 6 * 10, out.tx.size());
+  TEST_ASSERT_EQUAL(40, sampler.available());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_disabled_ignores_edges);
+  RUN_TEST(test_divider);
+  RUN_TEST(test_drops_when_full);
+  RUN_TEST(test_frame_split_at_the_end_of_the_ring);
+  RUN_TEST(test_frame_limited_by_the_room_to_write);
+  return UNITY_END();
+}
@@ -0,0 +1,172 @@
+/**
+ * @file test_main.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Host benchmark of the edge timestamp codec: compression ratio and
+ * time per edge of the encoder and decoder.
+ * @copyright MIT License. See the LICENSE file for details.
+ *
+ * Runs on synthetic traces and, when the environment variable `EDGE_TRACE`
+ * points to one, on a recorded trace. A recorded trace is the binary reply of
+ * the `cb` command of the curve recorder, taken with decimation 1. Run with
+ * `pio test -e native -f test_bench_edge_codec -v` to see the results.
+ *
+ * The time per edge is measured on the host. On x86 the time stamp counter is
+ * read as well, to give a rough number of cycles per edge.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <chrono>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <x86intrin.h>
+#endif
+
+#include "edge_codec.h"
+
+static const uint32_t N_REPEAT = 20; // Timing runs, the fastest one counts
+
+struct Trace {
+  const char *name;
+  uint16_t n_slits;
+  std::vector<uint32_t> stamps;
+};
+
+static uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static double seconds() {
+  using namespace std::chrono;
+  return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Synthetic trace of @p n edges of a disk with @p n_slits slits, 2%
+ * unevenly spaced, with a jitter of +/- @p jitter_us. The rotation rate goes
+ * from @p revps_0 to @p revps_1 linearly.
+ */
+static Trace synthetic(const char *name, uint32_t n, uint16_t n_slits,
+                       float revps_0, float revps_1, int jitter_us) {
+  Trace trace = {name, n_slits, {}};
+  double t = 1000;
+  srand(1);
+  for (uint32_t i = 0; i < n; ++i) {
+    trace.stamps.push_back((uint32_t)llround(t));
+    double revps = revps_0 + (revps_1 - revps_0) * i / n;
+    double spacing = 1. + (n_slits > 1 ? 0.02 * sin(i % n_slits) : 0);
+    int jitter = rand() % (2 * jitter_us + 1) - jitter_us;
+    t += 1e6 / (revps * n_slits) * spacing + jitter;
+  }
+  return trace;
+}
+
+/**
+ * @brief Load the recording of the curve recorder from @p path, see the `cb`
+ * command.
+ */
+static bool recorded(const char *path, Trace &trace) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return false;
+  }
+  uint8_t header[14];
+  bool ok = (fread(header, 1, sizeof(header), f) == sizeof(header) &&
+             header[0] == 'C' && header[1] == 'R');
+  uint32_t n = 0;
+  uint16_t decimation = 0;
+  uint32_t stamp = 0;
+  if (ok) {
+    memcpy(&n, &header[2], 4);
+    memcpy(&decimation, &header[6], 2);
+    memcpy(&trace.n_slits, &header[8], 2);
+    memcpy(&stamp, &header[10], 4);
+    ok = (decimation == 1);
+  }
+  trace.name = "recorded";
+  trace.stamps.clear();
+  for (uint32_t i = 0; ok && i < n; ++i) {
+    uint32_t period;
+    ok = (fread(&period, 1, 4, f) == 4);
+    stamp += period;
+    trace.stamps.push_back(stamp);
+  }
+  fclose(f);
+  return ok && n > 0;
+}
+
+static void bench(const Trace &trace) {
+  std::vector<uint8_t> bytes(trace.stamps.size() * EdgeEncoder::MAX_TOKEN);
+  std::vector<uint32_t> decoded(trace.stamps.size());
+  size_t n_bytes = 0;
+  size_t n_decoded = 0;
+  double t_enc = 1e9, t_dec = 1e9;
+  uint64_t c_enc = UINT64_MAX, c_dec = UINT64_MAX;
+
+  for (uint32_t run = 0; run < N_REPEAT; ++run) {
+    EdgeEncoder enc(trace.n_slits);
+    double t = seconds();
+    uint64_t c = cycles();
+    n_bytes = 0;
+    for (uint32_t stamp : trace.stamps) {
+      n_bytes += enc.encode(stamp, &bytes[n_bytes]);
+    }
+    c_enc = min(c_enc, cycles() - c);
+    t_enc = min(t_enc, seconds() - t);
+
+    EdgeDecoder dec(trace.n_slits);
+    t = seconds();
+    c = cycles();
+    n_decoded = 0;
+    for (size_t i = 0; i < n_bytes; ++i) {
+      n_decoded += dec.push(bytes[i], decoded[n_decoded]);
+    }
+    c_dec = min(c_dec, cycles() - c);
+    t_dec = min(t_dec, seconds() - t);
+  }
+
+  TEST_ASSERT_EQUAL(trace.stamps.size(), n_decoded);
+  TEST_ASSERT_TRUE(trace.stamps == decoded);
+
+  double n = trace.stamps.size();
+  printf("%-12s %4u slits %7u edges: %5.3f bytes/edge, ratio %4.2f, "
+         "encode %5.1f ns/edge %6.1f cycles/edge, "
+         "decode %5.1f ns/edge %6.1f cycles/edge\n",
+         trace.name, trace.n_slits, (unsigned)n, n_bytes / n,
+         4 * n / n_bytes, t_enc / n * 1e9, c_enc / n, t_dec / n * 1e9,
+         c_dec / n);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_synthetic_traces() {
+  bench(synthetic("steady", 100000, 1, 20, 20, 1));
+  bench(synthetic("steady", 100000, 20, 20, 20, 1));
+  bench(synthetic("steady", 100000, 20, 20, 20, 20));
+  bench(synthetic("run-up", 100000, 20, 1, 50, 2));
+  bench(synthetic("coast-down", 100000, 20, 50, 1, 2));
+}
+
+void test_recorded_trace() {
+  const char *path = getenv("EDGE_TRACE");
+  if (!path) {
+    TEST_IGNORE_MESSAGE("Set EDGE_TRACE to a `cb` recording to benchmark it");
+  }
+  Trace trace;
+  TEST_ASSERT_TRUE_MESSAGE(recorded(path, trace), path);
+  bench(trace);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_synthetic_traces);
+  RUN_TEST(test_recorded_trace);
+  return UNITY_END();
+}
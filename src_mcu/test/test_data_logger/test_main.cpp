@@ -0,0 +1,216 @@
+/**
+ * @file test_main.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Host test of the flash data logger, on top of the file-backed flash
+ * simulator.
+ * @copyright MIT License. See the LICENSE file for details.
+ *
+ * The simulated flash is kept small, 4 sectors of 16 pages, so that the log
+ * wraps around quickly. A restart after a power loss is simulated by reloading
+ * the flash image and starting a fresh logger on it, dropping the page that
+ * was still open in RAM.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <vector>
+
+#include "data_logger.h"
+
+static const char *PATH = "test_data_logger.bin";
+static const uint32_t PAGE_SIZE = QSPIFlash::PAGE_SIZE;
+static const uint32_t N_PAGES = 64;
+
+static QSPIFlash flash;
+static uint64_t t_us = 0; // [us] Simulated `micros64()`
+
+/**
+ * @brief Log speed records until @p n more pages have been written.
+ */
+static void write_pages(DataLogger &logger, uint32_t n) {
+  uint32_t target = logger.pageCount() + n;
+  logger.enable(true);
+  while (logger.pageCount() < target) {
+    t_us += 1000;
+    logger.logSpeed(t_us, 10.f + (t_us / 1000) % 7);
+    for (int i = 0; i < 3; ++i) {
+      logger.poll();
+    }
+  }
+}
+
+/**
+ * @brief Return the sequence numbers of the pages sent by @p logger, in order.
+ * Sending closes the page still open, which hence comes last.
+ */
+static std::vector<uint32_t> sent_seqs(DataLogger &logger) {
+  HostSerial out;
+  logger.send(out);
+  TEST_ASSERT_EQUAL(0, out.tx.size() % PAGE_SIZE);
+
+  std::vector<uint32_t> seqs;
+  for (size_t i = 0; i + PAGE_SIZE < out.tx.size(); i += PAGE_SIZE) {
+    uint32_t seq;
+    memcpy(&seq, out.tx.data() + i + 4, sizeof(seq));
+    seqs.push_back(seq);
+  }
+  TEST_ASSERT_EQUAL('L', out.tx[out.tx.size() - PAGE_SIZE]); // End block
+  return seqs;
+}
+
+static std::vector<uint32_t> range(uint32_t first, uint32_t last) {
+  std::vector<uint32_t> seqs;
+  for (uint32_t seq = first; seq <= last; ++seq) {
+    seqs.push_back(seq);
+  }
+  return seqs;
+}
+
+/**
+ * @brief Simulate a power loss while programming page @p idx, after its first
+ * @p keep bytes.
+ */
+static void tear(uint32_t idx, uint32_t keep) {
+  uint8_t blank[PAGE_SIZE];
+  memset(blank, 0xFF, sizeof(blank));
+  FILE *f = fopen(PATH, "r+b");
+  TEST_ASSERT_NOT_NULL(f);
+  fseek(f, idx * PAGE_SIZE + keep, SEEK_SET);
+  fwrite(blank, 1, PAGE_SIZE - keep, f);
+  fclose(f);
+}
+
+static void restart(DataLogger &logger) {
+  TEST_ASSERT_TRUE(flash.begin());
+  TEST_ASSERT_TRUE(logger.begin());
+}
+
+static uint32_t seq_at(uint32_t idx) {
+  uint32_t seq;
+  flash.read(idx * PAGE_SIZE + 4, &seq, sizeof(seq));
+  return seq;
+}
+
+static bool is_erased(uint32_t idx) {
+  uint8_t page[PAGE_SIZE];
+  flash.read(idx * PAGE_SIZE, page, sizeof(page));
+  for (uint8_t b : page) {
+    if (b != 0xFF) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void setUp() {
+  remove(PATH);
+  flash.setSimulationFile(PATH, N_PAGES * PAGE_SIZE);
+  TEST_ASSERT_TRUE(flash.begin());
+}
+
+void tearDown() { remove(PATH); }
+
+void test_pages_round_trip() {
+  DataLogger logger(flash);
+  TEST_ASSERT_TRUE(logger.begin());
+  TEST_ASSERT_EQUAL(1, logger.getSequence());
+
+  write_pages(logger, 5);
+  TEST_ASSERT_TRUE(range(1, 6) == sent_seqs(logger));
+  TEST_ASSERT_EQUAL(0, logger.droppedCount());
+}
+
+void test_torn_page_is_rejected() {
+  DataLogger logger(flash);
+  TEST_ASSERT_TRUE(logger.begin());
+  write_pages(logger, 6);
+
+  tear(2, 100); // Payload cut short
+  tear(4, 10);  // Header cut short
+  DataLogger restarted(flash);
+  restart(restarted);
+  std::vector<uint32_t> expected = {1, 2, 4, 6};
+  TEST_ASSERT_TRUE(expected == sent_seqs(restarted));
+}
+
+void test_resume_after_highest_seq() {
+  DataLogger logger(flash);
+  TEST_ASSERT_TRUE(logger.begin());
+  write_pages(logger, 6);
+
+  DataLogger restarted(flash);
+  restart(restarted);
+  TEST_ASSERT_EQUAL(7, restarted.getSequence());
+  write_pages(restarted, 2);
+  TEST_ASSERT_EQUAL(7, seq_at(6));
+
+  DataLogger again(flash);
+  restart(again);
+  TEST_ASSERT_EQUAL(9, again.getSequence());
+  TEST_ASSERT_TRUE(range(1, 8) == sent_seqs(again));
+}
+
+void test_resume_skips_a_torn_newest_page() {
+  DataLogger logger(flash);
+  TEST_ASSERT_TRUE(logger.begin());
+  write_pages(logger, 6);
+  tear(5, 100);
+
+  // The torn page can not be programmed again, so the log continues behind it
+  DataLogger restarted(flash);
+  restart(restarted);
+  TEST_ASSERT_EQUAL(6, restarted.getSequence());
+  write_pages(restarted, 2);
+  TEST_ASSERT_EQUAL(6, seq_at(6));
+  TEST_ASSERT_EQUAL(7, seq_at(7));
+  TEST_ASSERT_TRUE(range(1, 8) == sent_seqs(restarted));
+}
+
+void test_wrap_erases_the_sector_ahead() {
+  DataLogger logger(flash);
+  TEST_ASSERT_TRUE(logger.begin());
+  write_pages(logger, N_PAGES + 8);
+
+  // Sector 0 got erased before page 65 went in, dropping pages 1 to 16
+  TEST_ASSERT_EQUAL(65, seq_at(0));
+  TEST_ASSERT_EQUAL(72, seq_at(7));
+  for (uint32_t idx = 8; idx < 16; ++idx) {
+    TEST_ASSERT_TRUE(is_erased(idx));
+  }
+  TEST_ASSERT_EQUAL(17, seq_at(16));
+
+  DataLogger restarted(flash);
+  restart(restarted);
+  TEST_ASSERT_EQUAL(73, restarted.getSequence());
+  TEST_ASSERT_TRUE(range(17, 72) == sent_seqs(restarted));
+
+  // Continues in the erased part of sector 0, then erases sector 1
+  write_pages(restarted, 9);
+  TEST_ASSERT_EQUAL(80, seq_at(15));
+  TEST_ASSERT_EQUAL(81, seq_at(16));
+  TEST_ASSERT_TRUE(is_erased(17));
+  TEST_ASSERT_TRUE(range(33, 82) == sent_seqs(restarted));
+}
+
+void test_erase() {
+  DataLogger logger(flash);
+  TEST_ASSERT_TRUE(logger.begin());
+  write_pages(logger, 3);
+  logger.erase();
+  TEST_ASSERT_TRUE(logger.isErasing());
+  logger.poll();
+  TEST_ASSERT_FALSE(logger.isErasing());
+  TEST_ASSERT_EQUAL(0, sent_seqs(logger).size());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_pages_round_trip);
+  RUN_TEST(test_torn_page_is_rejected);
+  RUN_TEST(test_resume_after_highest_seq);
+  RUN_TEST(test_resume_skips_a_torn_newest_page);
+  RUN_TEST(test_wrap_erases_the_sector_ahead);
+  RUN_TEST(test_erase);
+  return UNITY_END();
+}
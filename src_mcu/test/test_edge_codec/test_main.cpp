@@ -0,0 +1,191 @@
+/**
+ * @file test_main.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Host test of the edge timestamp encoder and decoder.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <vector>
+
+#include "edge_codec.h"
+
+/**
+ * @brief Return @p n edge timestamps of a disk with @p n_slits unevenly
+ * spaced slits, turning at @p revps with a small jitter. The first edge is at
+ * @p t0_us.
+ */
+static std::vector<uint32_t> make_edges(uint32_t n, uint16_t n_slits,
+                                        float revps, uint32_t t0_us = 1000) {
+  std::vector<uint32_t> stamps;
+  double t = t0_us;
+  srand(1);
+  for (uint32_t i = 0; i < n; ++i) {
+    stamps.push_back((uint32_t)llround(t));
+    double spacing = 1. + (n_slits > 1 ? 0.03 * sin(i % n_slits) : 0);
+    double jitter = (rand() % 5) - 2;
+    t += 1e6 / (revps * n_slits) * spacing + jitter;
+  }
+  return stamps;
+}
+
+static std::vector<uint8_t> encode(EdgeEncoder &enc,
+                                   const std::vector<uint32_t> &stamps,
+                                   std::vector<size_t> *token_at = nullptr) {
+  std::vector<uint8_t> bytes;
+  uint8_t token[EdgeEncoder::MAX_TOKEN];
+  for (uint32_t stamp : stamps) {
+    if (token_at) {
+      token_at->push_back(bytes.size());
+    }
+    uint8_t len = enc.encode(stamp, token);
+    bytes.insert(bytes.end(), token, token + len);
+  }
+  return bytes;
+}
+
+static std::vector<uint32_t> decode(EdgeDecoder &dec,
+                                    const std::vector<uint8_t> &bytes,
+                                    size_t from = 0) {
+  std::vector<uint32_t> stamps;
+  uint32_t stamp;
+  for (size_t i = from; i < bytes.size(); ++i) {
+    if (dec.push(bytes[i], stamp)) {
+      stamps.push_back(stamp);
+    }
+  }
+  return stamps;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_round_trip_single_slit() {
+  std::vector<uint32_t> stamps = make_edges(1000, 1, 25);
+  EdgeEncoder enc(1);
+  EdgeDecoder dec(1);
+  std::vector<uint8_t> bytes = encode(enc, stamps);
+
+  TEST_ASSERT_TRUE(stamps == decode(dec, bytes));
+  TEST_ASSERT_TRUE(bytes.size() < stamps.size() * 1.1); // ~1 byte per edge
+}
+
+void test_round_trip_uneven_slits() {
+  // The slits are 3% apart from even, far beyond a single byte residual at
+  // this speed. The predictor cancels the pattern after one revolution.
+  const uint16_t N = 20;
+  std::vector<uint32_t> stamps = make_edges(1000, N, 10);
+  EdgeEncoder enc(N);
+  EdgeDecoder dec(N);
+  std::vector<size_t> token_at;
+  std::vector<uint8_t> bytes = encode(enc, stamps, &token_at);
+
+  TEST_ASSERT_TRUE(stamps == decode(dec, bytes));
+  for (size_t i = N + 2; i < 256; ++i) {
+    TEST_ASSERT_EQUAL(1, token_at[i + 1] - token_at[i]);
+  }
+
+  // Without knowing the number of slits it costs more
+  EdgeEncoder enc_1(1);
+  TEST_ASSERT_TRUE(encode(enc_1, stamps).size() > bytes.size() + 500);
+}
+
+void test_round_trip_across_the_32_bit_wrap() {
+  std::vector<uint32_t> stamps = make_edges(500, 8, 20, 0xFFFF0000);
+  EdgeEncoder enc(8);
+  EdgeDecoder dec(8);
+  TEST_ASSERT_TRUE(stamps == decode(dec, encode(enc, stamps)));
+}
+
+void test_keyframe_interval() {
+  std::vector<uint32_t> stamps = make_edges(100, 4, 20);
+  EdgeEncoder enc(4, 10);
+  std::vector<size_t> token_at;
+  std::vector<uint8_t> bytes = encode(enc, stamps, &token_at);
+
+  for (size_t i = 0; i < stamps.size(); ++i) {
+    bool key = (bytes[token_at[i]] == 1);
+    TEST_ASSERT_EQUAL(i % 11 == 0, key); // Key plus 10 regular edges
+  }
+}
+
+void test_keyframe_resync_mid_stream() {
+  const uint16_t N = 8;
+  std::vector<uint32_t> stamps = make_edges(200, N, 20);
+  EdgeEncoder enc(N, 50);
+  std::vector<size_t> token_at;
+  std::vector<uint8_t> bytes = encode(enc, stamps, &token_at);
+
+  // Joining halfway, the decoder stays silent until the keyframe of edge 51
+  EdgeDecoder dec(N);
+  std::vector<uint32_t> decoded = decode(dec, bytes, token_at[30] + 1);
+  std::vector<uint32_t> expected(stamps.begin() + 51, stamps.end());
+  TEST_ASSERT_TRUE(expected == decoded);
+
+  // After losing bytes, a reset drops sync up to the next keyframe
+  EdgeDecoder dec_2(N);
+  std::vector<uint8_t> lossy(bytes.begin(), bytes.begin() + token_at[60]);
+  lossy.insert(lossy.end(), bytes.begin() + token_at[70], bytes.end());
+  uint32_t stamp;
+  decoded.clear();
+  for (size_t i = 0; i < lossy.size(); ++i) {
+    if (i == token_at[60]) {
+      dec_2.reset();
+      TEST_ASSERT_FALSE(dec_2.isSynced());
+    }
+    if (dec_2.push(lossy[i], stamp)) {
+      decoded.push_back(stamp);
+    }
+  }
+  expected.assign(stamps.begin(), stamps.begin() + 60);
+  expected.insert(expected.end(), stamps.begin() + 102, stamps.end());
+  TEST_ASSERT_TRUE(expected == decoded);
+}
+
+void test_residual_overflow_forces_a_keyframe() {
+  const uint16_t N = 4;
+  std::vector<uint32_t> stamps = make_edges(40, N, 20);
+
+  // A standstill of over 2^30 us between edges 20 and 21
+  for (size_t i = 21; i < stamps.size(); ++i) {
+    stamps[i] += 1200000000;
+  }
+  EdgeEncoder enc(N);
+  std::vector<size_t> token_at;
+  std::vector<uint8_t> bytes = encode(enc, stamps, &token_at);
+  TEST_ASSERT_EQUAL(1, bytes[token_at[0]]);
+  TEST_ASSERT_EQUAL(1, bytes[token_at[21]]);
+  TEST_ASSERT_EQUAL(1, bytes[token_at[22]]); // Predicted from the long gap
+  TEST_ASSERT_TRUE(bytes[token_at[23]] != 1);
+
+  EdgeDecoder dec(N);
+  TEST_ASSERT_TRUE(stamps == decode(dec, bytes));
+}
+
+void test_encoder_reset_emits_a_keyframe() {
+  std::vector<uint32_t> stamps = make_edges(20, 1, 20);
+  EdgeEncoder enc(1);
+  std::vector<size_t> token_at;
+  std::vector<uint8_t> bytes = encode(enc, stamps, &token_at);
+  TEST_ASSERT_TRUE(bytes[token_at[10]] != 1);
+
+  enc.reset();
+  uint8_t token[EdgeEncoder::MAX_TOKEN];
+  TEST_ASSERT_EQUAL(6, enc.encode(stamps.back() + 5000, token));
+  TEST_ASSERT_EQUAL(1, token[0]);
+  TEST_ASSERT_EQUAL(0, token[5]); // Period unknown
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip_single_slit);
+  RUN_TEST(test_round_trip_uneven_slits);
+  RUN_TEST(test_round_trip_across_the_32_bit_wrap);
+  RUN_TEST(test_keyframe_interval);
+  RUN_TEST(test_keyframe_resync_mid_stream);
+  RUN_TEST(test_residual_overflow_forces_a_keyframe);
+  RUN_TEST(test_encoder_reset_emits_a_keyframe);
+  return UNITY_END();
+}
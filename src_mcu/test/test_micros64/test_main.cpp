@@ -0,0 +1,114 @@
+/**
+ * @file test_main.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Host test of the 64-bit extension of `micros()`, across its
+ * wraparound and through it stepping back a tick.
+ * @copyright MIT License. See the LICENSE file for details.
+ *
+ * The extension keeps its state between calls, so the tests run in order on a
+ * single simulated clock that only moves forward, apart from the deliberate
+ * steps back.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "micros64.h"
+
+static const uint64_t WRAP = 1ULL << 32;
+static const uint32_t T_CALL = 30 * 60 * 1000000UL; // [us] Max. between calls
+
+void setUp() {}
+void tearDown() {}
+
+void test_follows_micros_up_to_the_wrap() {
+  host::micros_now = 0;
+  TEST_ASSERT_EQUAL_UINT64(0, micros64());
+
+  while (host::micros_now < 0xFFFFFF00 - T_CALL) {
+    host::micros_now += T_CALL;
+    TEST_ASSERT_EQUAL_UINT64(host::micros_now, micros64());
+  }
+  host::micros_now = 0xFFFFFF00;
+  TEST_ASSERT_EQUAL_UINT64(0xFFFFFF00, micros64());
+}
+
+void test_across_the_wrap() {
+  uint64_t prev = micros64();
+  for (uint32_t i = 0; i < 0x200; ++i) {
+    host::micros_now++;
+    uint64_t now = micros64();
+    TEST_ASSERT_EQUAL_UINT64(prev + 1, now);
+    prev = now;
+  }
+  TEST_ASSERT_EQUAL_UINT64(WRAP + 0x100, prev);
+}
+
+void test_extend_across_the_wrap() {
+  // Stamps of before and after the wrap, extended after it
+  host::micros_now = 0x1000;
+  TEST_ASSERT_EQUAL_UINT64(WRAP - 0x10, micros64_extend(0xFFFFFFF0));
+  TEST_ASSERT_EQUAL_UINT64(WRAP + 0x800, micros64_extend(0x800));
+  TEST_ASSERT_EQUAL_UINT64(WRAP + 0x1000, micros64_extend(0x1000));
+
+  // Up to the 35 minutes of the longest interval between calls
+  TEST_ASSERT_EQUAL_UINT64(WRAP + 0x1000 - T_CALL,
+                           micros64_extend(0x1000 - T_CALL));
+}
+
+void test_one_tick_step_back_is_held() {
+  host::micros_now = 0x5000;
+  uint64_t t = micros64();
+  TEST_ASSERT_EQUAL_UINT64(WRAP + 0x5000, t);
+
+  // Stepping back a tick holds the last value instead of counting a wrap
+  host::micros_now -= 1000;
+  TEST_ASSERT_EQUAL_UINT64(t, micros64());
+  host::micros_now += 1000;
+  TEST_ASSERT_EQUAL_UINT64(t, micros64());
+  host::micros_now += 1;
+  TEST_ASSERT_EQUAL_UINT64(t + 1, micros64());
+}
+
+void test_extend_through_a_step_back() {
+  // A stamp taken by an ISR, after which `micros()` steps back a tick when
+  // read for the extension
+  host::micros_now = 0x9000;
+  micros64();
+  host::micros_now += 100;
+  uint32_t stamp = host::micros_now;
+  host::micros_now -= 1000;
+  TEST_ASSERT_EQUAL_UINT64(WRAP + stamp, micros64_extend(stamp));
+  host::micros_now += 1000;
+  TEST_ASSERT_EQUAL_UINT64(WRAP + stamp, micros64_extend(stamp));
+}
+
+void test_step_back_right_after_the_wrap() {
+  // Advance to the next wrap in steps of 30 minutes
+  while (host::micros_now < 0xFFFFFFFF - T_CALL) {
+    host::micros_now += T_CALL;
+    micros64();
+  }
+  host::micros_now = 0xFFFFFFFF;
+  TEST_ASSERT_EQUAL_UINT64(2 * WRAP - 1, micros64());
+  host::micros_now = 2;
+  TEST_ASSERT_EQUAL_UINT64(2 * WRAP + 2, micros64());
+
+  // Stepping back across the wrap is not a second wrap
+  host::micros_now = 0xFFFFFFFE;
+  TEST_ASSERT_EQUAL_UINT64(2 * WRAP + 2, micros64());
+  TEST_ASSERT_EQUAL_UINT64(2 * WRAP - 2, micros64_extend(0xFFFFFFFE));
+  host::micros_now = 3;
+  TEST_ASSERT_EQUAL_UINT64(2 * WRAP + 3, micros64());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_follows_micros_up_to_the_wrap);
+  RUN_TEST(test_across_the_wrap);
+  RUN_TEST(test_extend_across_the_wrap);
+  RUN_TEST(test_one_tick_step_back_is_held);
+  RUN_TEST(test_extend_through_a_step_back);
+  RUN_TEST(test_step_back_right_after_the_wrap);
+  return UNITY_END();
+}
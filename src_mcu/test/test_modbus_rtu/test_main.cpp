@@ -0,0 +1,268 @@
+/**
+ * @file test_main.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Host test of the Modbus RTU slave against a master on the other end
+ * of a pseudo terminal.
+ * @copyright MIT License. See the LICENSE file for details.
+ *
+ * The slave reads and writes the pty like it would a serial port. The master
+ * side writes whole request frames and collects the reply bytes, while the
+ * simulated `micros()` advances in steps of 100 us per call to `poll()`.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "modbus_rtu.h"
+
+static const uint8_t ADDRESS = 17;
+static const uint32_t BAUD = 19200;
+static const uint32_t T_STEP = 100; // [us] Simulated time per `poll()`
+
+/**
+ * @brief Stream on the slave end of the pty.
+ */
+class PtyStream : public Stream {
+public:
+  int fd = -1;
+
+  size_t write(uint8_t byte) override { return write(&byte, 1); }
+  size_t write(const uint8_t *buf, size_t len) override {
+    ssize_t n = ::write(fd, buf, len);
+    return (n > 0 ? (size_t)n : 0);
+  }
+  using Print::write;
+  int availableForWrite() override { return 64; }
+
+  int available() override {
+    int n = 0;
+    ioctl(fd, FIONREAD, &n);
+    return n;
+  }
+  int read() override {
+    uint8_t c;
+    return (::read(fd, &c, 1) == 1 ? c : -1);
+  }
+  int peek() override { return -1; }
+};
+
+static int master_fd = -1;
+static PtyStream port;
+
+static uint16_t holding[8];
+static uint16_t input[4] = {0x1234, 0x5678, 0x9ABC, 0xDEF0};
+
+static void read_input(uint16_t *regs) { memcpy(regs, input, sizeof(input)); }
+static void read_holding(uint16_t *regs) {
+  memcpy(regs, holding, sizeof(holding));
+}
+static uint8_t write_holding(uint16_t addr, uint16_t count,
+                             const uint16_t *regs) {
+  if (addr == 7) {
+    return ModbusRTU::ILLEGAL_DATA_VALUE; // Read-only in this map
+  }
+  memcpy(&holding[addr], regs, count * sizeof(uint16_t));
+  return ModbusRTU::NONE;
+}
+
+static const ModbusRTU::RegisterMap MAP = {4, 8, read_input, read_holding,
+                                           write_holding};
+static ModbusRTU modbus(port, MAP);
+
+static void raw(int fd) {
+  struct termios tio;
+  tcgetattr(fd, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(fd, TCSANOW, &tio);
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+/**
+ * @brief Send @p len request bytes, appending the CRC, and return the reply
+ * collected within @p timeout_us of simulated time.
+ */
+static std::string transact(const uint8_t *req, size_t len,
+                            uint32_t timeout_us = 20000) {
+  uint8_t frame[ModbusRTU::MAX_FRAME];
+  memcpy(frame, req, len);
+  uint16_t crc = ModbusRTU::crc16(frame, len);
+  frame[len] = crc & 0xFF;
+  frame[len + 1] = crc >> 8;
+  TEST_ASSERT_EQUAL(len + 2, (size_t)write(master_fd, frame, len + 2));
+  usleep(1000); // Let the pty pass the frame on in full
+
+  std::string reply;
+  for (uint32_t t = 0; t < timeout_us; t += T_STEP) {
+    modbus.poll();
+    host::micros_now += T_STEP;
+    uint8_t buf[64];
+    ssize_t n = read(master_fd, buf, sizeof(buf));
+    if (n > 0) {
+      reply.append((const char *)buf, n);
+    }
+  }
+  return reply;
+}
+
+static bool crc_ok(const std::string &reply) {
+  size_t n = reply.size();
+  if (n < 4) {
+    return false;
+  }
+  uint16_t crc = ModbusRTU::crc16((const uint8_t *)reply.data(), n - 2);
+  return (uint8_t)reply[n - 2] == (crc & 0xFF) &&
+         (uint8_t)reply[n - 1] == (crc >> 8);
+}
+
+void setUp() {
+  memset(holding, 0, sizeof(holding));
+  modbus.begin(ADDRESS, BAUD);
+}
+
+void tearDown() {}
+
+void test_read_input_registers() {
+  const uint8_t req[] = {ADDRESS, 4, 0, 1, 0, 2};
+  std::string reply = transact(req, sizeof(req));
+  TEST_ASSERT_EQUAL(9, reply.size());
+  TEST_ASSERT_TRUE(crc_ok(reply));
+  const uint8_t expected[] = {ADDRESS, 4, 4, 0x56, 0x78, 0x9A, 0xBC};
+  TEST_ASSERT_EQUAL_MEMORY(expected, reply.data(), sizeof(expected));
+  TEST_ASSERT_EQUAL(1, modbus.requestCount());
+}
+
+void test_write_then_read_holding_registers() {
+  const uint8_t write_multiple[] = {ADDRESS, 16, 0, 2, 0, 2, 4, 0xAB, 0xCD,
+                                    0x00,    0x2A};
+  std::string reply = transact(write_multiple, sizeof(write_multiple));
+  TEST_ASSERT_EQUAL(8, reply.size());
+  TEST_ASSERT_TRUE(crc_ok(reply));
+  TEST_ASSERT_EQUAL_MEMORY(write_multiple, reply.data(), 6); // Echo
+
+  const uint8_t write_single[] = {ADDRESS, 6, 0, 5, 0x01, 0x02};
+  reply = transact(write_single, sizeof(write_single));
+  TEST_ASSERT_EQUAL(8, reply.size());
+  TEST_ASSERT_EQUAL_MEMORY(write_single, reply.data(), 6);
+
+  const uint8_t read[] = {ADDRESS, 3, 0, 2, 0, 4};
+  reply = transact(read, sizeof(read));
+  TEST_ASSERT_EQUAL(13, reply.size());
+  TEST_ASSERT_TRUE(crc_ok(reply));
+  const uint8_t expected[] = {ADDRESS, 3,    8, 0xAB, 0xCD, 0x00,
+                              0x2A,    0x00, 0, 0x01, 0x02};
+  TEST_ASSERT_EQUAL_MEMORY(expected, reply.data(), sizeof(expected));
+}
+
+void test_exceptions() {
+  const uint8_t out_of_range[] = {ADDRESS, 3, 0, 6, 0, 3};
+  std::string reply = transact(out_of_range, sizeof(out_of_range));
+  TEST_ASSERT_EQUAL(5, reply.size());
+  TEST_ASSERT_EQUAL(0x83, (uint8_t)reply[1]);
+  TEST_ASSERT_EQUAL(ModbusRTU::ILLEGAL_DATA_ADDRESS, reply[2]);
+
+  const uint8_t bad_function[] = {ADDRESS, 5, 0, 0, 0xFF, 0};
+  reply = transact(bad_function, sizeof(bad_function));
+  TEST_ASSERT_EQUAL(5, reply.size());
+  TEST_ASSERT_EQUAL(0x85, (uint8_t)reply[1]);
+  TEST_ASSERT_EQUAL(ModbusRTU::ILLEGAL_FUNCTION, reply[2]);
+
+  const uint8_t read_only[] = {ADDRESS, 6, 0, 7, 0, 1};
+  reply = transact(read_only, sizeof(read_only));
+  TEST_ASSERT_EQUAL(5, reply.size());
+  TEST_ASSERT_EQUAL(ModbusRTU::ILLEGAL_DATA_VALUE, reply[2]);
+  TEST_ASSERT_EQUAL(3, modbus.exceptionCount());
+}
+
+void test_no_reply_to_others_broadcast_or_bad_crc() {
+  const uint8_t other[] = {ADDRESS + 1, 3, 0, 0, 0, 1};
+  TEST_ASSERT_EQUAL(0, transact(other, sizeof(other)).size());
+
+  const uint8_t broadcast[] = {0, 6, 0, 1, 0x12, 0x34};
+  TEST_ASSERT_EQUAL(0, transact(broadcast, sizeof(broadcast)).size());
+  TEST_ASSERT_EQUAL(0x1234, holding[1]); // But applied
+
+  // Corrupt the CRC by sending the frame without it
+  const uint8_t no_crc[] = {ADDRESS, 3, 0, 0, 0, 1, 0, 0};
+  TEST_ASSERT_EQUAL(8, write(master_fd, no_crc, sizeof(no_crc)));
+  usleep(1000);
+  for (int i = 0; i < 100; ++i) {
+    modbus.poll();
+    host::micros_now += T_STEP;
+  }
+  uint8_t buf[16];
+  TEST_ASSERT_TRUE(read(master_fd, buf, sizeof(buf)) <= 0);
+  TEST_ASSERT_EQUAL(1, modbus.errorCount());
+}
+
+void test_frames_need_the_silence_in_between() {
+  // Back to back without a silence, both frames merge into one bad frame
+  const uint8_t req[] = {ADDRESS, 4, 0, 0, 0, 1};
+  uint8_t frame[16];
+  memcpy(frame, req, sizeof(req));
+  uint16_t crc = ModbusRTU::crc16(frame, sizeof(req));
+  frame[6] = crc & 0xFF;
+  frame[7] = crc >> 8;
+  memcpy(frame + 8, frame, 8);
+  TEST_ASSERT_EQUAL(16, write(master_fd, frame, 16));
+  usleep(1000);
+  for (int i = 0; i < 100; ++i) {
+    modbus.poll();
+    host::micros_now += T_STEP;
+  }
+  uint8_t buf[16];
+  TEST_ASSERT_TRUE(read(master_fd, buf, sizeof(buf)) <= 0);
+  TEST_ASSERT_EQUAL(1, modbus.errorCount());
+
+  // After the silence the next request gets answered as usual
+  TEST_ASSERT_EQUAL(7, transact(req, sizeof(req)).size());
+}
+
+void test_bytes_received_while_off_are_discarded() {
+  modbus.begin(0, BAUD);
+  const uint8_t junk[] = {ADDRESS, 4, 0, 0};
+  TEST_ASSERT_EQUAL(4, write(master_fd, junk, sizeof(junk)));
+  usleep(1000);
+  for (int i = 0; i < 10; ++i) {
+    modbus.poll();
+    host::micros_now += T_STEP;
+  }
+
+  // Switched on right away, without a silence after the junk
+  modbus.begin(ADDRESS, BAUD);
+  const uint8_t req[] = {ADDRESS, 4, 0, 3, 0, 1};
+  std::string reply = transact(req, sizeof(req));
+  TEST_ASSERT_EQUAL(7, reply.size());
+  TEST_ASSERT_EQUAL(0xDE, (uint8_t)reply[3]);
+  TEST_ASSERT_EQUAL(0, modbus.errorCount());
+}
+
+int main() {
+  master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master_fd < 0 || grantpt(master_fd) || unlockpt(master_fd)) {
+    return 1;
+  }
+  port.fd = open(ptsname(master_fd), O_RDWR | O_NOCTTY);
+  if (port.fd < 0) {
+    return 1;
+  }
+  raw(master_fd);
+  raw(port.fd);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_read_input_registers);
+  RUN_TEST(test_write_then_read_holding_registers);
+  RUN_TEST(test_exceptions);
+  RUN_TEST(test_no_reply_to_others_broadcast_or_bad_crc);
+  RUN_TEST(test_frames_need_the_silence_in_between);
+  RUN_TEST(test_bytes_received_while_off_are_discarded);
+  int result = UNITY_END();
+
+  close(port.fd);
+  close(master_fd);
+  return result;
+}
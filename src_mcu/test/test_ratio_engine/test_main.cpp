@@ -0,0 +1,96 @@
+/**
+ * @file test_main.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Host test of the speed ratio between two tacho channels, on
+ * simulated edge streams.
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "ratio_engine.h"
+
+static const uint16_t N_SLITS_A = 20;
+static const uint16_t N_SLITS_B = 10;
+static const uint16_t WINDOW = 40;
+static const uint32_t TIMEOUT = 200000; // [us]
+
+/**
+ * @brief Two shafts turning at a constant rate, A at @ref REVPS_A and B at
+ * @ref REVPS_B, sampled at every up-flank of A like the ISR does.
+ */
+static const float REVPS_A = 10;
+static const float REVPS_B = 4;
+
+static RatioEngine ratio(N_SLITS_A, N_SLITS_B, WINDOW, TIMEOUT);
+static uint32_t n_A = 0;
+
+static RatioSample sample(uint32_t n) {
+  const double T_A = 1e6 / (REVPS_A * N_SLITS_A); // [us]
+  const double T_B = 1e6 / (REVPS_B * N_SLITS_B); // [us]
+  double t_A = 1e6 + n * T_A;
+  uint32_t n_B = (uint32_t)(t_A / T_B);
+  return {(uint32_t)t_A, n, n_B, (uint32_t)(n_B * T_B), (uint32_t)T_B};
+}
+
+/**
+ * @brief Take the next @p n samples, of which only the last @p pushed get to
+ * the engine.
+ */
+static void run(uint32_t n, uint32_t pushed) {
+  for (uint32_t i = 0; i < n; ++i) {
+    RatioSample s = sample(++n_A);
+    if (i >= n - pushed) {
+      ratio.push(s);
+    }
+  }
+}
+
+void setUp() {
+  n_A = 0;
+  ratio.reset();
+}
+
+void tearDown() {}
+
+void test_ratio() {
+  run(WINDOW, WINDOW);
+  TEST_ASSERT_TRUE(isnan(ratio.ratio())); // Window not yet full
+  run(1, 1);
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, REVPS_A / REVPS_B, ratio.ratio());
+  run(500, 500);
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, REVPS_A / REVPS_B, ratio.ratio());
+
+  ratio.setNominalRatio(2.4f);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, (1 - 2.4f / 2.5f) * 100, ratio.slip());
+}
+
+void test_dropped_samples_restart_the_window() {
+  run(100, 100);
+
+  // 30 samples lost on the way. Without noticing, the next ratio would be
+  // taken over 30 more edges of A than the window holds.
+  run(31, 1);
+  TEST_ASSERT_TRUE(isnan(ratio.ratio()));
+  run(WINDOW - 1, WINDOW - 1);
+  TEST_ASSERT_TRUE(isnan(ratio.ratio()));
+  run(1, 1);
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, REVPS_A / REVPS_B, ratio.ratio());
+}
+
+void test_standstill_of_B() {
+  run(100, 100);
+  RatioSample s = sample(++n_A);
+  s.t_B = s.t_A - TIMEOUT - 1;
+  ratio.push(s);
+  TEST_ASSERT_TRUE(isnan(ratio.ratio()));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_ratio);
+  RUN_TEST(test_dropped_samples_restart_the_window);
+  RUN_TEST(test_standstill_of_B);
+  return UNITY_END();
+}
@@ -0,0 +1,158 @@
+/**
+ * @file test_main.cpp
+ * @author Dennis van Gils (vangils.dennis@gmail.com)
+ * @brief Host test of the PID speed controller, closing the loop over a
+ * simulated motor and disk.
+ * @copyright MIT License. See the LICENSE file for details.
+ *
+ * The plant is a first-order model of a DC motor driving the slotted disk:
+ * the rotation rate follows the PWM duty cycle with a mechanical time
+ * constant `TAU`, up to `REVPS_MAX` at full duty. The controller runs from the
+ * simulated control timer at the same rate as in `main.cpp`.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "control_timer.h"
+#include "speed_pid.h"
+
+static const uint16_t PID_RATE = 500;     // [Hz] As in `main.cpp`
+static const uint16_t PID_PWM_MAX = 4095; // As in `main.cpp`
+static const float DT = 1.f / PID_RATE;   // [s]
+
+static const float TAU = 0.5f;       // [s] Mechanical time constant
+static const float REVPS_MAX = 50.f; // [rev/s] At full duty cycle
+static const float FRICTION = 150.f; // Duty cycle needed to start turning
+
+static SpeedPID pid(DT, 0, PID_PWM_MAX);
+static float plant_revps = 0; // [rev/s] Simulated rotation rate
+
+/**
+ * @brief One control step: measure, update the controller and advance the
+ * plant by one interval.
+ */
+static void pid_tick() {
+  float duty = pid.update(plant_revps);
+  float drive = max(duty - FRICTION, 0.f) / (PID_PWM_MAX - FRICTION);
+  plant_revps += (drive * REVPS_MAX - plant_revps) * DT / TAU;
+}
+
+/**
+ * @brief Run the loop for @p seconds and return the largest rotation rate
+ * seen. The time after which the rate stayed within @p band of @p target is
+ * returned in @p t_settled.
+ */
+static float run(float seconds, float target = 0, float band = 0,
+                 float *t_settled = nullptr) {
+  uint32_t n = (uint32_t)(seconds * PID_RATE);
+  float peak = plant_revps;
+  for (uint32_t i = 1; i <= n; ++i) {
+    host::micros_now += 1000000UL / PID_RATE;
+    control_timer_tick();
+    peak = max(peak, plant_revps);
+    if (t_settled && fabsf(plant_revps - target) > band) {
+      *t_settled = i * DT;
+    }
+  }
+  return peak;
+}
+
+void setUp() {
+  host::micros_now = 1000;
+  plant_revps = 0;
+  pid.setGains(400, 800, 0);
+  pid.setFeedForward((PID_PWM_MAX - FRICTION) / REVPS_MAX, FRICTION);
+  pid.setRampRate(0);
+  pid.setSetpoint(0);
+  pid.reset(0);
+  control_timer_begin(PID_RATE, pid_tick);
+}
+
+void tearDown() { control_timer_end(); }
+
+void test_step_response() {
+  pid.setSetpoint(20);
+  float t_settled = 0;
+  float peak = run(3, 20, 0.4f, &t_settled);
+
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 20, plant_revps);
+  TEST_ASSERT_TRUE(peak < 20 * 1.05f); // < 5% overshoot
+  TEST_ASSERT_TRUE(t_settled < 1.f);   // Within 2%
+}
+
+void test_step_response_with_a_wrong_feed_forward() {
+  // The integral has to make up for a plant that is 20% weaker than assumed
+  pid.setFeedForward(0.8f * (PID_PWM_MAX - FRICTION) / REVPS_MAX, 0);
+  pid.setSetpoint(20);
+  float t_settled = 0;
+  float peak = run(3, 20, 0.4f, &t_settled);
+
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 20, plant_revps);
+  TEST_ASSERT_TRUE(peak < 20 * 1.10f);
+  TEST_ASSERT_TRUE(t_settled < 1.5f);
+}
+
+void test_anti_windup() {
+  // The output saturates for most of the run-up. Without anti-windup the
+  // integral would keep growing and overshoot by far at the end.
+  pid.setFeedForward(0, 0);
+  pid.setSetpoint(45);
+  float t_settled = 0;
+  float peak = run(5, 45, 0.9f, &t_settled);
+
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 45, plant_revps);
+  TEST_ASSERT_TRUE(peak < 45 * 1.02f);
+  TEST_ASSERT_TRUE(t_settled < 2.f);
+}
+
+void test_ramp_rate() {
+  pid.setRampRate(10); // [rev/s^2]
+  pid.setSetpoint(20);
+
+  run(1);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 10, pid.getRampedSetpoint());
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 10, plant_revps); // Tracks the ramp
+
+  run(1.1f);
+  TEST_ASSERT_EQUAL_FLOAT(20, pid.getRampedSetpoint());
+
+  float peak = run(2);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 20, plant_revps);
+  TEST_ASSERT_TRUE(peak < 20 * 1.05f);
+}
+
+void test_no_derivative_kick_on_setpoint_step() {
+  pid.setGains(400, 0, 50);
+  pid.setFeedForward(0, 0);
+  run(0.1f);
+  float out = pid.getOutput();
+
+  // The plant stands still, so the derivative on the measurement is zero and
+  // the step only shows through the proportional term
+  pid.setSetpoint(1);
+  TEST_ASSERT_EQUAL_FLOAT(out + 400, pid.update(plant_revps));
+}
+
+void test_control_timer_jitter() {
+  run(0.1f);
+  TEST_ASSERT_EQUAL(0, control_timer_jitter());
+
+  host::micros_now += 1000000UL / PID_RATE + 30; // One tick late
+  control_timer_tick();
+  TEST_ASSERT_EQUAL(30, control_timer_jitter());
+
+  control_timer_reset_jitter();
+  TEST_ASSERT_EQUAL(0, control_timer_jitter());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_step_response);
+  RUN_TEST(test_step_response_with_a_wrong_feed_forward);
+  RUN_TEST(test_anti_windup);
+  RUN_TEST(test_ramp_rate);
+  RUN_TEST(test_no_derivative_kick_on_setpoint_step);
+  RUN_TEST(test_control_timer_jitter);
+  return UNITY_END();
+}